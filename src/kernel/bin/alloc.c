@@ -20,43 +20,264 @@
 #include "alloc.h"
 #include <stddef.h>
 #include <string.h>
-#include "memzone.h"
+#include "allocstat.h"
+#include "page.h"
+#include "pte.h"
+#include "slab.h"
+#include "trace.h"
+#include "vmem.h"
+
 /*
-#include "vmemarea.h"
-*/
+ * Small allocations come from slab caches of fixed size classes.
+ * Larger allocations are backed by whole pages that start with a
+ * header. The header's first word is NULL, which tells it apart
+ * from slab headers.
+ */
+
+struct large_alloc
+{
+        struct slab_cache *cache; /* always NULL */
+        size_t             npages;
+        unsigned long      pad[SLAB_CACHE_LINE_SIZE / sizeof(unsigned long) - 2];
+};
+
+static const size_t g_kmalloc_size[] =
+{
+        16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+enum
+{
+        KMALLOC_NCLASSES = ARRAY_NELEMS(g_kmalloc_size),
+        KMALLOC_MAX_SIZE = 1024,
+        KMALLOC_GRANULE  = 16
+};
+
+static struct slab_cache g_kmalloc_cache[KMALLOC_NCLASSES];
+
+/* maps (nbytes-1)/KMALLOC_GRANULE to the size class */
+static unsigned char g_kmalloc_class[KMALLOC_MAX_SIZE / KMALLOC_GRANULE];
+
+static struct vmem *g_kernel_as;
 
-static struct memzone g_memzone_kernel;
+/* pages of large allocations */
+static struct semaphore g_large_sem = SEMAPHORE_INITIALIZER(g_large_sem, 1);
+static size_t           g_large_npages;
+
+static size_t
+size_class_align(size_t size)
+{
+        size_t align;
+
+        /* largest power of two that divides the size */
+        align = size & -size;
+
+        return align < SLAB_CACHE_LINE_SIZE ? align : SLAB_CACHE_LINE_SIZE;
+}
 
 int
 allocator_init(struct vmem *as)
 {
-        return memzone_init(&g_memzone_kernel, as, VMEM_AREA_KERNEL);
+        int err;
+        size_t i, j;
+
+        g_kernel_as = as;
+
+        for (i = 0, j = 0; i < KMALLOC_NCLASSES; ++i)
+        {
+                if ((err = slab_cache_init(g_kmalloc_cache + i,
+                                           g_kmalloc_size[i],
+                                           size_class_align(g_kmalloc_size[i]),
+                                           NULL)) < 0)
+                {
+                        goto err_slab_cache_init;
+                }
+
+                for (; j < g_kmalloc_size[i] / KMALLOC_GRANULE; ++j)
+                {
+                        g_kmalloc_class[j] = i;
+                }
+        }
+
+        return 0;
+
+err_slab_cache_init:
+        return err;
+}
+
+static void *
+kmalloc_large(size_t nbytes)
+{
+        size_t npages;
+        struct large_alloc *hdr;
+
+        npages = page_count(0, sizeof(*hdr) + nbytes);
+
+        if (!(hdr = kmalloc_pages(npages)))
+        {
+                return NULL;
+        }
+
+        hdr->cache = NULL;
+        hdr->npages = npages;
+
+        semaphore_enter(&g_large_sem);
+        g_large_npages += npages;
+        semaphore_leave(&g_large_sem);
+
+        return hdr + 1;
 }
 
-void *
-kmalloc(size_t nbytes)
+static struct large_alloc *
+large_alloc_of(void *mem)
+{
+        return ((struct large_alloc *)mem) - 1;
+}
+
+static void *
+alloc_mem(size_t nbytes)
+{
+        if (!nbytes)
+        {
+                return NULL;
+        }
+        else if (nbytes > KMALLOC_MAX_SIZE)
+        {
+                return kmalloc_large(nbytes);
+        }
+
+        return slab_cache_alloc(g_kmalloc_cache +
+                                g_kmalloc_class[(nbytes - 1) / KMALLOC_GRANULE]);
+}
+
+static size_t
+mem_size(void *mem)
+{
+        struct slab_cache *cache;
+
+        if ((cache = slab_cache_of_object(mem)))
+        {
+                return cache->size;
+        }
+
+        return page_memory(large_alloc_of(mem)->npages) -
+               sizeof(struct large_alloc);
+}
+
+static void
+free_mem(void *mem)
+{
+        struct slab_cache *cache;
+        struct large_alloc *hdr;
+
+        if ((cache = slab_cache_of_object(mem)))
+        {
+                slab_cache_free(cache, mem);
+                return;
+        }
+
+        hdr = large_alloc_of(mem);
+
+        semaphore_enter(&g_large_sem);
+        g_large_npages -= hdr->npages;
+        semaphore_leave(&g_large_sem);
+
+        kfree_pages(hdr, hdr->npages);
+}
+
+#ifdef ALLOC_STATS
+
+/*
+ * With ALLOC_STATS, each allocation is preceded by a tag that
+ * records the call site and the requested size.
+ */
+
+struct alloc_tag
+{
+        const void    *site;
+        size_t         nbytes;
+        unsigned long  pad[2]; /* keep 16-byte alignment */
+};
+
+static void *
+kmalloc_from(size_t nbytes, const void *site)
+{
+        struct alloc_tag *tag;
+
+        if (!nbytes)
+        {
+                return NULL;
+        }
+
+        if (!(tag = alloc_mem(sizeof(*tag) + nbytes)))
+        {
+                return NULL;
+        }
+
+        tag->site = site;
+        tag->nbytes = nbytes;
+
+        allocstat_add(site, nbytes);
+
+        trace_event(TRACE_KMALLOC, tag + 1, nbytes, site);
+
+        return tag + 1;
+}
+
+static size_t
+usable_size(void *mem)
+{
+        return mem_size(((struct alloc_tag *)mem) - 1) -
+               sizeof(struct alloc_tag);
+}
+
+static void
+kfree_tagged(void *mem)
 {
-        ssize_t chunk;
-        size_t *mem;
-        size_t nchunks;
+        struct alloc_tag *tag;
+
+        tag = ((struct alloc_tag *)mem) - 1;
+
+        allocstat_remove(tag->site, tag->nbytes);
 
-        nchunks = memzone_get_nchunks(&g_memzone_kernel,
-                                      nbytes + 2 * sizeof(size_t));
+        free_mem(tag);
+}
+
+#else
+
+static void *
+kmalloc_from(size_t nbytes, const void *site)
+{
+        void *mem;
 
-        if ((chunk = memzone_alloc(&g_memzone_kernel, nchunks)) < 0)
+        mem = alloc_mem(nbytes);
+
+        if (mem)
         {
-                goto err_memzone_alloc;
+                trace_event(TRACE_KMALLOC, mem, nbytes, site);
         }
 
-        mem = memzone_address(&g_memzone_kernel, chunk);
+        return mem;
+}
+
+static size_t
+usable_size(void *mem)
+{
+        return mem_size(mem);
+}
 
-        mem[0] = chunk;
-        mem[1] = nbytes;
+static void
+kfree_tagged(void *mem)
+{
+        free_mem(mem);
+}
 
-        return mem + 2;
+#endif
 
-err_memzone_alloc:
-        return NULL;
+void *
+kmalloc(size_t nbytes)
+{
+        return kmalloc_from(nbytes, __builtin_return_address(0));
 }
 
 void *
@@ -64,7 +285,13 @@ kcalloc(size_t nmemb, size_t nbytes)
 {
         void *mem;
 
-        if (!(mem = kmalloc(nmemb * nbytes)))
+        if (nmemb && (nbytes > ((size_t)-1) / nmemb))
+        {
+                return NULL; /* overflow */
+        }
+
+        if (!(mem = kmalloc_from(nmemb * nbytes,
+                                 __builtin_return_address(0))))
         {
                 return NULL;
         }
@@ -72,11 +299,119 @@ kcalloc(size_t nmemb, size_t nbytes)
         return memset(mem, 0, nmemb * nbytes);
 }
 
+void *
+krealloc(void *mem, size_t nbytes)
+{
+        size_t oldsize;
+        void *newmem;
+
+        if (!mem)
+        {
+                return kmalloc_from(nbytes, __builtin_return_address(0));
+        }
+        else if (!nbytes)
+        {
+                kfree(mem);
+                return NULL;
+        }
+
+        oldsize = usable_size(mem);
+
+        if (nbytes <= oldsize)
+        {
+                return mem;
+        }
+
+        if (!(newmem = kmalloc_from(nbytes, __builtin_return_address(0))))
+        {
+                return NULL;
+        }
+
+        memcpy(newmem, mem, oldsize);
+        kfree(mem);
+
+        return newmem;
+}
+
 void
 kfree(void *mem)
 {
-        size_t *mem2 = mem;
+        if (!mem)
+        {
+                return;
+        }
+
+        trace_event(TRACE_KFREE, mem, 0, 0);
+
+        kfree_tagged(mem);
+}
+
+void
+kmalloc_set_watermark(size_t max_empty)
+{
+        size_t i;
+
+        for (i = 0; i < KMALLOC_NCLASSES; ++i)
+        {
+                slab_cache_set_watermark(g_kmalloc_cache + i, max_empty);
+        }
+}
+
+size_t
+kmalloc_shrink()
+{
+        size_t i, npages;
+
+        for (i = 0, npages = 0; i < KMALLOC_NCLASSES; ++i)
+        {
+                npages += slab_cache_shrink(g_kmalloc_cache + i);
+        }
+
+        return npages;
+}
+
+void
+kmalloc_get_stats(struct kmalloc_stats *stats)
+{
+        size_t i;
+        struct slab_cache_stats cstats;
+
+        memset(stats, 0, sizeof(*stats));
+
+        for (i = 0; i < KMALLOC_NCLASSES; ++i)
+        {
+                slab_cache_get_stats(g_kmalloc_cache + i, &cstats);
 
-        memzone_free(&g_memzone_kernel, mem2[-2],
-                     memzone_get_nchunks(&g_memzone_kernel, mem2[-1]));
+                stats->npages_slab += cstats.nslabs;
+                stats->npages_empty += cstats.nempty;
+                stats->nbytes_used += cstats.nused * g_kmalloc_size[i];
+        }
+
+        semaphore_enter(&g_large_sem);
+        stats->npages_large = g_large_npages;
+        semaphore_leave(&g_large_sem);
+}
+
+void *
+kmalloc_pages(size_t npages)
+{
+        os_index_t pgindex;
+
+        pgindex = vmem_alloc_pages_in_area(g_kernel_as,
+                                           VMEM_AREA_KERNEL,
+                                           npages,
+                                           PTE_FLAG_PRESENT|
+                                           PTE_FLAG_WRITEABLE);
+        if (pgindex < 0)
+        {
+                return NULL;
+        }
+
+        return page_address(pgindex);
+}
+
+void
+kfree_pages(void *mem, size_t npages)
+{
+        vmem_unmap_pages_at(g_kernel_as, page_index(mem), npages);
 }
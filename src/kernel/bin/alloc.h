@@ -32,5 +32,62 @@ kmalloc(size_t nbytes);
 void *
 kcalloc(size_t nmemb, size_t nbytes);
 
+/**
+ * \brief changes the size of an allocation
+ * \param[in] mem the allocation, or NULL
+ * \param nbytes the new size
+ * \return the resized allocation, or NULL on errors
+ *
+ * On errors, the original allocation remains valid.
+ */
+void *
+krealloc(void *mem, size_t nbytes);
+
 void
 kfree(void *mem);
+
+/** statistics of the kernel heap */
+struct kmalloc_stats
+{
+        size_t npages_slab;  /**< pages in slabs of all size classes */
+        size_t npages_empty; /**< pages in empty slabs */
+        size_t npages_large; /**< pages of large allocations */
+        size_t nbytes_used;  /**< bytes in allocated size-class objects */
+};
+
+/**
+ * \brief sets the number of empty slabs kept per size class
+ * \param max_empty the maximum number of empty slabs
+ */
+void
+kmalloc_set_watermark(size_t max_empty);
+
+/**
+ * \brief releases all empty slabs of the size classes
+ * \return the number of released pages
+ */
+size_t
+kmalloc_shrink(void);
+
+/**
+ * \brief reads the statistics of the kernel heap
+ * \param[out] stats the statistics
+ */
+void
+kmalloc_get_stats(struct kmalloc_stats *stats);
+
+/**
+ * \brief allocates page-aligned kernel memory
+ * \param npages the number of pages
+ * \return the address of the first page, or NULL on errors
+ */
+void *
+kmalloc_pages(size_t npages);
+
+/**
+ * \brief releases memory returned by kmalloc_pages()
+ * \param[in] mem the address of the first page
+ * \param npages the number of pages
+ */
+void
+kfree_pages(void *mem, size_t npages);
@@ -0,0 +1,188 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "allocstat.h"
+#include <stdint.h>
+#include <string.h>
+#include "alloc.h"
+#include "console.h"
+#include "pmem.h"
+#include "pmemarea.h"
+#include "semaphore.h"
+
+#ifdef ALLOC_STATS
+
+enum {
+    ALLOCSTAT_HASH_BITS = 8,
+    ALLOCSTAT_NSITES = 1 << ALLOCSTAT_HASH_BITS
+};
+
+struct allocstat_site {
+    const void* site;
+    size_t      nbytes;     /**< live bytes */
+    size_t      peak;       /**< maximum of live bytes */
+    size_t      nallocs;
+    size_t      nfrees;
+};
+
+struct allocstat {
+    struct semaphore      sem;
+    struct allocstat_site site[ALLOCSTAT_NSITES];
+    struct allocstat_site overflow; /**< sites that did not fit */
+};
+
+static struct allocstat g_allocstat = {
+    .sem = SEMAPHORE_INITIALIZER(g_allocstat.sem, 1)
+};
+
+static size_t
+hash_site(const void* site)
+{
+    /* Fibonacci hashing of the return address */
+    return (((uintptr_t)site >> 2) * 2654435761u) >> (32 - ALLOCSTAT_HASH_BITS);
+}
+
+static struct allocstat_site*
+lookup_site(const void* site)
+{
+    size_t i = hash_site(site);
+
+    for (size_t n = ALLOCSTAT_NSITES; n; --n, ++i) {
+        struct allocstat_site* entry =
+            g_allocstat.site + (i & (ALLOCSTAT_NSITES - 1));
+
+        if (entry->site == site) {
+            return entry;
+        } else if (!entry->site) {
+            entry->site = site;
+            return entry;
+        }
+    }
+
+    return &g_allocstat.overflow;
+}
+
+void
+allocstat_add(const void* site, size_t nbytes)
+{
+    semaphore_enter(&g_allocstat.sem);
+
+    struct allocstat_site* entry = lookup_site(site);
+
+    entry->nbytes += nbytes;
+    ++entry->nallocs;
+
+    if (entry->nbytes > entry->peak) {
+        entry->peak = entry->nbytes;
+    }
+
+    semaphore_leave(&g_allocstat.sem);
+}
+
+void
+allocstat_remove(const void* site, size_t nbytes)
+{
+    semaphore_enter(&g_allocstat.sem);
+
+    struct allocstat_site* entry = lookup_site(site);
+
+    entry->nbytes -= nbytes;
+    ++entry->nfrees;
+
+    semaphore_leave(&g_allocstat.sem);
+}
+
+static void
+dump_site(const struct allocstat_site* entry)
+{
+    console_printf("  site=%p live=%lu peak=%lu allocs=%lu frees=%lu\n",
+                   entry->site,
+                   (unsigned long)entry->nbytes,
+                   (unsigned long)entry->peak,
+                   (unsigned long)entry->nallocs,
+                   (unsigned long)entry->nfrees);
+}
+
+static void
+dump_sites(void)
+{
+    console_printf("kmalloc call sites:\n");
+
+    semaphore_enter(&g_allocstat.sem);
+
+    for (size_t i = 0; i < ARRAY_NELEMS(g_allocstat.site); ++i) {
+        if (g_allocstat.site[i].site) {
+            dump_site(g_allocstat.site + i);
+        }
+    }
+    if (g_allocstat.overflow.nallocs) {
+        dump_site(&g_allocstat.overflow);
+    }
+
+    semaphore_leave(&g_allocstat.sem);
+}
+
+#else
+
+static void
+dump_sites(void)
+{
+    return;
+}
+
+#endif
+
+static void
+dump_heap(void)
+{
+    struct kmalloc_stats stats;
+    kmalloc_get_stats(&stats);
+
+    console_printf("kmalloc: slab pages=%lu empty=%lu large pages=%lu used bytes=%lu\n",
+                   (unsigned long)stats.npages_slab,
+                   (unsigned long)stats.npages_empty,
+                   (unsigned long)stats.npages_large,
+                   (unsigned long)stats.nbytes_used);
+}
+
+static void
+dump_pmem_areas(void)
+{
+    static const char* const name[LAST_PMEM_AREA] = {
+        [PMEM_AREA_DMA_20] = "DMA20",
+        [PMEM_AREA_DMA_24] = "DMA24",
+        [PMEM_AREA_DMA_32] = "DMA32",
+        [PMEM_AREA_USER]   = "USER"
+    };
+
+    for (size_t i = 0; i < ARRAY_NELEMS(name); ++i) {
+        const struct pmem_area* area = pmem_area_get_by_name(i);
+
+        console_printf("pmem %s: used frames=%lu of %lu\n", name[i],
+                       pmem_count_used_frames(area->pfindex, area->nframes),
+                       (unsigned long)area->nframes);
+    }
+}
+
+void
+allocstat_dump()
+{
+    dump_pmem_areas();
+    dump_heap();
+    dump_sites();
+}
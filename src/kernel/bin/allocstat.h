@@ -0,0 +1,54 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Per-call-site accounting of kernel allocations is only available
+ * when building with ALLOC_STATS. The dump function always exists
+ * and prints the heap and page-frame statistics.
+ */
+
+#ifdef ALLOC_STATS
+
+/**
+ * \brief records an allocation
+ * \param[in] site the return address of the allocating call
+ * \param nbytes the allocation size
+ */
+void
+allocstat_add(const void* site, size_t nbytes);
+
+/**
+ * \brief records the release of an allocation
+ * \param[in] site the return address of the allocating call
+ * \param nbytes the allocation size
+ */
+void
+allocstat_remove(const void* site, size_t nbytes);
+
+#endif
+
+/**
+ * \brief prints allocation statistics on the console
+ */
+void
+allocstat_dump(void);
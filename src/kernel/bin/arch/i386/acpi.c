@@ -0,0 +1,228 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * We only read the MADT from the ACPI tables. It lists the I/O APICs
+ * and overrides for the routing of ISA IRQs. Tables are located in
+ * physical memory, so we temporarily map them.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "fwtable.h"
+#include "irqroute.h"
+
+struct acpi_rsdp {
+    char     signature[8];
+    uint8_t  checksum;
+    char     oemid[6];
+    uint8_t  revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char     signature[4];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oemid[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t               lapic_address;
+    uint32_t               flags;
+} __attribute__((packed));
+
+struct acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+enum {
+    ACPI_MADT_LAPIC           = 0,
+    ACPI_MADT_IOAPIC          = 1,
+    ACPI_MADT_SOURCE_OVERRIDE = 2
+};
+
+struct acpi_madt_ioapic {
+    struct acpi_madt_entry entry;
+    uint8_t                id;
+    uint8_t                reserved;
+    uint32_t               address;
+    uint32_t               gsi_base;
+} __attribute__((packed));
+
+struct acpi_madt_source_override {
+    struct acpi_madt_entry entry;
+    uint8_t                bus; /* always 0 for ISA */
+    uint8_t                source;
+    uint32_t               gsi;
+    uint16_t               flags;
+} __attribute__((packed));
+
+enum {
+    ACPI_BIOS_AREA_ADDR = 0xe0000,
+    ACPI_BIOS_AREA_LEN  = 0x20000
+};
+
+static int
+find_rsdp(struct acpi_rsdp* rsdp)
+{
+    /* The RSDP is either in the first KiB of the EBDA, or in
+     * the BIOS area below 1 MiB. */
+
+    int res = fwtable_search_ebda("RSD PTR ", rsdp, sizeof(*rsdp));
+    if (res != -ENOENT) {
+        return res;
+    }
+
+    return fwtable_search(ACPI_BIOS_AREA_ADDR, ACPI_BIOS_AREA_LEN,
+                          "RSD PTR ", rsdp, sizeof(*rsdp));
+}
+
+/* Maps a complete table and validates it. */
+static const struct acpi_sdt_header*
+map_sdt(uintptr_t addr)
+{
+    const struct acpi_sdt_header* header = fwtable_map(addr, sizeof(*header));
+    if (!header) {
+        return NULL;
+    }
+
+    size_t len = header->length;
+
+    fwtable_unmap(header, sizeof(*header));
+
+    if (len < sizeof(*header)) {
+        return NULL;
+    }
+
+    header = fwtable_map(addr, len);
+    if (!header) {
+        return NULL;
+    }
+
+    if (!fwtable_has_valid_checksum(header, len)) {
+        fwtable_unmap(header, len);
+        return NULL;
+    }
+
+    return header;
+}
+
+static void
+unmap_sdt(const struct acpi_sdt_header* header)
+{
+    fwtable_unmap(header, header->length);
+}
+
+static int
+parse_madt(const struct acpi_madt* madt, struct irq_routing* routing)
+{
+    const uint8_t* beg = (const uint8_t*)(madt + 1);
+    const uint8_t* end = ((const uint8_t*)madt) + madt->header.length;
+
+    while (beg + sizeof(struct acpi_madt_entry) <= end) {
+
+        const struct acpi_madt_entry* entry = (const void*)beg;
+
+        if (entry->length < sizeof(*entry) || beg + entry->length > end) {
+            return -EINVAL;
+        }
+
+        switch (entry->type) {
+            case ACPI_MADT_IOAPIC: {
+                const struct acpi_madt_ioapic* ioapic = (const void*)entry;
+                int res = irq_routing_add_ioapic(routing, ioapic->id,
+                                                 ioapic->address,
+                                                 ioapic->gsi_base);
+                if (res < 0) {
+                    return res;
+                }
+                break;
+            }
+            case ACPI_MADT_SOURCE_OVERRIDE: {
+                const struct acpi_madt_source_override* ovr =
+                    (const void*)entry;
+                if (!ovr->bus) {
+                    irq_routing_set_isa(routing, ovr->source, ovr->gsi,
+                                        ovr->flags);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        beg += entry->length;
+    }
+
+    return routing->nioapics ? 0 : -ENODEV;
+}
+
+int
+acpi_read_irq_routing(struct irq_routing* routing)
+{
+    struct acpi_rsdp rsdp;
+
+    int res = find_rsdp(&rsdp);
+    if (res < 0) {
+        return res;
+    }
+
+    const struct acpi_sdt_header* rsdt = map_sdt(rsdp.rsdt_address);
+    if (!rsdt) {
+        return -EINVAL;
+    }
+
+    const uint32_t* beg = (const uint32_t*)(rsdt + 1);
+    const uint32_t* end = beg + (rsdt->length - sizeof(*rsdt)) /
+                                sizeof(*beg);
+
+    res = -ENOENT;
+
+    for (; beg < end; ++beg) {
+
+        const struct acpi_sdt_header* sdt = map_sdt(*beg);
+        if (!sdt) {
+            continue;
+        }
+
+        if (!memcmp(sdt->signature, "APIC", sizeof(sdt->signature)) &&
+            (sdt->length >= sizeof(struct acpi_madt))) {
+            irq_routing_init(routing);
+            res = parse_madt((const struct acpi_madt*)sdt, routing);
+        }
+
+        unmap_sdt(sdt);
+
+        if (res != -ENOENT) {
+            break;
+        }
+    }
+
+    unmap_sdt(rsdt);
+
+    return res;
+}
@@ -0,0 +1,151 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "apic.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include "drivers/i8259/pic.h"
+#include "drivers/ioapic/ioapic.h"
+#include "drivers/lapic/lapic.h"
+#include "idt.h"
+#include "ioports.h"
+#include "irq.h"
+#include "irqroute.h"
+
+/* Interrupt Mode Configuration Register */
+enum {
+    IMCR_ADDR      = 0x22,
+    IMCR_DATA      = 0x23,
+    IMCR_SELECT    = 0x70,
+    IMCR_APIC_MODE = 0x01
+};
+
+static struct ioapic_drv g_ioapic[IRQ_ROUTING_MAX_IOAPICS];
+static size_t            g_nioapics;
+
+/* I/O APIC and pin of each ISA IRQ */
+static struct {
+    struct ioapic_drv* ioapic;
+    unsigned long      pin;
+} g_isa_pin[IRQ_ROUTING_NISAIRQS];
+
+static struct ioapic_drv*
+find_ioapic(unsigned long gsi)
+{
+    for (size_t i = 0; i < g_nioapics; ++i) {
+        if (ioapic_has_gsi(g_ioapic + i, gsi)) {
+            return g_ioapic + i;
+        }
+    }
+    return NULL;
+}
+
+static int
+enable_irq(unsigned char irqno)
+{
+    if (!(irqno < ARRAY_NELEMS(g_isa_pin))) {
+        return 0; /* local interrupt; not routed through an I/O APIC */
+    }
+    if (!g_isa_pin[irqno].ioapic) {
+        return -ENODEV;
+    }
+
+    ioapic_unmask_pin(g_isa_pin[irqno].ioapic, g_isa_pin[irqno].pin);
+
+    return 0;
+}
+
+static void
+disable_irq(unsigned char irqno)
+{
+    if (!(irqno < ARRAY_NELEMS(g_isa_pin)) || !g_isa_pin[irqno].ioapic) {
+        return;
+    }
+
+    ioapic_mask_pin(g_isa_pin[irqno].ioapic, g_isa_pin[irqno].pin);
+}
+
+int
+apic_install(struct lapic_drv* lapic, const struct irq_routing* routing)
+{
+    int res = 0;
+
+    for (g_nioapics = 0; g_nioapics < routing->nioapics; ++g_nioapics) {
+        res = ioapic_init(g_ioapic + g_nioapics,
+                          routing->ioapic[g_nioapics].id,
+                          routing->ioapic[g_nioapics].addr,
+                          routing->ioapic[g_nioapics].gsi_base);
+        if (res < 0) {
+            goto err_ioapic_init;
+        }
+    }
+
+    /* Route ISA IRQs to the vectors they had with the PIC, so
+     * the IRQ numbers remain the same. */
+
+    unsigned char dest = lapic_id(lapic);
+
+    for (size_t i = 0; i < ARRAY_NELEMS(g_isa_pin); ++i) {
+
+        if (!routing->isa[i].routed) {
+            g_isa_pin[i].ioapic = NULL;
+            continue;
+        }
+
+        unsigned long gsi = routing->isa[i].gsi;
+        unsigned short flags = routing->isa[i].flags;
+
+        struct ioapic_drv* ioapic = find_ioapic(gsi);
+
+        g_isa_pin[i].ioapic = ioapic;
+
+        if (!ioapic) {
+            continue;
+        }
+
+        g_isa_pin[i].pin = gsi - ioapic->gsi_base;
+
+        ioapic_route_pin(ioapic, g_isa_pin[i].pin, IDT_IRQ_OFFSET + i,
+                         (flags & IRQ_ROUTING_POLARITY_MASK) ==
+                            IRQ_ROUTING_ACTIVE_LOW,
+                         (flags & IRQ_ROUTING_TRIGGER_MASK) ==
+                            IRQ_ROUTING_LEVEL,
+                         dest);
+    }
+
+    /* Disconnect the PIC and let the I/O APICs deliver interrupts. */
+
+    pic_disable();
+
+    if (routing->has_imcr) {
+        io_outb(IMCR_ADDR, IMCR_SELECT);
+        io_outb(IMCR_DATA, IMCR_APIC_MODE);
+    }
+
+    init_irq_handling(enable_irq, disable_irq);
+
+    return 0;
+
+err_ioapic_init:
+    while (g_nioapics) {
+        --g_nioapics;
+        ioapic_uninit(g_ioapic + g_nioapics);
+    }
+    return res;
+}
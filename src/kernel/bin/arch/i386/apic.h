@@ -0,0 +1,34 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+struct irq_routing;
+struct lapic_drv;
+
+/**
+ * \brief replaces the PIC with the local and I/O APICs
+ * \param[in] lapic the initialized local-APIC driver
+ * \param[in] routing the platform's IRQ routing
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * ISA IRQs keep their interrupt vectors and numbers in the IRQ
+ * framework. Acknowledge interrupts with lapic_eoi() afterwards.
+ */
+int
+apic_install(struct lapic_drv* lapic, const struct irq_routing* routing);
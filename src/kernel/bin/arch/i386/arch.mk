@@ -1,6 +1,9 @@
 
 kernel_SRCS += $(addprefix $(archdir)/, \
+        acpi.c \
+        apic.c \
         debug.c \
+        fwtable.c \
         gdt.c \
         idt.c \
         idt.S \
@@ -8,12 +11,16 @@ kernel_SRCS += $(addprefix $(archdir)/, \
         interupt.c \
         iomem.c \
         ioports.c \
+        irqroute.c \
+        kmap.c \
+        mptable.c \
         multiboot.c \
         multiboot.S \
         pagedir.c \
         pagetbl.c \
         pde.c \
         pte.c \
+        tsc.c \
         tcbregs.c \
         tcbregs.S \
         vmem_32.c \
@@ -50,3 +50,15 @@ atomic_dec(void *addr)
                 : "r"((unsigned long)addr)
                 );
 }
+
+static __inline__ unsigned long
+atomic_xadd(volatile void *addr, unsigned long value)
+{
+        __asm__("lock xadd %0, (%1)\n\t"
+                : "+r"(value)
+                : "r"(addr)
+                : "memory"
+                );
+
+        return value;
+}
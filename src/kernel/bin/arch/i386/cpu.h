@@ -126,6 +126,19 @@ hlt(void)
         __asm__("hlt\n\t");
 }
 
+/**
+ * \brief Enable interrupts and execute hlt instruction
+ *
+ * Interrupts are only delivered after the instruction following sti,
+ * so no interrupt gets lost between enabling them and halting.
+ */
+static __inline__ void
+sti_hlt(void)
+{
+        __asm__("sti\n\t"
+                "hlt\n\t");
+}
+
 /**
  * \brief Read CPU register EFLAGS
  */
@@ -149,3 +162,100 @@ cpuid(void)
 {
         return 0;
 }
+
+/**
+ * \brief The bits of CPUID's feature flags.
+ */
+enum {
+        CPUID_1_ECX_TSC_DEADLINE = 1<<24, /**< TSC-deadline timer mode */
+        CPUID_1_EDX_TSC          = 1<<4, /**< Time-stamp counter */
+        CPUID_1_EDX_MSR          = 1<<5, /**< RDMSR and WRMSR */
+        CPUID_1_EDX_APIC         = 1<<9, /**< Local APIC */
+        CPUID_80000007_EDX_INVTSC = 1<<8 /**< Invariant TSC */
+};
+
+/**
+ * \brief Test for the CPUID instruction
+ * \return true if the CPU supports CPUID, or false otherwise
+ *
+ * CPUID is available if software can toggle the ID flag in EFLAGS.
+ */
+static __inline__ int
+has_cpuid(void)
+{
+        unsigned long old, new;
+
+        __asm__("pushf\n\t"
+                "popl %0\n\t"
+                "movl %0, %1\n\t"
+                "xorl %2, %1\n\t"
+                "pushl %1\n\t"
+                "popf\n\t"
+                "pushf\n\t"
+                "popl %1\n\t"
+                "pushl %0\n\t"
+                "popf\n\t"
+                        : "=&r"(old), "=&r"(new)
+                        : "i"(EFLAGS_ID)
+                        : "cc");
+
+        return !!((old ^ new) & EFLAGS_ID);
+}
+
+/**
+ * \brief Execute CPUID instruction
+ * \param leaf the requested information
+ * \param[out] regs the returned values of EAX, EBX, ECX and EDX
+ */
+static __inline__ void
+cpuid_leaf(unsigned long leaf, unsigned long regs[4])
+{
+        __asm__("cpuid\n\t"
+                        : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]),
+                          "=d"(regs[3])
+                        : "a"(leaf), "c"(0));
+}
+
+/**
+ * \brief Read the time-stamp counter
+ */
+static __inline__ unsigned long long
+rdtsc(void)
+{
+        unsigned long long tsc;
+
+        __asm__ __volatile__("rdtsc\n\t"
+                        : "=A"(tsc));
+
+        return tsc;
+}
+
+/**
+ * \brief Read a model-specific register
+ * \param msr the register's index
+ */
+static __inline__ unsigned long long
+rdmsr(unsigned long msr)
+{
+        unsigned long long value;
+
+        __asm__ __volatile__("rdmsr\n\t"
+                        : "=A"(value)
+                        : "c"(msr));
+
+        return value;
+}
+
+/**
+ * \brief Write a model-specific register
+ * \param msr the register's index
+ * \param value the new value
+ */
+static __inline__ void
+wrmsr(unsigned long msr, unsigned long long value)
+{
+        __asm__ __volatile__("wrmsr\n\t"
+                        :
+                        : "c"(msr), "A"(value)
+                        : "memory");
+}
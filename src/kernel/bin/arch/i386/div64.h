@@ -0,0 +1,51 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * \brief divides a 64-bit integer by a 32-bit integer
+ * \param n the dividend
+ * \param d the divisor
+ * \param[out] rem the remainder, or NULL
+ * \return the quotient
+ *
+ * The kernel is not linked against libgcc, so 64-bit division
+ * has to be done explicitly with two 32-bit divl instructions.
+ */
+static __inline__ unsigned long long
+div64_u32(unsigned long long n, unsigned long d, unsigned long *rem)
+{
+        unsigned long hi = n >> 32;
+        unsigned long lo = n;
+        unsigned long qhi, qlo, r;
+
+        __asm__("divl %4\n\t"
+                : "=a"(qhi), "=d"(r)
+                : "a"(hi), "d"(0ul), "rm"(d));
+        __asm__("divl %4\n\t"
+                : "=a"(qlo), "=d"(r)
+                : "a"(lo), "d"(r), "rm"(d));
+
+        if (rem)
+        {
+                *rem = r;
+        }
+
+        return ((unsigned long long)qhi << 32) | qlo;
+}
@@ -0,0 +1,105 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fwtable.h"
+#include <errno.h>
+#include <string.h>
+#include "iomem.h"
+#include "pte.h"
+
+enum {
+    FWTABLE_EBDA_SEGMENT_ADDR = 0x40e, /* in the BIOS Data Area */
+    FWTABLE_EBDA_SEARCH_LEN   = 1024
+};
+
+const void*
+fwtable_map(uintptr_t addr, size_t len)
+{
+    return map_io_range((const void*)addr, len, PTE_FLAG_PRESENT);
+}
+
+void
+fwtable_unmap(const void* table, size_t len)
+{
+    unmap_io_range(table, len);
+}
+
+bool
+fwtable_has_valid_checksum(const void* table, size_t len)
+{
+    const uint8_t* beg = table;
+    const uint8_t* end = beg + len;
+
+    uint8_t sum = 0;
+
+    while (beg < end) {
+        sum += *beg++;
+    }
+
+    return !sum;
+}
+
+int
+fwtable_search(uintptr_t addr, size_t len, const char* signature,
+               void* buf, size_t buflen)
+{
+    const uint8_t* area = fwtable_map(addr, len);
+    if (!area) {
+        return -ENOMEM;
+    }
+
+    size_t siglen = strlen(signature);
+    int res = -ENOENT;
+
+    for (size_t off = 0; off + buflen <= len; off += 16) {
+        if (memcmp(area + off, signature, siglen)) {
+            continue;
+        }
+        if (!fwtable_has_valid_checksum(area + off, buflen)) {
+            continue;
+        }
+        memcpy(buf, area + off, buflen);
+        res = 0;
+        break;
+    }
+
+    fwtable_unmap(area, len);
+
+    return res;
+}
+
+int
+fwtable_search_ebda(const char* signature, void* buf, size_t buflen)
+{
+    const uint16_t* segment = fwtable_map(FWTABLE_EBDA_SEGMENT_ADDR,
+                                          sizeof(*segment));
+    if (!segment) {
+        return -ENOMEM;
+    }
+
+    uintptr_t addr = (uintptr_t)*segment << 4;
+
+    fwtable_unmap(segment, sizeof(*segment));
+
+    if (!addr) {
+        return -ENOENT;
+    }
+
+    return fwtable_search(addr, FWTABLE_EBDA_SEARCH_LEN, signature,
+                          buf, buflen);
+}
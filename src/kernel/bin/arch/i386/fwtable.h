@@ -0,0 +1,82 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Helpers for reading tables that the firmware left in physical
+ * memory, such as the ACPI tables or the MP configuration table.
+ */
+
+/**
+ * \brief maps a firmware table into kernel memory
+ * \param addr the table's physical address
+ * \param len the table's length in bytes
+ * \return the mapped table, or NULL on errors
+ */
+const void*
+fwtable_map(uintptr_t addr, size_t len);
+
+/**
+ * \brief unmaps a firmware table
+ * \param[in] table the mapped table
+ * \param len the table's length in bytes
+ */
+void
+fwtable_unmap(const void* table, size_t len);
+
+/**
+ * \brief validates a table's checksum
+ * \param[in] table the table
+ * \param len the table's length in bytes
+ * \return true if all bytes add up to zero, or false otherwise
+ */
+bool
+fwtable_has_valid_checksum(const void* table, size_t len);
+
+/**
+ * \brief searches the BIOS memory for a structure
+ * \param addr the physical start address of the search area
+ * \param len the length of the search area in bytes
+ * \param[in] signature the structure's signature
+ * \param[out] buf the found structure
+ * \param buflen the structure's length in bytes
+ * \return 0 on success, -ENOENT if not found, or another negative
+ *         error code otherwise
+ *
+ * Structures are located at 16-byte boundaries and have a valid
+ * checksum.
+ */
+int
+fwtable_search(uintptr_t addr, size_t len, const char* signature,
+               void* buf, size_t buflen);
+
+/**
+ * \brief searches the first KiB of the Extended BIOS Data Area
+ * \param[in] signature the structure's signature
+ * \param[out] buf the found structure
+ * \param buflen the structure's length in bytes
+ * \return 0 on success, -ENOENT if not found, or another negative
+ *         error code otherwise
+ */
+int
+fwtable_search_ebda(const char* signature, void* buf, size_t buflen);
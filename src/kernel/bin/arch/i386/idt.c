@@ -46,6 +46,7 @@ extern void idt_handle_irq12(void);
 extern void idt_handle_irq13(void);
 extern void idt_handle_irq14(void);
 extern void idt_handle_irq15(void);
+extern void idt_handle_irq16(void);
 extern void idt_handle_syscall(void);
 
 struct idt_register {
@@ -100,6 +101,9 @@ init_idt()
     IDT_ENTRY_INIT(IDT_IRQ_OFFSET + 0xe, idt_handle_irq14);
     IDT_ENTRY_INIT(IDT_IRQ_OFFSET + 0xf, idt_handle_irq15);
 
+    /* local interupts, not routed through the PIC */
+    IDT_ENTRY_INIT(IDT_IRQ_OFFSET + 0x10, idt_handle_irq16);
+
     /* syscall interrupt */
     IDT_ENTRY_INIT(0x80, idt_handle_syscall);
 
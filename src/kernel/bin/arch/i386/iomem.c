@@ -22,6 +22,7 @@
 #include "page.h"
 #include "pageframe.h"
 #include "pmem.h"
+#include "pte.h"
 #include "vmem.h"
 #include "vmemarea.h"
 
@@ -85,11 +86,15 @@ map_io_range(const void* io_addr, size_t length, unsigned int flags)
                                                  area->pgindex,
                                                  area->pgindex + area->npages,
                                                  pfcount);
-    if (!pgindex) {
+    if (pgindex < 0) {
         return NULL;
     }
 
-    int res = vmem_alloc_frames(g_iomem.vmem, pfindex, pfcount, pgindex, flags);
+    /* Device memory is usually located outside of the range of page
+     * frames that is managed by pmem, so we don't reference count it. */
+
+    int res = vmem_alloc_frames(g_iomem.vmem, pfindex, pgindex, pfcount,
+                                flags | PTE_FLAG_IOMEM);
 
     if (res < 0) {
         return NULL;
@@ -104,5 +109,6 @@ map_io_range(const void* io_addr, size_t length, unsigned int flags)
 void
 unmap_io_range(const void* virt_addr, size_t length)
 {
-    // todo: unmap
+    vmem_unmap_pages_at(g_iomem.vmem, page_index(virt_addr),
+                        page_count(virt_addr, length));
 }
@@ -0,0 +1,81 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "irqroute.h"
+#include <errno.h>
+#include <string.h>
+
+void
+irq_routing_init(struct irq_routing* routing)
+{
+    routing->nioapics = 0;
+
+    for (size_t i = 0; i < ARRAY_NELEMS(routing->isa); ++i) {
+        routing->isa[i].gsi = i;
+        routing->isa[i].flags = IRQ_ROUTING_ACTIVE_HIGH | IRQ_ROUTING_EDGE;
+        routing->isa[i].routed = i != IRQ_ROUTING_ISA_CASCADE;
+    }
+
+    routing->has_imcr = false;
+}
+
+int
+irq_routing_add_ioapic(struct irq_routing* routing, unsigned char id,
+                       uintptr_t addr, unsigned long gsi_base)
+{
+    if (routing->nioapics == ARRAY_NELEMS(routing->ioapic)) {
+        return -ENOMEM;
+    }
+
+    routing->ioapic[routing->nioapics].id = id;
+    routing->ioapic[routing->nioapics].addr = addr;
+    routing->ioapic[routing->nioapics].gsi_base = gsi_base;
+    ++routing->nioapics;
+
+    return 0;
+}
+
+void
+irq_routing_set_isa(struct irq_routing* routing, unsigned char irqno,
+                    unsigned long gsi, unsigned short flags)
+{
+    if (!(irqno < ARRAY_NELEMS(routing->isa)) ||
+        (irqno == IRQ_ROUTING_ISA_CASCADE)) {
+        return;
+    }
+
+    /* conforming polarity and trigger mode default to ISA settings */
+    if (!(flags & IRQ_ROUTING_POLARITY_MASK)) {
+        flags |= IRQ_ROUTING_ACTIVE_HIGH;
+    }
+    if (!(flags & IRQ_ROUTING_TRIGGER_MASK)) {
+        flags |= IRQ_ROUTING_EDGE;
+    }
+
+    routing->isa[irqno].gsi = gsi;
+    routing->isa[irqno].flags = flags;
+    routing->isa[irqno].routed = true;
+
+    /* The ISA IRQ that is still identity mapped to the GSI loses its
+     * pin. Otherwise it would later reprogram the pin to its own vector
+     * and steal the interrupt, as with IRQ 0 on GSI 2. */
+    if ((gsi < ARRAY_NELEMS(routing->isa)) && (gsi != irqno) &&
+        (routing->isa[gsi].gsi == gsi)) {
+        routing->isa[gsi].routed = false;
+    }
+}
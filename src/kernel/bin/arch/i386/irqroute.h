@@ -0,0 +1,117 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    IRQ_ROUTING_MAX_IOAPICS = 8,
+    IRQ_ROUTING_NISAIRQS    = 16,
+    IRQ_ROUTING_ISA_CASCADE = 2  /**< slave PIC's cascade; never routed */
+};
+
+/* polarity and trigger mode of an interrupt line; the values
+ * match the MPS INTI flags and the ACPI MADT's MPS flags */
+enum {
+    IRQ_ROUTING_POLARITY_MASK = 0x03,
+    IRQ_ROUTING_ACTIVE_HIGH   = 0x01,
+    IRQ_ROUTING_ACTIVE_LOW    = 0x03,
+    IRQ_ROUTING_TRIGGER_MASK  = 0x0c,
+    IRQ_ROUTING_EDGE          = 0x04,
+    IRQ_ROUTING_LEVEL         = 0x0c
+};
+
+/**
+ * Interrupt routing of the platform, as read from the ACPI MADT or
+ * the MP configuration table. ISA IRQs are identity mapped to global
+ * system interrupts (abbr. GSI) unless the firmware overrides them.
+ * An override takes the GSI away from the ISA IRQ that is identity
+ * mapped to it; that IRQ remains unrouted.
+ */
+struct irq_routing {
+    size_t nioapics;
+
+    struct {
+        unsigned char id;
+        uintptr_t     addr;     /**< physical address of registers */
+        unsigned long gsi_base; /**< GSI of the first input pin */
+    } ioapic[IRQ_ROUTING_MAX_IOAPICS];
+
+    struct {
+        unsigned long  gsi;
+        unsigned short flags;
+        bool           routed;
+    } isa[IRQ_ROUTING_NISAIRQS];
+
+    /* The IMCR routes the PIC's output to the CPU. Switch it over to
+     * the APIC when enabling the I/O APICs. */
+    bool has_imcr;
+};
+
+/**
+ * \brief init IRQ routing with ISA defaults
+ * \param[out] routing the IRQ routing
+ */
+void
+irq_routing_init(struct irq_routing* routing);
+
+/**
+ * \brief adds an I/O APIC
+ * \param[in, out] routing the IRQ routing
+ * \param id the I/O APIC's id
+ * \param addr the physical address of the I/O APIC's registers
+ * \param gsi_base the GSI of the first input pin
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+irq_routing_add_ioapic(struct irq_routing* routing, unsigned char id,
+                       uintptr_t addr, unsigned long gsi_base);
+
+/**
+ * \brief overrides the routing of an ISA IRQ
+ *
+ * If another ISA IRQ is identity mapped to the GSI, it becomes
+ * unrouted. The cascade IRQ is never routed.
+ *
+ * \param[in, out] routing the IRQ routing
+ * \param irqno the ISA IRQ
+ * \param gsi the global system interrupt
+ * \param flags the polarity and trigger mode
+ */
+void
+irq_routing_set_isa(struct irq_routing* routing, unsigned char irqno,
+                    unsigned long gsi, unsigned short flags);
+
+/**
+ * \brief reads IRQ routing from ACPI tables
+ * \param[out] routing the IRQ routing
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+acpi_read_irq_routing(struct irq_routing* routing);
+
+/**
+ * \brief reads IRQ routing from the MP configuration table
+ * \param[out] routing the IRQ routing
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+mptable_read_irq_routing(struct irq_routing* routing);
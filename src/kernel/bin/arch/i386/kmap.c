@@ -0,0 +1,129 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kmap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "interupt.h"
+#include "membar.h"
+#include "mmu.h"
+#include "pagetbl.h"
+#include "pte.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "vmemarea.h"
+
+enum {
+    KMAP_NSLOTS = 1024 / SCHED_NCPUS /**< temporary mappings per CPU */
+};
+
+/* Slots return to the CPU that owns them, which might not be the
+ * current CPU. Other CPUs push released slots while the owner pops
+ * them, so access requires the lock. */
+struct kmap_cpu {
+    spinlock_type  lock;
+    unsigned short free[KMAP_NSLOTS]; /**< stack of released slots */
+    unsigned short nfree;
+    unsigned short nfresh; /**< number of slots that have been used */
+};
+
+static struct kmap_cpu g_kmap_cpu[SCHED_NCPUS];
+
+struct page_table*
+kmap_get_page_table()
+{
+    const struct vmem_area* low = vmem_area_get_by_name(VMEM_AREA_KERNEL_LOW);
+    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
+
+    return page_address(low->pgindex + low->npages - (tmp->npages >> 10));
+}
+
+static os_index_t
+slot_page(unsigned int cpu, size_t slot)
+{
+    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
+
+    return tmp->pgindex + cpu * KMAP_NSLOTS + slot;
+}
+
+void*
+kmap(os_index_t pfindex)
+{
+    bool int_enabled = cli_if_on();
+
+    unsigned int cpu = cpuid();
+    struct kmap_cpu* kc = g_kmap_cpu + cpu;
+
+    spinlock_lock(&kc->lock, cpu + 1);
+
+    size_t slot;
+
+    if (kc->nfree) {
+        slot = kc->free[--kc->nfree];
+    } else if (kc->nfresh < KMAP_NSLOTS) {
+        slot = kc->nfresh++;
+    } else {
+        spinlock_unlock(&kc->lock);
+        sti_if_on(int_enabled);
+        return NULL;
+    }
+
+    spinlock_unlock(&kc->lock);
+    sti_if_on(int_enabled);
+
+    os_index_t pgindex = slot_page(cpu, slot);
+
+    /* Released slots have been invalidated already, so the new
+     * entry requires no TLB flush. */
+
+    struct page_table* pt = kmap_get_page_table();
+    pt->entry[pagetable_page_index(pgindex)] =
+        pte_create(pfindex, PTE_FLAG_PRESENT | PTE_FLAG_WRITEABLE);
+
+    return page_address(pgindex);
+}
+
+void
+kunmap(void* addr)
+{
+    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
+
+    os_index_t pgindex = page_index(addr);
+
+    if (!vmem_area_contains_page(tmp, pgindex)) {
+        return; /* not temporarily mapped */
+    }
+
+    /* finish access before unmapping page */
+    rwmembar();
+
+    struct page_table* pt = kmap_get_page_table();
+    pt->entry[pagetable_page_index(pgindex)] = pte_create(0, 0);
+
+    mmu_flush_tlb_entry(addr);
+
+    size_t i = pgindex - tmp->pgindex;
+    struct kmap_cpu* kc = g_kmap_cpu + i / KMAP_NSLOTS;
+
+    bool int_enabled = cli_if_on();
+    spinlock_lock(&kc->lock, cpuid() + 1);
+    kc->free[kc->nfree++] = i % KMAP_NSLOTS;
+    spinlock_unlock(&kc->lock);
+    sti_if_on(int_enabled);
+}
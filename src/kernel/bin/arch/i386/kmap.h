@@ -0,0 +1,49 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "page.h"
+
+struct page_table;
+
+/**
+ * \brief returns the page table of the temporary mappings
+ * \return the page table
+ */
+struct page_table*
+kmap_get_page_table(void);
+
+/**
+ * \brief temporarily maps a page frame into the kernel address space
+ * \param pfindex the page frame
+ * \return the address of the mapping, or NULL if all slots are in use
+ *
+ * Each CPU owns a fixed set of slots. Mappings can be nested and
+ * released in any order. No reference is taken on the page frame,
+ * so the caller has to hold one while the mapping exists.
+ */
+void*
+kmap(os_index_t pfindex);
+
+/**
+ * \brief releases a temporary mapping
+ * \param[in] addr the address returned by kmap()
+ */
+void
+kunmap(void* addr);
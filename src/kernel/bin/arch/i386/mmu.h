@@ -64,5 +64,8 @@ mmu_flush_tlb(void)
 static __inline__ void
 mmu_flush_tlb_entry(const void *pfaddr)
 {
-        mmu_flush_tlb();
+        __asm__("invlpg (%0)\n\t"
+                        :
+                        : "r" (pfaddr)
+                        : "memory");
 }
@@ -0,0 +1,284 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The MP configuration table is the predecessor of the ACPI MADT. We
+ * use it on systems without ACPI. I/O-interrupt entries name the
+ * destination I/O APIC and its input pin instead of a global system
+ * interrupt, so we compute each I/O APIC's GSI base by counting the
+ * pins of the preceding I/O APICs.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "drivers/ioapic/ioapic.h"
+#include "fwtable.h"
+#include "irqroute.h"
+
+struct mp_floating_pointer {
+    char     signature[4];
+    uint32_t config_address;
+    uint8_t  length; /* in units of 16 bytes */
+    uint8_t  spec_rev;
+    uint8_t  checksum;
+    uint8_t  feature[5];
+} __attribute__((packed));
+
+enum {
+    MP_FEATURE2_IMCR = 0x80
+};
+
+struct mp_config_header {
+    char     signature[4];
+    uint16_t base_length;
+    uint8_t  spec_rev;
+    uint8_t  checksum;
+    char     oem_id[8];
+    char     product_id[12];
+    uint32_t oem_table_address;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t ext_length;
+    uint8_t  ext_checksum;
+    uint8_t  reserved;
+} __attribute__((packed));
+
+enum {
+    MP_ENTRY_PROCESSOR = 0,
+    MP_ENTRY_BUS       = 1,
+    MP_ENTRY_IOAPIC    = 2,
+    MP_ENTRY_IO_INT    = 3,
+    MP_ENTRY_LOCAL_INT = 4
+};
+
+struct mp_bus {
+    uint8_t type;
+    uint8_t id;
+    char    bus_type[6];
+} __attribute__((packed));
+
+struct mp_ioapic {
+    uint8_t  type;
+    uint8_t  id;
+    uint8_t  version;
+    uint8_t  flags;
+    uint32_t address;
+} __attribute__((packed));
+
+enum {
+    MP_IOAPIC_ENABLED = 0x01
+};
+
+struct mp_io_int {
+    uint8_t  type;
+    uint8_t  int_type;
+    uint16_t flags;
+    uint8_t  src_bus;
+    uint8_t  src_irq;
+    uint8_t  dst_ioapic;
+    uint8_t  dst_pin;
+} __attribute__((packed));
+
+enum {
+    MP_INT_TYPE_INT = 0 /* vectored interrupt */
+};
+
+enum {
+    MP_BASE_MEM_END      = 0x9fc00,
+    MP_BIOS_ROM_ADDR     = 0xf0000,
+    MP_BIOS_ROM_LEN      = 0x10000,
+    /* I/O APIC of the default configurations */
+    MP_DEFAULT_IOAPIC_ID   = 2,
+    MP_DEFAULT_IOAPIC_ADDR = 0xfec00000
+};
+
+static int
+find_floating_pointer(struct mp_floating_pointer* mpfp)
+{
+    /* The floating pointer is either in the first KiB of the EBDA,
+     * in the last KiB of base memory, or in the BIOS ROM. */
+
+    int res = fwtable_search_ebda("_MP_", mpfp, sizeof(*mpfp));
+    if (res != -ENOENT) {
+        return res;
+    }
+
+    res = fwtable_search(MP_BASE_MEM_END, 1024, "_MP_", mpfp, sizeof(*mpfp));
+    if (res != -ENOENT) {
+        return res;
+    }
+
+    return fwtable_search(MP_BIOS_ROM_ADDR, MP_BIOS_ROM_LEN, "_MP_",
+                          mpfp, sizeof(*mpfp));
+}
+
+static int
+add_ioapic(struct irq_routing* routing, unsigned char id, uintptr_t addr,
+           unsigned long* gsi_base)
+{
+    long npins = ioapic_count_pins(addr);
+    if (npins < 0) {
+        return npins;
+    }
+
+    int res = irq_routing_add_ioapic(routing, id, addr, *gsi_base);
+    if (res < 0) {
+        return res;
+    }
+
+    *gsi_base += npins;
+
+    return 0;
+}
+
+static long
+gsi_of_pin(const struct irq_routing* routing, unsigned char ioapic_id,
+           unsigned char pin)
+{
+    for (size_t i = 0; i < routing->nioapics; ++i) {
+        if (routing->ioapic[i].id == ioapic_id) {
+            return routing->ioapic[i].gsi_base + pin;
+        }
+    }
+
+    return -ENOENT;
+}
+
+static int
+parse_config_table(const struct mp_config_header* header,
+                   struct irq_routing* routing)
+{
+    /* All entries are 8 bytes long, except for processors. */
+
+    enum {
+        MP_PROCESSOR_LENGTH = 20,
+        MP_ENTRY_LENGTH     = 8
+    };
+
+    const uint8_t* beg = (const uint8_t*)(header + 1);
+    const uint8_t* end = ((const uint8_t*)header) + header->base_length;
+
+    /* ISA buses, indexed by bus id */
+    bool is_isa[256];
+    memset(is_isa, 0, sizeof(is_isa));
+
+    unsigned long gsi_base = 0;
+
+    /* The MP specification sorts entries by type, so buses and
+     * I/O APICs come before I/O-interrupt entries. */
+
+    for (size_t i = 0; (i < header->entry_count) && (beg < end); ++i) {
+
+        switch (*beg) {
+            case MP_ENTRY_PROCESSOR:
+                beg += MP_PROCESSOR_LENGTH;
+                continue;
+            case MP_ENTRY_BUS: {
+                const struct mp_bus* bus = (const void*)beg;
+                is_isa[bus->id] = !memcmp(bus->bus_type, "ISA", 3);
+                break;
+            }
+            case MP_ENTRY_IOAPIC: {
+                const struct mp_ioapic* ioapic = (const void*)beg;
+                if (ioapic->flags & MP_IOAPIC_ENABLED) {
+                    int res = add_ioapic(routing, ioapic->id,
+                                         ioapic->address, &gsi_base);
+                    if (res < 0) {
+                        return res;
+                    }
+                }
+                break;
+            }
+            case MP_ENTRY_IO_INT: {
+                const struct mp_io_int* io_int = (const void*)beg;
+                if ((io_int->int_type == MP_INT_TYPE_INT) &&
+                    is_isa[io_int->src_bus]) {
+                    long gsi = gsi_of_pin(routing, io_int->dst_ioapic,
+                                          io_int->dst_pin);
+                    if (!(gsi < 0)) {
+                        irq_routing_set_isa(routing, io_int->src_irq, gsi,
+                                            io_int->flags);
+                    }
+                }
+                break;
+            }
+            case MP_ENTRY_LOCAL_INT:
+                break;
+            default:
+                return -EINVAL; /* unknown length */
+        }
+
+        beg += MP_ENTRY_LENGTH;
+    }
+
+    return routing->nioapics ? 0 : -ENODEV;
+}
+
+int
+mptable_read_irq_routing(struct irq_routing* routing)
+{
+    struct mp_floating_pointer mpfp;
+
+    int res = find_floating_pointer(&mpfp);
+    if (res < 0) {
+        return res;
+    }
+
+    irq_routing_init(routing);
+    routing->has_imcr = !!(mpfp.feature[1] & MP_FEATURE2_IMCR);
+
+    if (mpfp.feature[0]) {
+        /* default configuration; no table present */
+        unsigned long gsi_base = 0;
+        return add_ioapic(routing, MP_DEFAULT_IOAPIC_ID,
+                          MP_DEFAULT_IOAPIC_ADDR, &gsi_base);
+    }
+
+    const struct mp_config_header* header =
+        fwtable_map(mpfp.config_address, sizeof(*header));
+    if (!header) {
+        return -ENOMEM;
+    }
+
+    size_t len = header->base_length;
+
+    fwtable_unmap(header, sizeof(*header));
+
+    if (len < sizeof(*header)) {
+        return -EINVAL;
+    }
+
+    header = fwtable_map(mpfp.config_address, len);
+    if (!header) {
+        return -ENOMEM;
+    }
+
+    if (memcmp(header->signature, "PCMP", sizeof(header->signature)) ||
+        !fwtable_has_valid_checksum(header, len)) {
+        res = -EINVAL;
+        goto out;
+    }
+
+    res = parse_config_table(header, routing);
+
+out:
+    fwtable_unmap(header, len);
+    return res;
+}
@@ -28,22 +28,33 @@
 #include <stddef.h>
 #include <string.h>
 #include "alloc.h"
+#include "apic.h"
+#include "clock.h"
 #include "console.h"
+#include "cpu.h"
 #include "drivers/i8042/kbd.h"
 #include "drivers/i8254/i8254.h"
 #include "drivers/i8259/pic.h"
+#include "drivers/lapic/lapic.h"
 #include "drivers/multiboot_vga/multiboot_vga.h"
+#include "drivers/uart16550/uart16550.h"
 #include "idt.h"
 #include "interupt.h"
 #include "iomem.h"
+#include "irq.h"
+#include "irqroute.h"
 #include "elf.h"
 #include "gdt.h"
 #include "pageframe.h"
 #include "pmem.h"
 #include "pte.h"
-#include "sched.h" // for SCHED_FREQ
+#include "rmap.h"
+#include "sched.h"
+#include "softirq.h"
 #include "syscall.h"
 #include "sysexec.h"
+#include "trace.h"
+#include "tsc.h"
 #include "vmem.h"
 
 /*
@@ -57,7 +68,13 @@ static struct vmem g_kernel_vmem;
  */
 
 static struct i8254_drv         g_i8254_drv;
+static struct lapic_drv         g_lapic_drv;
+static struct clocksource       g_tsc_clocksource;
 static struct multiboot_vga_drv g_mb_vga_drv;
+static struct uart16550_drv     g_uart16550_drv;
+
+/* true if the APICs replaced the PIC */
+static bool g_apic_installed;
 
 /*
  * Platform entry points for ISR handlers
@@ -71,19 +88,39 @@ static struct multiboot_vga_drv g_mb_vga_drv;
 void __attribute__((used))
 platform_handle_invalid_opcode(void* ip)
 {
-    console_printf("invalid opcode ip=%x.\n", (unsigned long)ip);
+    console_printf("invalid opcode ip=%p.\n", ip);
 }
 
 void __attribute__((used))
 platform_handle_irq(unsigned char irqno)
 {
-    pic_handle_irq(irqno);
+    if (g_apic_installed) {
+        handle_irq(irqno);
+    } else {
+        pic_handle_irq(irqno);
+    }
 }
 
 void __attribute__((used))
 platform_eoi(unsigned char irqno)
 {
-    pic_eoi(irqno);
+    if (g_apic_installed || (irqno == LAPIC_TIMER_IRQNO)) {
+        lapic_eoi(&g_lapic_drv);
+    } else {
+        pic_eoi(irqno);
+    }
+}
+
+void __attribute__((used))
+platform_irq_exit()
+{
+    /* Softirqs run with interrupts enabled. Switching threads from
+     * an interrupt that arrived meanwhile would leave them marked
+     * as running, so only the outermost exit reschedules. The
+     * request remains pending until then. */
+    if (softirq_run()) {
+        sched_resched_if_needed(cpuid());
+    }
 }
 
 void __attribute__((used))
@@ -95,6 +132,8 @@ platform_handle_segmentation_fault(void* ip)
 void __attribute__((used))
 platform_handle_page_fault(void* ip, void* addr, unsigned long errcode)
 {
+    trace_event(TRACE_PAGE_FAULT, addr, errcode, ip);
+
     vmem_pagefault_handler(ip, addr, errcode);
 }
 
@@ -249,6 +288,9 @@ next_mod_list(const struct multiboot_info* info,
  *
  * We give the allocated map to PMEM and mark all pre-allocated
  * areas, such as kernel and module frames, using PMEM interfaces.
+ *
+ * The reverse map of the page frames is allocated right after the
+ * memory map, starting at the next page frame.
  */
 
 static bool
@@ -357,11 +399,46 @@ available_frames(const struct multiboot_info* info)
     return nframes;
 }
 
+static size_t
+memmap_size(unsigned long pfcount)
+{
+    return pfcount * sizeof(pmem_map_t);
+}
+
+static size_t
+rmap_size(unsigned long pfcount)
+{
+    return pfcount * sizeof(rmap_t) +
+           rmap_chain_count(pfcount) * sizeof(struct rmap_chain);
+}
+
+static size_t
+memmap_and_rmap_size(unsigned long pfcount)
+{
+    return pageframe_memory(pageframe_count(memmap_size(pfcount))) +
+           rmap_size(pfcount);
+}
+
+static rmap_t*
+get_rmap(const pmem_map_t* memmap, unsigned long pfcount)
+{
+    uintptr_t addr = (uintptr_t)memmap +
+                     pageframe_memory(pageframe_count(memmap_size(pfcount)));
+
+    return (rmap_t*)addr;
+}
+
+static struct rmap_chain*
+get_rmap_chain(const pmem_map_t* memmap, unsigned long pfcount)
+{
+    return (struct rmap_chain*)(get_rmap(memmap, pfcount) + pfcount);
+}
+
 static pmem_map_t*
 alloc_memmap(const struct multiboot_info* info,
              unsigned long pfcount)
 {
-    unsigned long nframes = pageframe_count(pfcount * sizeof(pmem_map_t));
+    unsigned long nframes = pageframe_count(memmap_and_rmap_size(pfcount));
 
     unsigned long pfindex = find_unused_area(info, nframes);
     if (!pfindex) {
@@ -498,15 +575,23 @@ init_pmem_from_multiboot(const struct multiboot_info* info)
         return res;
     }
 
+    res = rmap_init(get_rmap(memmap, pfcount), pfcount,
+                    get_rmap_chain(memmap, pfcount),
+                    rmap_chain_count(pfcount));
+    if (res < 0) {
+        return res;
+    }
+
     res = mark_mmap_areas(info);
     if (res < 0) {
         return res;
     }
 
-    /* claim memory map; global variables of pmem claimed
-     * by kernel image */
+    /* claim memory map and reverse map; global variables of
+     * pmem claimed by kernel image */
     res = pmem_claim_frames(pageframe_index(memmap),
-                            pageframe_span(memmap, pfcount * sizeof(*memmap)));
+                            pageframe_span(memmap,
+                                           memmap_and_rmap_size(pfcount)));
     if (res < 0) {
         return res;
     }
@@ -605,7 +690,7 @@ map_memmap_frames(struct vmem* vmem, const pmem_map_t* memmap, size_t nframes)
     int res = vmem_map_pageframes_nopg(vmem,
                                        pageframe_index(memmap),
                                        pageframe_index(memmap),
-                                       pageframe_count(nframes * sizeof(*memmap)),
+                                       pageframe_count(memmap_and_rmap_size(nframes)),
                                        PTE_FLAG_PRESENT |
                                        PTE_FLAG_WRITEABLE);
     if (res < 0) {
@@ -788,6 +873,22 @@ multiboot_load_modules(struct task *parent,
  * Entry point
  */
 
+static int
+install_apic(void)
+{
+    struct irq_routing routing;
+
+    int res = acpi_read_irq_routing(&routing);
+    if (res < 0) {
+        res = mptable_read_irq_routing(&routing);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    return apic_install(&g_lapic_drv, &routing);
+}
+
 /**
  * The function |multiboot_init| is called from multiboot.S as the entry
  * point into the C code. Don't declare it 'static.'
@@ -812,6 +913,16 @@ multiboot_init(const struct multiboot_header* header,
         return;
     }
 
+    /* mirror the console on COM1; output is polled until
+     * interrupts are available */
+
+    res = uart16550_init(&g_uart16550_drv, UART16550_COM1_PORT);
+    bool has_uart = !(res < 0);
+
+    if (has_uart) {
+        console_add_sink(&g_uart16550_drv.sink);
+    }
+
     /* At this point we have a console ready, so display
      * something to the user. */
     console_printf("opsys booting...\n");
@@ -856,19 +967,58 @@ multiboot_init(const struct multiboot_header* header,
         return;
     }
 
-    /* init interupt controller and handling */
+    /* init interupt controller and handling; the APICs replace
+     * the PIC if the firmware describes the IRQ routing */
 
     init_idt();
     pic_install();
+    softirq_init();
 
-    /* setup PIT for system timer */
+    res = lapic_init(&g_lapic_drv);
+    bool has_lapic = !(res < 0);
 
-    res = i8254_init(&g_i8254_drv);
-    if (res < 0) {
-        return;
+    if (has_lapic) {
+        res = install_apic();
+        g_apic_installed = !(res < 0);
+    }
+
+    /* setup system clock; fall back to counting PIT ticks if the
+     * CPU has no time-stamp counter */
+
+    res = tsc_init_clocksource(&g_tsc_clocksource);
+    bool has_tsc = !(res < 0);
+
+    /* setup system timer; prefer the local APIC over the PIT. The
+     * PIT's clock source requires the PIT timer, so we only use the
+     * local APIC with the TSC. */
+
+    if (has_tsc && has_lapic) {
+        res = lapic_install_timer(&g_lapic_drv);
+    }
+    if (!has_tsc || !has_lapic || (res < 0)) {
+        res = i8254_init(&g_i8254_drv);
+        if (res < 0) {
+            return;
+        }
+        i8254_install_timer(&g_i8254_drv);
+    }
+
+    if (has_tsc) {
+        clock_set_source(&g_tsc_clocksource);
+    } else {
+        clock_set_source(&g_i8254_drv.clocksource);
+    }
+
+    if (has_uart) {
+        res = uart16550_install_irq(&g_uart16550_drv, UART16550_COM1_IRQNO);
+        if (res < 0) {
+            console_perror("uart16550_install_irq", -res);
+        }
     }
 
-    i8254_install_timer(&g_i8254_drv, SCHED_FREQ); // TODO: avoid SCHED_FREQ
+    /* tracing requires the TSC; dumps go to the serial port */
+    trace_init(has_tsc ? &g_tsc_clocksource : NULL,
+               has_uart ? &g_uart16550_drv.sink : NULL);
 
     /* init keyboard; TODO: this driver should run as a user-space program */
     res = kbd_init();
@@ -71,3 +71,34 @@ page_ceil(const void *addr)
 {
         return (void*)(((((size_t)addr)>>PAGE_SHIFT)+1) << PAGE_SHIFT);
 }
+
+/**
+ * \brief fills a page with zeros
+ * \param page the page-aligned address
+ */
+static __inline__ void
+page_zero(void *page)
+{
+        size_t nwords = PAGE_SIZE/sizeof(unsigned long);
+
+        __asm__ __volatile__("rep stosl\n\t"
+                             : "+D"(page), "+c"(nwords)
+                             : "a"(0)
+                             : "memory");
+}
+
+/**
+ * \brief copies a page
+ * \param dst the page-aligned destination address
+ * \param src the page-aligned source address
+ */
+static __inline__ void
+page_copy(void *dst, const void *src)
+{
+        size_t nwords = PAGE_SIZE/sizeof(unsigned long);
+
+        __asm__ __volatile__("rep movsl\n\t"
+                             : "+D"(dst), "+S"(src), "+c"(nwords)
+                             :
+                             : "memory");
+}
@@ -18,13 +18,13 @@
  */
 
 #include "pagedir.h"
-#include <string.h>
+#include "page.h"
 #include "pmem.h"
 
 int
 page_directory_init(struct page_directory *pd)
 {
-        memset(pd, 0, sizeof(*pd));
+        page_zero(pd);
 
         return 0;
 }
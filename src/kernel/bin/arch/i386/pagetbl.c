@@ -18,13 +18,12 @@
  */
 
 #include "pagetbl.h"
-#include <string.h>
 #include "pmem.h"
 
 int
 page_table_init(struct page_table *pt)
 {
-        memset(pt, 0, sizeof(*pt));
+        page_zero(pt);
 
         return 0;
 }
@@ -35,29 +34,51 @@ page_table_uninit(struct page_table *pt)
         return;
 }
 
+static void
+unref_page_frame(struct page_table *pt, rmap_asid_t asid, os_index_t pgindex)
+{
+        pte_type pte = pt->entry[pagetable_page_index(pgindex)];
+        os_index_t pfindex = pte_get_pageframe_index(pte);
+
+        if (pfindex && !(pte & PTE_FLAG_IOMEM))
+        {
+                rmap_remove(pfindex, asid, pgindex);
+                pmem_unref_frames(pfindex, 1);
+        }
+}
+
 int
-page_table_map_page_frame(struct page_table *pt, os_index_t pfindex,
-                          os_index_t index, unsigned int flags)
+page_table_map_page_frame(struct page_table *pt, rmap_asid_t asid,
+                          os_index_t pfindex, os_index_t pgindex,
+                          unsigned int flags)
 {
         int err;
+        os_index_t index;
+
+        index = pagetable_page_index(pgindex);
 
         /*
-         * ref new page frame
+         * ref new page frame; device memory is not reference counted
          */
 
-        if ((err = pmem_ref_frames(pfindex, 1)) < 0)
+        if (!(flags & PTE_FLAG_IOMEM))
         {
-                goto err_pmem_ref_frames;
+                if ((err = pmem_ref_frames(pfindex, 1)) < 0)
+                {
+                        goto err_pmem_ref_frames;
+                }
+
+                if ((err = rmap_add(pfindex, asid, pgindex)) < 0)
+                {
+                        goto err_rmap_add;
+                }
         }
 
         /*
          * unref old page frame
          */
 
-        if (pte_get_pageframe_index(pt->entry[index]))
-        {
-                pmem_unref_frames(pte_get_pageframe_index(pt->entry[index]), 1);
-        }
+        unref_page_frame(pt, asid, pgindex);
 
         /*
          * update page table entry
@@ -66,36 +87,41 @@ page_table_map_page_frame(struct page_table *pt, os_index_t pfindex,
 
         return 0;
 
+err_rmap_add:
+        pmem_unref_frames(pfindex, 1);
 err_pmem_ref_frames:
         return err;
 }
 
 int
-page_table_map_page_frames(struct page_table *pt,
-                           os_index_t pfindex,
-                           os_index_t index, size_t count, unsigned int flags)
+page_table_map_page_frames(struct page_table *pt, rmap_asid_t asid,
+                           os_index_t pfindex, os_index_t pgindex,
+                           size_t count, unsigned int flags)
 {
         int err;
 
-        for (err = 0; count && !(err < 0); --count, ++index, ++pfindex)
+        for (err = 0; count && !(err < 0); --count, ++pgindex, ++pfindex)
         {
-                err = page_table_map_page_frame(pt, pfindex, index, flags);
+                err = page_table_map_page_frame(pt, asid, pfindex, pgindex,
+                                                flags);
         }
 
         return err;
 }
 
 int
-page_table_unmap_page_frame(struct page_table *pt, os_index_t index)
+page_table_unmap_page_frame(struct page_table *pt, rmap_asid_t asid,
+                            os_index_t pgindex)
 {
+        os_index_t index;
+
+        index = pagetable_page_index(pgindex);
+
         /*
          * unref page frame
          */
 
-        if (pte_get_pageframe_index(pt->entry[index]))
-        {
-                pmem_unref_frames(pte_get_pageframe_index(pt->entry[index]), 1);
-        }
+        unref_page_frame(pt, asid, pgindex);
 
         /*
          * clear page table entry
@@ -106,14 +132,14 @@ page_table_unmap_page_frame(struct page_table *pt, os_index_t index)
 }
 
 int
-page_table_unmap_page_frames(struct page_table *pt, os_index_t index,
-                             size_t count)
+page_table_unmap_page_frames(struct page_table *pt, rmap_asid_t asid,
+                             os_index_t pgindex, size_t count)
 {
         int err;
 
-        for (err = 0; count && !(err < 0); --count, ++index)
+        for (err = 0; count && !(err < 0); --count, ++pgindex)
         {
-                err = page_table_unmap_page_frame(pt, index);
+                err = page_table_unmap_page_frame(pt, asid, pgindex);
         }
 
         return err;
@@ -21,6 +21,7 @@
 
 #include "page.h"
 #include "pte.h"
+#include "rmap.h"
 
 enum {
         PAGETABLE_SHIFT = 22,
@@ -84,20 +85,24 @@ page_table_uninit(struct page_table *pt);
 
 int
 page_table_map_page_frame(struct page_table *pt,
+                          rmap_asid_t asid,
                           os_index_t pfindex,
-                          os_index_t index,
+                          os_index_t pgindex,
                           unsigned int flags);
 
 int
 page_table_map_page_frames(struct page_table *pt,
+                           rmap_asid_t asid,
                            os_index_t pfindex,
-                           os_index_t index,
+                           os_index_t pgindex,
                            size_t count,
                            unsigned int flags);
 
 int
-page_table_unmap_page_frame(struct page_table *pt, os_index_t index);
+page_table_unmap_page_frame(struct page_table *pt, rmap_asid_t asid,
+                                                   os_index_t pgindex);
 
 int
-page_table_unmap_page_frames(struct page_table *pt, os_index_t index,
+page_table_unmap_page_frames(struct page_table *pt, rmap_asid_t asid,
+                                                    os_index_t pgindex,
                                                     size_t count);
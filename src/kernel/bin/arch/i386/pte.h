@@ -20,12 +20,20 @@
 #pragma once
 
 enum {
-        PTE_FLAG_PRESENT   = 1<<0,
-        PTE_FLAG_WRITEABLE = 1<<1,
-        PTE_FLAG_USERMODE  = 1<<2,
-        PTE_ALL_FLAGS      = PTE_FLAG_PRESENT|
-                             PTE_FLAG_WRITEABLE|
-                             PTE_FLAG_USERMODE
+        PTE_FLAG_PRESENT      = 1<<0,
+        PTE_FLAG_WRITEABLE    = 1<<1,
+        PTE_FLAG_USERMODE     = 1<<2,
+        PTE_FLAG_WRITETHROUGH = 1<<3,
+        PTE_FLAG_CACHEDISABLE = 1<<4,
+        /* available to software; page frame is device memory that
+         * is not managed by pmem, so it is not reference counted */
+        PTE_FLAG_IOMEM        = 1<<9,
+        PTE_ALL_FLAGS         = PTE_FLAG_PRESENT|
+                                PTE_FLAG_WRITEABLE|
+                                PTE_FLAG_USERMODE|
+                                PTE_FLAG_WRITETHROUGH|
+                                PTE_FLAG_CACHEDISABLE|
+                                PTE_FLAG_IOMEM
 };
 
 enum {
@@ -0,0 +1,105 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tsc.h"
+#include <errno.h>
+#include <stddef.h>
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "div64.h"
+#include "drivers/i8254/i8254.h"
+#include "interupt.h"
+#include "timer.h"
+
+enum {
+    /* calibrate over 50 ms; must fit into the 16-bit counter */
+    TSC_CALIBRATION_TICKS = i8254_TICKS_PER_S / 20
+};
+
+bool
+tsc_is_available()
+{
+    if (!has_cpuid()) {
+        return false;
+    }
+
+    unsigned long regs[4];
+
+    cpuid_leaf(0, regs);
+    if (regs[0] < 1) {
+        return false;
+    }
+
+    cpuid_leaf(1, regs);
+
+    return !!(regs[3] & CPUID_1_EDX_TSC);
+}
+
+static bool
+tsc_is_invariant(void)
+{
+    unsigned long regs[4];
+
+    cpuid_leaf(0x80000000, regs);
+    if (regs[0] < 0x80000007) {
+        return false;
+    }
+
+    cpuid_leaf(0x80000007, regs);
+
+    return !!(regs[3] & CPUID_80000007_EDX_INVTSC);
+}
+
+static unsigned long long
+read_tsc(struct clocksource* cs)
+{
+    return rdtsc();
+}
+
+int
+tsc_init_clocksource(struct clocksource* cs)
+{
+    if (!tsc_is_available()) {
+        return -ENODEV;
+    }
+
+    bool ints_on = cli_if_on();
+
+    unsigned long long tsc0 = rdtsc();
+    i8254_busy_wait(TSC_CALIBRATION_TICKS);
+    unsigned long long tsc1 = rdtsc();
+
+    sti_if_on(ints_on);
+
+    unsigned long long cycles = tsc1 - tsc0;
+    if (!cycles || (cycles >> 32)) {
+        return -ERANGE;
+    }
+
+    unsigned long ns = div64_u32((unsigned long long)TSC_CALIBRATION_TICKS *
+                                 S_TO_NS(1), i8254_TICKS_PER_S, NULL);
+
+    clocksource_init(cs, "tsc", read_tsc, cycles, ns);
+
+    if (!tsc_is_invariant()) {
+        console_printf("TSC is not invariant; clock might drift.\n");
+    }
+
+    return 0;
+}
@@ -1,7 +1,6 @@
 /*
  *  opsys - A small, experimental operating system
- *  Copyright (C) 2010  Thomas Zimmermann
- *  Copyright (C) 2016  Thomas Zimmermann
+ *  Copyright (C) 2017  Thomas Zimmermann
  *
  *  This program is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -19,30 +18,23 @@
 
 #pragma once
 
-#include "vmemarea.h"
+#include <stdbool.h>
 
-struct memzone
-{
-        size_t                 flagslen;
-        unsigned char         *flags;
-        size_t                 chunksize;
-        size_t                 nchunks;
-        struct vmem           *as;
-        enum vmem_area_name    areaname;
-};
+struct clocksource;
 
-int
-memzone_init(struct memzone *mz,
-             struct vmem *as, enum vmem_area_name areaname);
-
-size_t
-memzone_get_nchunks(struct memzone *mz, size_t nbytes);
-
-os_index_t
-memzone_alloc(struct memzone *mz, size_t nchunks);
-
-void
-memzone_free(struct memzone *mz, os_index_t chunk, size_t nchunks);
+/**
+ * \brief tests if the CPU has a time-stamp counter
+ * \return true if the TSC is available, or false otherwise
+ */
+bool
+tsc_is_available(void);
 
-void *
-memzone_address(struct memzone *mz, os_index_t chunk);
+/**
+ * \brief inits a clock source for the time-stamp counter
+ * \param[out] cs the clock source
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * The TSC's frequency is calibrated against the i8254.
+ */
+int
+tsc_init_clocksource(struct clocksource* cs);
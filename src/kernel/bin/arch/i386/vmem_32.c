@@ -21,7 +21,7 @@
 #include <errno.h>
 #include <stddef.h>
 #include <string.h>
-#include "membar.h"
+#include "kmap.h"
 #include "minmax.h"
 #include "mmu.h"
 #include "pagedir.h"
@@ -35,19 +35,10 @@
  * Page-table mappings
  */
 
-static struct page_table *
-get_temp_page_table(void)
-{
-    const struct vmem_area* low = vmem_area_get_by_name(VMEM_AREA_KERNEL_LOW);
-    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
-
-    return page_address(low->pgindex + low->npages - (tmp->npages >> 10));
-}
-
 static struct page_table*
 claim_and_init_temp_page_table(void)
 {
-    struct page_table* pt = get_temp_page_table();
+    struct page_table* pt = kmap_get_page_table();
     if (!pt) {
         return NULL;
     }
@@ -70,97 +61,6 @@ err_pmem_claim_frames:
     return NULL;
 }
 
-static os_index_t
-get_temp_page(size_t i)
-{
-    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
-
-    return tmp->pgindex + i;
-}
-
-static bool
-page_is_temp(os_index_t pgindex)
-{
-    const struct vmem_area* tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
-
-    return vmem_area_contains_page(tmp, pgindex);
-}
-
-static os_index_t
-get_temp_index(os_index_t pgindex)
-{
-    const struct vmem_area *tmp = vmem_area_get_by_name(VMEM_AREA_TMPMAP);
-
-    return pgindex - tmp->pgindex;
-}
-
-static os_index_t
-install_temp_page_frame(os_index_t pfindex)
-{
-    struct page_table* pt = get_temp_page_table();
-
-    /* find empty temporary page
-     */
-
-    volatile pde_type* ptebeg = pt->entry;
-    volatile pde_type* pteend = pt->entry + ARRAY_NELEMS(pt->entry);
-    volatile pde_type* pte = ptebeg;
-
-    while ((pte < pteend) && (pte_get_pageframe_index(*pte))) {
-        ++pte;
-    }
-
-    if (!(pteend - pte)) {
-        /* none found */
-        return -EBUSY;
-    }
-
-    /* establish mapping to page frame
-     */
-
-    pmem_ref_frames(pfindex, 1);
-
-    *pte = pte_create(pfindex, PTE_FLAG_PRESENT|PTE_FLAG_WRITEABLE);
-
-    os_index_t pgindex = get_temp_page(pte - ptebeg);
-
-    mmu_flush_tlb_entry(page_address(pgindex));
-
-    return pgindex;
-}
-
-static os_index_t
-uninstall_temp_page(os_index_t pgindex)
-{
-    if (!page_is_temp(pgindex)) {
-        /* not temporarily mapped */
-        return -EINVAL;
-    }
-
-    os_index_t index = get_temp_index(pgindex);
-
-    /* finish access before unmapping page */
-    rwmembar();
-
-    /* remove mapping
-     */
-
-    struct page_table* pt = get_temp_page_table();
-
-    int res = page_table_unmap_page_frame(pt, index);
-    if (res < 0) {
-        goto err_page_table_unmap_page_frame;
-    }
-
-    mmu_flush_tlb_entry(page_address(pgindex));
-    mmu_flush_tlb();
-
-    return 0;
-
-err_page_table_unmap_page_frame:
-    return res;
-}
-
 static struct page_table*
 alloc_and_init_page_table(struct vmem_32* vmem32, unsigned long i)
 {
@@ -174,20 +74,14 @@ alloc_and_init_page_table(struct vmem_32* vmem32, unsigned long i)
         return NULL;
     }
 
-    os_index_t pgindex = install_temp_page_frame(pfindex);
+    struct page_table* pt = kmap(pfindex);
 
-    if (pgindex < 0) {
-        goto err_install_temp_page_frame;
+    if (!pt) {
+        goto err_kmap;
     }
 
     /* init and install page table */
 
-    struct page_table* pt = page_address(pgindex);
-
-    if (!pt) {
-        goto err_page_address;
-    }
-
     int res = page_table_init(pt);
     if (res < 0) {
         goto err_page_table_init;
@@ -202,15 +96,17 @@ alloc_and_init_page_table(struct vmem_32* vmem32, unsigned long i)
         goto err_page_directory_install_page_table;
     }
 
+    /* the page directory holds the reference from now on */
+    pmem_unref_frames(pfindex, pfcount);
+
     mmu_flush_tlb();
 
     return pt;
 
 err_page_directory_install_page_table:
 err_page_table_init:
-err_page_address:
-    uninstall_temp_page(pgindex);
-err_install_temp_page_frame:
+    kunmap(pt);
+err_kmap:
     pmem_unref_frames(pfindex, pfcount);
     return NULL;
 }
@@ -220,34 +116,131 @@ map_page_table(struct vmem_32* vmem32, unsigned long i, bool init_if_none)
 {
     os_index_t pfindex = pde_get_pageframe_index(vmem32->pd->entry[i]);
 
-    if (!pfindex && init_if_none) {
+    if (!pfindex) {
+        if (!init_if_none) {
+            return NULL;
+        }
         return alloc_and_init_page_table(vmem32, i);
     }
 
-    /* map page-table page frames */
-    os_index_t pgindex = install_temp_page_frame(pfindex);
+    /* map page-table page frames; the page directory
+     * holds the reference */
+    return kmap(pfindex);
+}
 
-    if (pgindex < 0) {
-        return NULL;
+static void
+unmap_page_table(struct vmem_32* vmem32, struct page_table* pt)
+{
+    kunmap(pt);
+}
+
+/*
+ * Page-table cursors
+ *
+ * A cursor keeps a single page table of an address space mapped
+ * while walking over consecutive pages. The page table is only
+ * remapped when the walk crosses a page-table boundary.
+ */
+
+struct page_table_cursor {
+    struct vmem_32*    vmem32;
+    os_index_t         ptindex;
+    struct page_table* pt;
+};
+
+static void
+page_table_cursor_init(struct page_table_cursor* cur, struct vmem_32* vmem32)
+{
+    cur->vmem32 = vmem32;
+    cur->ptindex = -1;
+    cur->pt = NULL;
+}
+
+static void
+page_table_cursor_uninit(struct page_table_cursor* cur)
+{
+    if (cur->pt) {
+        unmap_page_table(cur->vmem32, cur->pt);
+    }
+}
+
+static struct page_table*
+page_table_cursor_move(struct page_table_cursor* cur, os_index_t pgindex,
+                       bool init_if_none)
+{
+    os_index_t ptindex = pagetable_index(page_address(pgindex));
+
+    if (cur->pt && (cur->ptindex == ptindex)) {
+        return cur->pt;
     }
 
-    struct page_table* pt = page_address(pgindex);
+    page_table_cursor_uninit(cur);
 
-    if (!pt) {
-        goto err_page_address;
+    cur->ptindex = ptindex;
+    cur->pt = map_page_table(cur->vmem32, ptindex, init_if_none);
+
+    return cur->pt;
+}
+
+/*
+ * Page-frame batches
+ */
+
+enum {
+    FRAME_BATCH_SIZE = 64
+};
+
+struct frame_batch {
+    unsigned long pfindex[FRAME_BATCH_SIZE];
+    size_t        n;
+    size_t        nfreed; /**< number of released page frames */
+};
+
+static void
+flush_frame_batch(struct frame_batch* batch)
+{
+    batch->nfreed += pmem_unref_frame_batch(batch->pfindex, batch->n);
+    batch->n = 0;
+}
+
+static void
+add_to_frame_batch(struct frame_batch* batch, unsigned long pfindex)
+{
+    if (batch->n == ARRAY_NELEMS(batch->pfindex)) {
+        flush_frame_batch(batch);
     }
+    batch->pfindex[batch->n++] = pfindex;
+}
 
-    return pt;
+/*
+ * Page-table entries
+ *
+ * Device memory is mapped with PTE_FLAG_IOMEM. Its page frames are
+ * neither reference counted nor recorded in the reverse map.
+ */
 
-err_page_address:
-    uninstall_temp_page(pgindex);
-    return NULL;
+static os_index_t
+pte_get_managed_frame(pte_type pte)
+{
+    if (pte & PTE_FLAG_IOMEM) {
+        return 0;
+    }
+    return pte_get_pageframe_index(pte);
 }
 
+/* Clears an entry; the page frame is released with the batch. */
 static void
-unmap_page_table(struct vmem_32* vmem32, struct page_table* pt)
+release_pte(struct vmem_32* vmem32, volatile pte_type* pte,
+            os_index_t pgindex, struct frame_batch* batch)
 {
-    uninstall_temp_page(page_index(pt));
+    os_index_t pfindex = pte_get_managed_frame(*pte);
+
+    *pte = pte_create(0, 0);
+
+    if (pfindex) {
+        rmap_remove(pfindex, vmem32->asid, pgindex);
+        add_to_frame_batch(batch, pfindex);
+    }
 }
 
 /*
@@ -255,9 +248,9 @@ unmap_page_table(struct vmem_32* vmem32, struct page_table* pt)
  */
 
 int
-vmem_32_init(struct vmem_32* vmem32,
+vmem_32_init(struct vmem_32* vmem32, rmap_asid_t asid,
              void* (alloc_aligned)(size_t, void*),
-             void (*unref_aligned)(void*, size_t, void*), void* alloc_data)
+             size_t (*unref_aligned)(void*, size_t, void*), void* alloc_data)
 {
     struct page_directory* pd = alloc_aligned(sizeof(*pd), alloc_data);
     if (!pd) {
@@ -270,6 +263,9 @@ vmem_32_init(struct vmem_32* vmem32,
     }
 
     vmem32->pd = pd;
+    vmem32->asid = asid;
+    vmem32->unref_aligned = unref_aligned;
+    vmem32->alloc_data = alloc_data;
 
     return 0;
 
@@ -278,10 +274,179 @@ err_page_directory_init:
     return res;
 }
 
-void
+/*
+ * Borrowed page tables
+ *
+ * A page table can be installed in the page directories of other
+ * address spaces. Each such installation holds a reference on the
+ * page table's page frame and is recorded in the frame's reverse
+ * map with the first page of the page table. Page tables without
+ * such an entry belong to the address space.
+ */
+
+static os_index_t
+page_table_first_page(os_index_t ptindex)
+{
+    return page_index(pagetable_address(ptindex));
+}
+
+struct rmap_match {
+    rmap_asid_t asid;
+    os_index_t  pgindex;
+};
+
+static int
+match_mapping(rmap_asid_t asid, os_index_t pgindex, void* data)
+{
+    const struct rmap_match* match = data;
+
+    return (asid == match->asid) && (pgindex == match->pgindex);
+}
+
+static bool
+page_table_is_borrowed(const struct vmem_32* vmem32, os_index_t ptindex)
+{
+    os_index_t ptpfindex = pde_get_pageframe_index(vmem32->pd->entry[ptindex]);
+    if (!ptpfindex) {
+        return false;
+    }
+
+    struct rmap_match match = {
+        .asid = vmem32->asid,
+        .pgindex = page_table_first_page(ptindex)
+    };
+
+    return rmap_walk(ptpfindex, match_mapping, &match) > 0;
+}
+
+static int
+match_other_mapping(rmap_asid_t asid, os_index_t pgindex, void* data)
+{
+    return !match_mapping(asid, pgindex, data);
+}
+
+/* Tests if other address spaces borrowed one of our page tables. */
+static bool
+page_table_is_lent(const struct vmem_32* vmem32, os_index_t ptindex)
+{
+    os_index_t ptpfindex = pde_get_pageframe_index(vmem32->pd->entry[ptindex]);
+    if (!ptpfindex) {
+        return false;
+    }
+
+    struct rmap_match match = {
+        .asid = vmem32->asid,
+        .pgindex = page_table_first_page(ptindex)
+    };
+
+    return rmap_walk(ptpfindex, match_other_mapping, &match) > 0;
+}
+
+static bool
+has_borrowed_page_table(struct vmem_32* vmem32, os_index_t pgindex,
+                        size_t pgcount)
+{
+    os_index_t ptindex = pagetable_index(page_address(pgindex));
+    size_t     ptcount = pagetable_count(page_address(pgindex),
+                                         page_memory(pgcount));
+
+    for (; ptcount; --ptcount, ++ptindex) {
+        if (page_table_is_borrowed(vmem32, ptindex)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Teardown
+ */
+
+static void
+revoke_borrowers(struct vmem_32* vmem32, os_index_t ptindex);
+
+static void
+release_page_table(struct vmem_32* vmem32, os_index_t ptindex,
+                   struct frame_batch* batch)
+{
+    os_index_t ptpfindex = pde_get_pageframe_index(vmem32->pd->entry[ptindex]);
+    if (!ptpfindex) {
+        return;
+    }
+
+    if (page_table_is_borrowed(vmem32, ptindex)) {
+        /* only drop our reference; the owner releases the pages */
+        rmap_remove(ptpfindex, vmem32->asid, page_table_first_page(ptindex));
+        goto out;
+    }
+
+    struct page_table* pt = map_page_table(vmem32, ptindex, false);
+
+    if (pt) {
+        os_index_t pgindex = page_table_first_page(ptindex);
+
+        for (size_t i = 0; i < ARRAY_NELEMS(pt->entry); ++i, ++pgindex) {
+            release_pte(vmem32, pt->entry + i, pgindex, batch);
+        }
+
+        unmap_page_table(vmem32, pt);
+    }
+
+out:
+    /* The address space is not active, so clearing the entry
+     * requires no TLB flush. The page table's page frame is
+     * released with the batch. */
+    vmem32->pd->entry[ptindex] = pde_create(0, 0);
+
+    add_to_frame_batch(batch, ptpfindex);
+}
+
+size_t
 vmem_32_uninit(struct vmem_32* vmem32)
 {
-    // TODO: Unmap page directory
+    struct frame_batch batch = {
+        .n = 0,
+        .nfreed = 0
+    };
+
+    /* Only user areas belong to the address space. All other areas
+     * share their page tables with the parent. */
+
+    for (enum vmem_area_name name = 0; name < LAST_VMEM_AREA; ++name) {
+
+        const struct vmem_area* area = vmem_area_get_by_name(name);
+
+        if (!(area->flags & VMEM_AREA_FLAG_USER)) {
+            continue;
+        }
+
+        os_index_t ptindex = pagetable_index(page_address(area->pgindex));
+        size_t     ptcount = pagetable_count(page_address(area->pgindex),
+                                             page_memory(area->npages));
+
+        for (; ptcount; --ptcount, ++ptindex) {
+            if (!page_table_is_borrowed(vmem32, ptindex)) {
+                /* borrowers must not see the freed pages */
+                revoke_borrowers(vmem32, ptindex);
+            }
+            release_page_table(vmem32, ptindex, &batch);
+        }
+    }
+
+    mmu_flush_tlb();
+
+    flush_frame_batch(&batch);
+
+    /* release page directory */
+
+    page_directory_uninit(vmem32->pd);
+
+    size_t nfreed = vmem32->unref_aligned(vmem32->pd, sizeof(*vmem32->pd),
+                                          vmem32->alloc_data);
+    vmem32->pd = NULL;
+
+    return batch.nfreed + nfreed;
 }
 
 size_t
@@ -297,7 +462,10 @@ vmem_32_check_empty_pages(struct vmem_32* vmem32, os_index_t pgindex, size_t pgc
         struct page_table* pt = map_page_table(vmem32, ptindex, false);
 
         if (!pt) {
-            nempty += minul(pgcount, 1024 - pagetable_page_index(pgindex));
+            size_t n = minul(pgcount, 1024 - pagetable_page_index(pgindex));
+            pgcount -= n;
+            pgindex += n;
+            nempty += n;
         } else {
             /* count empty pages at beginning of page table */
             for (size_t i = pagetable_page_index(pgindex);
@@ -326,6 +494,11 @@ vmem_32_alloc_frames(struct vmem_32* vmem32,
     size_t     ptcount = pagetable_count(page_address(pgindex),
                                          page_memory(pgcount));
 
+    /* borrowed page tables belong to another address space */
+    if (has_borrowed_page_table(vmem32, pgindex, pgcount)) {
+        return -EINVAL;
+    }
+
     int res;
 
     for (size_t i = 0; i < ptcount; ++i) {
@@ -343,8 +516,9 @@ vmem_32_alloc_frames(struct vmem_32* vmem32,
                 --pgcount, ++j, ++pgindex, ++pfindex) {
 
             res = page_table_map_page_frame(pt,
+                                            vmem32->asid,
                                             pfindex,
-                                            j,
+                                            pgindex,
                                             pteflags);
             if (res < 0) {
                 goto err_page_table_map_page_frame;
@@ -400,6 +574,11 @@ vmem_32_alloc_pages(struct vmem_32* vmem32, os_index_t pgindex, size_t pgcount,
     size_t     ptcount = pagetable_count(page_address(pgindex),
                                          page_memory(pgcount));
 
+    /* borrowed page tables belong to another address space */
+    if (has_borrowed_page_table(vmem32, pgindex, pgcount)) {
+        return -EINVAL;
+    }
+
     int res = 0;
 
     for (size_t i = 0; i < ptcount; ++i) {
@@ -424,7 +603,12 @@ vmem_32_alloc_pages(struct vmem_32* vmem32, os_index_t pgindex, size_t pgcount,
                 goto err_pmem_alloc_frames;
             }
 
-            res = page_table_map_page_frame(pt, pfindex, j, pteflags);
+            res = page_table_map_page_frame(pt, vmem32->asid, pfindex,
+                                            pgindex, pteflags);
+
+            /* the page table holds the reference from now on */
+            pmem_unref_frames(pfindex, 1);
+
             if (res < 0) {
                 goto err_page_table_map_page_frame;
             }
@@ -444,57 +628,666 @@ err_map_page_table:
     return res;
 }
 
+int
+vmem_32_unmap_pages(struct vmem_32* vmem32, os_index_t pgindex, size_t pgcount,
+                    size_t* nfreed)
+{
+    os_index_t ptindex = pagetable_index(page_address(pgindex));
+    size_t     ptcount = pagetable_count(page_address(pgindex),
+                                         page_memory(pgcount));
+
+    struct frame_batch batch = {
+        .n = 0,
+        .nfreed = 0
+    };
+
+    int res = 0;
+
+    for (; ptcount; --ptcount, ++ptindex) {
+
+        size_t n = minul(pgcount, 1024 - pagetable_page_index(pgindex));
+
+        if (page_table_is_borrowed(vmem32, ptindex)) {
+            /* borrowed page tables can only be removed as a whole */
+            if (n < ARRAY_NELEMS(vmem32->pd->entry)) {
+                res = -EINVAL;
+                goto out;
+            }
+            release_page_table(vmem32, ptindex, &batch);
+        } else {
+            struct page_table* pt = map_page_table(vmem32, ptindex, false);
+
+            if (pt) {
+                volatile pte_type* pte =
+                    pt->entry + pagetable_page_index(pgindex);
+
+                for (size_t i = 0; i < n; ++i) {
+                    release_pte(vmem32, pte + i, pgindex + i, &batch);
+                }
+                unmap_page_table(vmem32, pt);
+            }
+        }
+
+        pgcount -= n;
+        pgindex += n;
+    }
+
+out:
+    mmu_flush_tlb();
+
+    /* release page frames after the TLB flush */
+    flush_frame_batch(&batch);
+
+    if (nfreed) {
+        *nfreed = batch.nfreed;
+    }
+
+    return res;
+}
+
+/* Clears the write flag if the source page table is mapped
+ * read-only. The entries in the table are checked separately. */
+static unsigned long
+pteflags_of_source(const struct vmem_32* src_as, os_index_t src_ptindex,
+                   unsigned long pteflags)
+{
+    if (!(src_as->pd->entry[src_ptindex] & PDE_FLAG_WRITEABLE)) {
+        pteflags &= ~PTE_FLAG_WRITEABLE;
+    }
+    return pteflags;
+}
+
+static int
+map_page_range(struct vmem_32* dst_as, struct page_table* dst_pt,
+               os_index_t dst_pgindex,
+               struct vmem_32* src_as, const struct page_table* src_pt,
+               os_index_t src_pgindex,
+               size_t pgcount, unsigned long pteflags,
+               struct frame_batch* unref)
+{
+    unsigned long pfindex[FRAME_BATCH_SIZE];
+    unsigned long flags[FRAME_BATCH_SIZE];
+
+    /* The mapping holds references on the page frames, so
+     * device memory cannot be mapped this way. */
+    if (pteflags & PTE_FLAG_IOMEM) {
+        return -EINVAL;
+    }
+
+    /* collect source page frames */
+
+    const volatile pte_type* src_pte =
+        src_pt->entry + pagetable_page_index(src_pgindex);
+
+    for (size_t i = 0; i < pgcount; ++i) {
+        if (!pte_is_present(src_pte[i])) {
+            return -EFAULT;
+        } else if (src_pte[i] & PTE_FLAG_IOMEM) {
+            return -EINVAL;
+        }
+        pfindex[i] = pte_get_pageframe_index(src_pte[i]);
+
+        /* never grant more access than the source has */
+        flags[i] = pteflags & (src_pte[i] | ~PTE_FLAG_WRITEABLE);
+    }
+
+    /* ref all page frames at once */
+
+    int res = pmem_ref_frame_batch(pfindex, pgcount);
+    if (res < 0) {
+        return res;
+    }
+
+    size_t i = 0;
+
+    for (; i < pgcount; ++i) {
+        res = rmap_add(pfindex[i], dst_as->asid, dst_pgindex + i);
+        if (res < 0) {
+            goto err_rmap_add;
+        }
+    }
+
+    /* replace destination entries; old page frames are
+     * released with the batch */
+
+    volatile pte_type* dst_pte =
+        dst_pt->entry + pagetable_page_index(dst_pgindex);
+
+    for (i = 0; i < pgcount; ++i) {
+        release_pte(dst_as, dst_pte + i, dst_pgindex + i, unref);
+        dst_pte[i] = pte_create(pfindex[i], flags[i]);
+    }
+
+    return 0;
+
+err_rmap_add:
+    while (i) {
+        --i;
+        rmap_remove(pfindex[i], dst_as->asid, dst_pgindex + i);
+    }
+    pmem_unref_frame_batch(pfindex, pgcount);
+    return res;
+}
+
 int
 vmem_32_map_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
                   struct vmem_32 *src_as, os_index_t src_pgindex,
                   size_t pgcount, unsigned long pteflags)
 {
-    os_index_t dst_ptindex = pagetable_index(page_address(dst_pgindex));
-    size_t     dst_ptcount = pagetable_count(page_address(dst_pgindex),
-                                             page_memory(pgcount));
+    /* Entries of borrowed page tables belong to the lender; writing
+     * them would corrupt the lender's mappings and reverse map. */
+    if (has_borrowed_page_table(dst_as, dst_pgindex, pgcount)) {
+        return -EINVAL;
+    }
 
-    int res;
+    struct page_table_cursor dst, src;
+    page_table_cursor_init(&dst, dst_as);
+    page_table_cursor_init(&src, src_as);
 
-    for (size_t i = 0; i < dst_ptcount; ++i) {
+    struct frame_batch unref = {
+        .n = 0,
+        .nfreed = 0
+    };
 
-        struct page_table* dst_pt = map_page_table(dst_as, dst_ptindex + i, true);
+    int res = 0;
 
-        if (!dst_pt) {
+    while (pgcount) {
+
+        const struct page_table* src_pt =
+            page_table_cursor_move(&src, src_pgindex, false);
+
+        if (!src_pt) {
             res = -EFAULT;
-            goto err_map_page_table;
+            goto err_page_table_cursor_move;
         }
 
-        /* map pages within page table */
+        struct page_table* dst_pt =
+            page_table_cursor_move(&dst, dst_pgindex, true);
 
-        for (size_t j = pagetable_page_index(dst_pgindex);
-                pgcount
-                && (j < ARRAY_NELEMS(dst_pt->entry));
-                --pgcount, ++j, ++dst_pgindex) {
+        if (!dst_pt) {
+            res = -ENOMEM;
+            goto err_page_table_cursor_move;
+        }
 
-            os_index_t src_pfindex = vmem_32_lookup_frame(src_as, src_pgindex);
+        /* map pages up to the next page-table boundary of
+         * either address space */
 
-            if (src_pfindex < 0) {
-                res = src_pfindex;
-                goto err_vmem_32_lookup_frame;
-            }
+        size_t n = minul(pgcount, FRAME_BATCH_SIZE);
+        n = minul(n, 1024 - pagetable_page_index(src_pgindex));
+        n = minul(n, 1024 - pagetable_page_index(dst_pgindex));
 
-            res = page_table_map_page_frame(dst_pt, src_pfindex, j, pteflags);
-            if (res < 0) {
-                goto err_page_table_map_page_frame;
+        res = map_page_range(dst_as, dst_pt, dst_pgindex,
+                             src_as, src_pt, src_pgindex, n,
+                             pteflags_of_source(src_as, src.ptindex, pteflags),
+                             &unref);
+        if (res < 0) {
+            goto err_map_page_range;
+        }
+
+        pgcount -= n;
+        src_pgindex += n;
+        dst_pgindex += n;
+    }
+
+err_map_page_range:
+err_page_table_cursor_move:
+    page_table_cursor_uninit(&src);
+    page_table_cursor_uninit(&dst);
+
+    mmu_flush_tlb();
+
+    /* release replaced page frames after the TLB flush */
+    flush_frame_batch(&unref);
+
+    return res;
+}
+
+/*
+ * Flexpages
+ */
+
+static bool
+covers_page_table(os_index_t pgindex, size_t pgcount)
+{
+    return !pagetable_page_index(pgindex) && (pgcount >= 1024);
+}
+
+static int
+borrow_page_table(struct vmem_32* dst_as, os_index_t dst_ptindex,
+                  struct vmem_32* src_as, os_index_t src_ptindex,
+                  unsigned long pdeflags, struct frame_batch* unref)
+{
+    os_index_t ptpfindex =
+        pde_get_pageframe_index(src_as->pd->entry[src_ptindex]);
+
+    if (pde_get_pageframe_index(dst_as->pd->entry[dst_ptindex]) == ptpfindex) {
+        return 0; /* already installed */
+    } else if (!page_table_is_borrowed(dst_as, dst_ptindex) &&
+               page_table_is_lent(dst_as, dst_ptindex)) {
+        return -EBUSY; /* revoke the borrowers first */
+    }
+
+    int res = pmem_ref_frames(ptpfindex, 1);
+    if (res < 0) {
+        return res;
+    }
+
+    res = rmap_add(ptpfindex, dst_as->asid, page_table_first_page(dst_ptindex));
+    if (res < 0) {
+        goto err_rmap_add;
+    }
+
+    release_page_table(dst_as, dst_ptindex, unref);
+
+    dst_as->pd->entry[dst_ptindex] = pde_create(ptpfindex, pdeflags);
+
+    return 0;
+
+err_rmap_add:
+    pmem_unref_frames(ptpfindex, 1);
+    return res;
+}
+
+static int
+move_page_table(struct vmem_32* dst_as, os_index_t dst_ptindex,
+                struct vmem_32* src_as, os_index_t src_ptindex,
+                unsigned long pdeflags, struct frame_batch* unref)
+{
+    if (!page_table_is_borrowed(dst_as, dst_ptindex) &&
+        page_table_is_lent(dst_as, dst_ptindex)) {
+        return -EBUSY; /* revoke the borrowers first */
+    }
+
+    struct page_table* pt = map_page_table(src_as, src_ptindex, false);
+    if (!pt) {
+        return -EFAULT;
+    }
+
+    /* transfer the reverse mappings of all pages */
+
+    os_index_t dst_pgindex = page_table_first_page(dst_ptindex);
+    os_index_t src_pgindex = page_table_first_page(src_ptindex);
+
+    int res;
+    size_t i = 0;
+
+    for (; i < ARRAY_NELEMS(pt->entry); ++i) {
+        os_index_t pfindex = pte_get_managed_frame(pt->entry[i]);
+        if (!pfindex) {
+            continue;
+        }
+        res = rmap_add(pfindex, dst_as->asid, dst_pgindex + i);
+        if (res < 0) {
+            goto err_rmap_add;
+        }
+        rmap_remove(pfindex, src_as->asid, src_pgindex + i);
+    }
+
+    unmap_page_table(src_as, pt);
+
+    /* The page directory entry carries the reference on the page
+     * table's page frame over to the new address space. */
+
+    os_index_t ptpfindex =
+        pde_get_pageframe_index(src_as->pd->entry[src_ptindex]);
+
+    release_page_table(dst_as, dst_ptindex, unref);
+
+    dst_as->pd->entry[dst_ptindex] = pde_create(ptpfindex, pdeflags);
+    src_as->pd->entry[src_ptindex] = pde_create(0, 0);
+
+    return 0;
+
+err_rmap_add:
+    while (i) {
+        --i;
+        os_index_t pfindex = pte_get_managed_frame(pt->entry[i]);
+        if (!pfindex) {
+            continue;
+        }
+        rmap_remove(pfindex, dst_as->asid, dst_pgindex + i);
+        rmap_add(pfindex, src_as->asid, src_pgindex + i);
+    }
+    unmap_page_table(src_as, pt);
+    return res;
+}
+
+static int
+transfer_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
+               struct vmem_32* src_as, os_index_t src_pgindex,
+               size_t pgcount, unsigned long pteflags, bool grant)
+{
+    struct frame_batch unref = {
+        .n = 0,
+        .nfreed = 0
+    };
+
+    int res = 0;
+
+    while (pgcount) {
+
+        os_index_t dst_ptindex = pagetable_index(page_address(dst_pgindex));
+        os_index_t src_ptindex = pagetable_index(page_address(src_pgindex));
+
+        size_t n;
+
+        bool whole_page_table =
+            covers_page_table(dst_pgindex, pgcount) &&
+            covers_page_table(src_pgindex, pgcount) &&
+            pde_get_pageframe_index(src_as->pd->entry[src_ptindex]);
+
+        if (whole_page_table && !grant) {
+            /* share the complete page table */
+            n = 1024;
+            res = borrow_page_table(dst_as, dst_ptindex,
+                                    src_as, src_ptindex,
+                                    pteflags_of_source(src_as, src_ptindex,
+                                                       pteflags),
+                                    &unref);
+        } else if (whole_page_table &&
+                   !page_table_is_borrowed(src_as, src_ptindex)) {
+            /* hand over the complete page table */
+            n = 1024;
+            res = move_page_table(dst_as, dst_ptindex,
+                                  src_as, src_ptindex,
+                                  pteflags_of_source(src_as, src_ptindex,
+                                                     pteflags),
+                                  &unref);
+        } else {
+            /* map individual pages up to the next page-table boundary */
+            n = minul(pgcount, 1024 - pagetable_page_index(dst_pgindex));
+            n = minul(n, 1024 - pagetable_page_index(src_pgindex));
+
+            res = vmem_32_map_pages(dst_as, dst_pgindex,
+                                    src_as, src_pgindex, n, pteflags);
+            if (!(res < 0) && grant) {
+                res = vmem_32_unmap_pages(src_as, src_pgindex, n, NULL);
             }
         }
+        if (res < 0) {
+            goto out;
+        }
 
-        unmap_page_table(dst_as, dst_pt);
+        pgcount -= n;
+        dst_pgindex += n;
+        src_pgindex += n;
     }
 
+out:
     mmu_flush_tlb();
 
+    flush_frame_batch(&unref);
+
+    return res;
+}
+
+int
+vmem_32_share_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
+                    struct vmem_32* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags)
+{
+    return transfer_pages(dst_as, dst_pgindex, src_as, src_pgindex,
+                          pgcount, pteflags, false);
+}
+
+int
+vmem_32_grant_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
+                    struct vmem_32* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags)
+{
+    return transfer_pages(dst_as, dst_pgindex, src_as, src_pgindex,
+                          pgcount, pteflags, true);
+}
+
+/*
+ * Revocation
+ */
+
+enum {
+    MAPPING_BATCH_SIZE = 16
+};
+
+struct mapping_batch {
+    struct rmap_match entry[MAPPING_BATCH_SIZE];
+    size_t            n;
+    rmap_asid_t       skip; /**< address space to leave alone */
+};
+
+static int
+collect_mapping(rmap_asid_t asid, os_index_t pgindex, void* data)
+{
+    struct mapping_batch* batch = data;
+
+    if (asid == batch->skip) {
+        return 0;
+    } else if (batch->n == ARRAY_NELEMS(batch->entry)) {
+        return 1; /* full; continue with next walk */
+    }
+
+    batch->entry[batch->n].asid = asid;
+    batch->entry[batch->n].pgindex = pgindex;
+    ++batch->n;
+
     return 0;
+}
+
+/* Other address spaces are pinned and locked one at a time, so
+ * the revoking address space must not be locked by the caller. The
+ * functions return true if they removed the reverse mapping. */
+
+static bool
+revoke_page(os_index_t pfindex, rmap_asid_t asid, os_index_t pgindex)
+{
+    struct vmem* vmem = rmap_pin_vmem(asid);
+    if (!vmem) {
+        /* stale entry */
+        rmap_remove(pfindex, asid, pgindex);
+        return true;
+    }
+
+    semaphore_enter(&vmem->sem);
+
+    struct page_table* pt = map_page_table(&vmem->vmem_32,
+                                           pagetable_index(page_address(pgindex)),
+                                           false);
+
+    if (pt && (pte_get_managed_frame(
+                    pt->entry[pagetable_page_index(pgindex)]) == pfindex)) {
+        page_table_unmap_page_frame(pt, asid, pgindex);
+    } else {
+        /* stale entry */
+        rmap_remove(pfindex, asid, pgindex);
+    }
+
+    if (pt) {
+        unmap_page_table(&vmem->vmem_32, pt);
+    }
+
+    semaphore_leave(&vmem->sem);
+    rmap_unpin_vmem(asid);
+
+    return true;
+}
+
+static bool
+revoke_page_table(os_index_t ptpfindex, rmap_asid_t asid, os_index_t pgindex)
+{
+    struct vmem* vmem = rmap_pin_vmem(asid);
+    if (!vmem) {
+        /* The address space is being torn down. It tells borrowed
+         * page tables from its own by this entry, so leave the entry
+         * for it to remove. */
+        return false;
+    }
+
+    semaphore_enter(&vmem->sem);
+
+    rmap_remove(ptpfindex, asid, pgindex);
+
+    os_index_t ptindex = pagetable_index(page_address(pgindex));
+
+    if (pde_get_pageframe_index(vmem->vmem_32.pd->entry[ptindex]) == ptpfindex) {
+        vmem->vmem_32.pd->entry[ptindex] = pde_create(0, 0);
+        pmem_unref_frames(ptpfindex, 1);
+    }
+
+    semaphore_leave(&vmem->sem);
+    rmap_unpin_vmem(asid);
+
+    return true;
+}
+
+static void
+revoke_mappings(os_index_t pfindex, rmap_asid_t skip,
+                bool (*revoke)(os_index_t, rmap_asid_t, os_index_t))
+{
+    struct mapping_batch batch = {
+        .skip = skip
+    };
+
+    bool progress;
+
+    do {
+        batch.n = 0;
+        rmap_walk(pfindex, collect_mapping, &batch);
+
+        progress = false;
+
+        for (size_t i = 0; i < batch.n; ++i) {
+            progress |= revoke(pfindex, batch.entry[i].asid,
+                               batch.entry[i].pgindex);
+        }
+    } while ((batch.n == ARRAY_NELEMS(batch.entry)) && progress);
+}
+
+/* Removes a page table of ours from all address spaces that
+ * borrowed it. */
+static void
+revoke_borrowers(struct vmem_32* vmem32, os_index_t ptindex)
+{
+    os_index_t ptpfindex = pde_get_pageframe_index(vmem32->pd->entry[ptindex]);
+    if (!ptpfindex) {
+        return;
+    }
+
+    revoke_mappings(ptpfindex, vmem32->asid, revoke_page_table);
+}
+
+/* Refs the page frames of a range of pages within a single page
+ * table. Call with the address space locked. */
+static int
+pin_frames(struct vmem_32* vmem32, os_index_t pgindex, size_t pgcount,
+           bool with_page_table, os_index_t* ptpfindex,
+           unsigned long* pfindex, size_t* nframes)
+{
+    os_index_t ptindex = pagetable_index(page_address(pgindex));
+
+    *ptpfindex = 0;
+    *nframes = 0;
+
+    if (page_table_is_borrowed(vmem32, ptindex)) {
+        return 0; /* borrowed since we checked; not ours to revoke */
+    }
+
+    struct page_table* pt = map_page_table(vmem32, ptindex, false);
+    if (!pt) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < pgcount; ++i) {
+        os_index_t pf = pte_get_managed_frame(
+                            pt->entry[pagetable_page_index(pgindex + i)]);
+        if (pf) {
+            pfindex[(*nframes)++] = pf;
+        }
+    }
+
+    unmap_page_table(vmem32, pt);
+
+    int res = pmem_ref_frame_batch(pfindex, *nframes);
+    if (res < 0) {
+        *nframes = 0;
+        return res;
+    }
+
+    if (with_page_table) {
+        os_index_t pf = pde_get_pageframe_index(vmem32->pd->entry[ptindex]);
+
+        res = pmem_ref_frames(pf, 1);
+        if (res < 0) {
+            goto err_pmem_ref_frames;
+        }
+        *ptpfindex = pf;
+    }
+
+    return 0;
+
+err_pmem_ref_frames:
+    pmem_unref_frame_batch(pfindex, *nframes);
+    *nframes = 0;
+    return res;
+}
+
+int
+vmem_32_revoke_pages(struct vmem_32* vmem32, struct semaphore* sem,
+                     os_index_t pgindex, size_t pgcount)
+{
+    unsigned long pfindex[FRAME_BATCH_SIZE];
+
+    semaphore_enter(sem);
+    bool borrowed = has_borrowed_page_table(vmem32, pgindex, pgcount);
+    semaphore_leave(sem);
+
+    if (borrowed) {
+        return -EINVAL; /* the page table's owner has to revoke */
+    }
+
+    int res = 0;
+    os_index_t last_ptindex = -1;
+
+    while (pgcount) {
+
+        os_index_t ptindex = pagetable_index(page_address(pgindex));
+
+        size_t n = minul(pgcount, 1024 - pagetable_page_index(pgindex));
+        n = minul(n, ARRAY_NELEMS(pfindex));
+
+        /* Pin the page frames, so they cannot be reused while we
+         * revoke their mappings without holding our lock. */
+
+        os_index_t ptpfindex;
+        size_t nframes;
+
+        semaphore_enter(sem);
+        res = pin_frames(vmem32, pgindex, n, ptindex != last_ptindex,
+                         &ptpfindex, pfindex, &nframes);
+        semaphore_leave(sem);
+
+        if (res < 0) {
+            break;
+        }
+
+        last_ptindex = ptindex;
+
+        if (ptpfindex) {
+            /* Other address spaces that borrowed this page table
+             * lose access to all of its pages. */
+            revoke_mappings(ptpfindex, vmem32->asid, revoke_page_table);
+            pmem_unref_frames(ptpfindex, 1);
+        }
+
+        for (size_t i = 0; i < nframes; ++i) {
+            revoke_mappings(pfindex[i], vmem32->asid, revoke_page);
+        }
+
+        pmem_unref_frame_batch(pfindex, nframes);
+
+        pgcount -= n;
+        pgindex += n;
+    }
+
+    mmu_flush_tlb();
 
-err_page_table_map_page_frame:
-err_vmem_32_lookup_frame:
-err_map_page_table:
-    /* TODO: clean up */
     return res;
 }
 
@@ -543,8 +1336,9 @@ vmem_32_map_pageframe_nopg(struct vmem_32* vmem32, os_index_t pfindex,
     }
 
     int res = page_table_map_page_frame(pt,
+                                        vmem32->asid,
                                         pfindex,
-                                        pagetable_page_index(pgindex),
+                                        pgindex,
                                         flags);
     if (res < 0) {
         goto err_page_table_map_page_frame;
@@ -585,6 +1379,9 @@ vmem_32_alloc_page_table_nopg(struct vmem_32* vmem32, os_index_t ptindex,
         goto err_page_directory_install_page_table;
     }
 
+    /* the page directory holds the reference from now on */
+    pmem_unref_frames(pfindex, pageframe_count(sizeof(struct page_table)));
+
     return 0;
 
 err_page_directory_install_page_table:
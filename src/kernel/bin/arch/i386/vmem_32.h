@@ -20,19 +20,35 @@
 #pragma once
 
 #include "page.h"
+#include "rmap.h"
 
 struct page_directory;
+struct semaphore;
 
 struct vmem_32 {
     struct page_directory* pd;
+    rmap_asid_t            asid; /**< id of the address space in the reverse map */
+
+    /* releases the page directory; returns the number of
+     * released page frames */
+    size_t (*unref_aligned)(void*, size_t, void*);
+    void* alloc_data;
 };
 
 int
-vmem_32_init(struct vmem_32* vmem32,
+vmem_32_init(struct vmem_32* vmem32, rmap_asid_t asid,
              void* (alloc_aligned)(size_t, void*),
-             void (*unref_aligned)(void*, size_t, void*), void* alloc_data);
+             size_t (*unref_aligned)(void*, size_t, void*), void* alloc_data);
 
-void
+/**
+ * \brief release all user mappings, page tables and the page directory
+ * \param[in] vmem32 the address space
+ * \return the number of page frames that have been returned to pmem
+ *
+ * Page tables that other address spaces borrowed are revoked from
+ * them first. The caller must not hold any address space's lock.
+ */
+size_t
 vmem_32_uninit(struct vmem_32* vmem32);
 
 int
@@ -51,11 +67,81 @@ int
 vmem_32_alloc_pages(struct vmem_32* vmem32, os_index_t pgindex,
                     size_t pgcount, unsigned int pteflags);
 
+/**
+ * \brief unmap pages
+ * \param[in] vmem32 the address space
+ * \param pgindex the first page
+ * \param pgcount the number of pages
+ * \param[out] nfreed the number of released page frames, or NULL
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+vmem_32_unmap_pages(struct vmem_32* vmem32, os_index_t pgindex,
+                    size_t pgcount, size_t* nfreed);
+
 int
 vmem_32_map_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
                   struct vmem_32* src_as, os_index_t src_pgindex,
                   size_t pgcount, unsigned long pteflags);
 
+/**
+ * \brief map pages of another address space
+ * \param[in] dst_as the destination address space
+ * \param dst_pgindex the first destination page
+ * \param[in] src_as the source address space
+ * \param src_pgindex the first source page
+ * \param pgcount the number of pages
+ * \param pteflags the flags of the new mappings
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * Ranges that cover complete page tables in both address spaces
+ * are shared by installing the source page table in the destination
+ * page directory.
+ */
+int
+vmem_32_share_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
+                    struct vmem_32* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags);
+
+/**
+ * \brief move pages to another address space
+ * \param[in] dst_as the destination address space
+ * \param dst_pgindex the first destination page
+ * \param[in] src_as the source address space
+ * \param src_pgindex the first source page
+ * \param pgcount the number of pages
+ * \param pteflags the flags of the new mappings
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * Like vmem_32_share_pages(), but removes the pages from the source
+ * address space. Complete page tables are moved between the page
+ * directories.
+ */
+int
+vmem_32_grant_pages(struct vmem_32* dst_as, os_index_t dst_pgindex,
+                    struct vmem_32* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags);
+
+/**
+ * \brief remove pages from all other address spaces
+ * \param[in] vmem32 the address space
+ * \param[in] sem the address space's lock, not held by the caller
+ * \param pgindex the first page
+ * \param pgcount the number of pages
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * The page frames remain mapped in vmem32. All other mappings of
+ * the page frames, and all borrowed copies of the page tables, are
+ * removed. The other address spaces are locked one at a time.
+ *
+ * Returns -EINVAL if the range contains a page table that vmem32
+ * borrowed from another address space. Only the page table's owner
+ * can revoke its pages.
+ */
+int
+vmem_32_revoke_pages(struct vmem_32* vmem32, struct semaphore* sem,
+                     os_index_t pgindex, size_t pgcount);
+
 int
 vmem_32_share_page_range(struct vmem_32* dst_vmem32,
                          struct vmem_32* src_vmem32,
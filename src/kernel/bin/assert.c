@@ -18,16 +18,18 @@
  */
 
 #include "assert.h"
-#include "console.h"
 #include "cpu.h"
 #include "interupt.h"
+#include "log.h"
 
 void
 __assert_failed(const char *cond, const char *file, unsigned long line)
 {
         cli();
 
-        console_printf("%s:%x: assertion (%s) failed\n", file, line, cond);
+        log_printf(LOG_CRIT, "%s:%lu: assertion (%s) failed\n",
+                   file, line, cond);
+        log_flush();
 
         hlt();
 }
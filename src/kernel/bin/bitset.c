@@ -16,57 +16,214 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-
 #include "bitset.h"
 #include <errno.h>
+#include <string.h>
 
-void
-bitset_set(unsigned char *bitset, unsigned long bit)
+/*
+ * Returns the mask of n bits starting at bit 'shift' of a word;
+ * shift + n must not exceed the word size.
+ */
+static bitset_word
+range_mask(unsigned long shift, size_t n)
 {
-        bitset[bit >> 3] |= 1 << (bit & 0x07);
+        bitset_word mask = ~0ul << shift;
+
+        if (shift + n < BITSET_WORD_BITS)
+        {
+                mask &= ~(~0ul << (shift + n));
+        }
+
+        return mask;
 }
 
 void
-bitset_unset(unsigned char *bitset, unsigned long bit)
+bitset_set_range(bitset_word *bitset, unsigned long bit, size_t n)
 {
-        bitset[bit >> 3] &= ~(1 << (bit & 0x07));
+        bitset_word *word = bitset + bitset_word_index(bit);
+        unsigned long shift = bit % BITSET_WORD_BITS;
+
+        while (n)
+        {
+                size_t nbits = BITSET_WORD_BITS - shift;
+
+                if (n < nbits)
+                {
+                        nbits = n;
+                }
+
+                *word++ |= range_mask(shift, nbits);
+
+                n -= nbits;
+                shift = 0;
+        }
 }
 
 void
-bitset_setto(unsigned char *bitset, unsigned long bit, int set)
+bitset_unset_range(bitset_word *bitset, unsigned long bit, size_t n)
+{
+        bitset_word *word = bitset + bitset_word_index(bit);
+        unsigned long shift = bit % BITSET_WORD_BITS;
+
+        while (n)
+        {
+                size_t nbits = BITSET_WORD_BITS - shift;
+
+                if (n < nbits)
+                {
+                        nbits = n;
+                }
+
+                *word++ &= ~range_mask(shift, nbits);
+
+                n -= nbits;
+                shift = 0;
+        }
+}
+
+/*
+ * Scans for the next bit that differs from 'skip', which is either
+ * all zeros or all ones.
+ */
+static ssize_t
+find_next(const bitset_word *bitset, size_t nbits, unsigned long bit,
+          bitset_word skip)
+{
+        size_t i, nwords;
+        bitset_word word;
+
+        if (!(bit < nbits))
+        {
+                return -ENOENT;
+        }
+
+        i = bitset_word_index(bit);
+        nwords = BITSET_NWORDS(nbits);
+
+        /* ignore bits before the cursor */
+        word = (bitset[i] ^ skip) & ~(bitset_word_mask(bit) - 1);
+
+        while (!word)
+        {
+                if (++i == nwords)
+                {
+                        return -ENOENT;
+                }
+                word = bitset[i] ^ skip;
+        }
+
+        bit = i * BITSET_WORD_BITS + bitset_word_first(word);
+
+        if (!(bit < nbits))
+        {
+                return -ENOENT;
+        }
+
+        return bit;
+}
+
+ssize_t
+bitset_find_next_set(const bitset_word *bitset, size_t nbits,
+                     unsigned long bit)
 {
-    static void (*const setto[]) (unsigned char *, unsigned long) = {
-        bitset_set,
-        bitset_unset
-    };
-    setto[!set] (bitset, bit);
+        return find_next(bitset, nbits, bit, 0);
 }
 
-int
-bitset_isset(const unsigned char *bitset, unsigned long bit)
+ssize_t
+bitset_find_next_unset(const bitset_word *bitset, size_t nbits,
+                       unsigned long bit)
 {
-        return !!(bitset[bit >> 3] & (1 << (bit & 0x07)));
+        ssize_t res = find_next(bitset, nbits, bit, ~0ul);
+
+        return res == -ENOENT ? -EAGAIN : res;
 }
 
 ssize_t
-bitset_find_unset(const unsigned char *bitset, size_t len)
+bitset_find_last_set(const bitset_word *bitset, size_t nbits)
 {
         size_t i;
-        unsigned long bit;
+        bitset_word word;
+
+        if (!nbits)
+        {
+                return -ENOENT;
+        }
+
+        i = bitset_word_index(nbits - 1);
 
-        bit = 0;
+        /* ignore bits beyond the end of the bitset */
+        word = bitset[i] & range_mask(0, (nbits - 1) % BITSET_WORD_BITS + 1);
 
-        for (i = 0; i < len; ++i)
+        while (!word)
         {
-                ssize_t j;
-                for (j = 0; j < 8; ++j, ++bit)
+                if (!i)
                 {
-                        if (!bitset_isset(bitset, bit))
-                        {
-                                return bit;
-                        }
+                        return -ENOENT;
                 }
+                word = bitset[--i];
+        }
+
+        return i * BITSET_WORD_BITS + bitset_word_last(word);
+}
+
+ssize_t
+bitset_find_unset(const bitset_word *bitset, size_t nbits)
+{
+        return bitset_find_next_unset(bitset, nbits, 0);
+}
+
+/*
+ * Summarized bitsets
+ */
+
+void
+bitset_summary_clear(struct bitset_summary *set)
+{
+        size_t nwords = BITSET_NWORDS(set->nbits);
+
+        memset(set->word, 0, nwords * sizeof(set->word[0]));
+        memset(set->summary, 0,
+               BITSET_NWORDS(nwords) * sizeof(set->summary[0]));
+}
+
+void
+bitset_summary_set(struct bitset_summary *set, unsigned long bit)
+{
+        size_t i = bitset_word_index(bit);
+
+        bitset_set(set->word, bit);
+
+        if (!~set->word[i])
+        {
+                bitset_set(set->summary, i);
+        }
+}
+
+void
+bitset_summary_unset(struct bitset_summary *set, unsigned long bit)
+{
+        bitset_unset(set->word, bit);
+        bitset_unset(set->summary, bitset_word_index(bit));
+}
+
+ssize_t
+bitset_summary_find_unset(const struct bitset_summary *set)
+{
+        ssize_t i;
+        unsigned long bit;
+
+        i = bitset_find_unset(set->summary, BITSET_NWORDS(set->nbits));
+        if (i < 0)
+        {
+                return i;
+        }
+
+        bit = i * BITSET_WORD_BITS + bitset_word_first(~set->word[i]);
+
+        if (!(bit < set->nbits))
+        {
+                return -EAGAIN;
         }
 
-        return -EAGAIN;
+        return bit;
 }
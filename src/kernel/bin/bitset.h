@@ -16,26 +16,91 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-
 #pragma once
 
 #include <sys/types.h>
 
+/*
+ * Bitsets are stored in arrays of machine words. Single-bit
+ * operations are inline; scans process a full word per step and
+ * locate bits within a word with a bit-scan instruction.
+ */
+
+typedef unsigned long bitset_word;
+
+enum {
+        BITSET_WORD_BITS = sizeof(bitset_word) * 8
+};
+
+/**
+ * \brief computes the number of words for a bitset
+ * \param nbits_ the number of bits
+ */
+#define BITSET_NWORDS(nbits_) \
+        ( ((nbits_) + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS )
+
+/**
+ * \brief computes the number of bits in a bitset array
+ * \param bitset_ the bitset array
+ */
+#define BITSET_NBITS(bitset_) \
+        ( sizeof(bitset_) * 8 )
+
+static __inline__ size_t
+bitset_word_index(unsigned long bit)
+{
+        return bit / BITSET_WORD_BITS;
+}
+
+static __inline__ bitset_word
+bitset_word_mask(unsigned long bit)
+{
+        return 1ul << (bit % BITSET_WORD_BITS);
+}
+
+/**
+ * \brief returns the position of the lowest set bit in a word
+ * \param word a non-zero word
+ * \return the bit position
+ */
+static __inline__ unsigned long
+bitset_word_first(bitset_word word)
+{
+        return __builtin_ctzl(word); /* bsf */
+}
+
+/**
+ * \brief returns the position of the highest set bit in a word
+ * \param word a non-zero word
+ * \return the bit position
+ */
+static __inline__ unsigned long
+bitset_word_last(bitset_word word)
+{
+        return BITSET_WORD_BITS - 1 - __builtin_clzl(word); /* bsr */
+}
+
 /**
  * \brief set a bit in a bitset
  * \param[in,out] bitset the bitset
  * \param bit the bit to set
  */
-void
-bitset_set(unsigned char *bitset, unsigned long bit);
+static __inline__ void
+bitset_set(bitset_word *bitset, unsigned long bit)
+{
+        bitset[bitset_word_index(bit)] |= bitset_word_mask(bit);
+}
 
 /**
  * \brief clear a bit in a bitset
  * \param[in,out] bitset the bitset
- * \param bit the bit to set
+ * \param bit the bit to clear
  */
-void
-bitset_unset(unsigned char *bitset, unsigned long bit);
+static __inline__ void
+bitset_unset(bitset_word *bitset, unsigned long bit)
+{
+        bitset[bitset_word_index(bit)] &= ~bitset_word_mask(bit);
+}
 
 /**
  * \brief set a bit in a bitset to specified value
@@ -43,23 +108,159 @@ bitset_unset(unsigned char *bitset, unsigned long bit);
  * \param bit the bit to set
  * \param set zero to clear the bit, or any other value to set the bit
  */
-void
-bitset_setto(unsigned char *bitset, unsigned long bit, int set);
+static __inline__ void
+bitset_setto(bitset_word *bitset, unsigned long bit, int set)
+{
+        bitset_word mask = bitset_word_mask(bit);
+        bitset_word *word = bitset + bitset_word_index(bit);
+
+        *word = (*word & ~mask) | (-(bitset_word)!!set & mask);
+}
 
 /**
  * \brief check if a bit in a bitset is set
+ * \param[in] bitset the bitset
+ * \param bit the bit to test
+ * \return true if the bit is set, or false otherwise
+ */
+static __inline__ int
+bitset_isset(const bitset_word *bitset, unsigned long bit)
+{
+        return !!(bitset[bitset_word_index(bit)] & bitset_word_mask(bit));
+}
+
+/**
+ * \brief set a range of bits in a bitset
+ * \param[in,out] bitset the bitset
+ * \param bit the first bit to set
+ * \param n the number of bits
+ */
+void
+bitset_set_range(bitset_word *bitset, unsigned long bit, size_t n);
+
+/**
+ * \brief clear a range of bits in a bitset
  * \param[in,out] bitset the bitset
+ * \param bit the first bit to clear
+ * \param n the number of bits
+ */
+void
+bitset_unset_range(bitset_word *bitset, unsigned long bit, size_t n);
+
+/**
+ * \brief find the next set bit in a bitset
+ * \param[in] bitset the bitset
+ * \param nbits the bitset's length in bits
+ * \param bit the first bit to test
+ * \return the set bit's position, or a negative error code otherwise
+ */
+ssize_t
+bitset_find_next_set(const bitset_word *bitset, size_t nbits,
+                     unsigned long bit);
+
+/**
+ * \brief find the next unset bit in a bitset
+ * \param[in] bitset the bitset
+ * \param nbits the bitset's length in bits
+ * \param bit the first bit to test
+ * \return the unset bit's position, or a negative error code otherwise
+ */
+ssize_t
+bitset_find_next_unset(const bitset_word *bitset, size_t nbits,
+                       unsigned long bit);
+
+/**
+ * \brief find the last set bit in a bitset
+ * \param[in] bitset the bitset
+ * \param nbits the bitset's length in bits
+ * \return the set bit's position, or a negative error code otherwise
+ */
+ssize_t
+bitset_find_last_set(const bitset_word *bitset, size_t nbits);
+
+/**
+ * \brief find first unset bit in a bitset
+ * \param[in] bitset the bitset
+ * \param nbits the bitset's length in bits
+ * \return the unset bit's position, or a negative error code otherwise
+ */
+ssize_t
+bitset_find_unset(const bitset_word *bitset, size_t nbits);
+
+/*
+ * Summarized bitsets
+ *
+ * A summarized bitset keeps one summary bit per word of the
+ * bitset. The summary bit is set while all bits of its word are
+ * set, so finding an unset bit scans the summary first and then a
+ * single word of the bitset. Allocators of ids use it.
+ */
+
+struct bitset_summary
+{
+        size_t       nbits;
+        bitset_word *word;    /**< the bits */
+        bitset_word *summary; /**< one bit per full word */
+};
+
+/**
+ * \brief computes the number of summary words for a bitset
+ * \param nbits_ the number of bits
+ */
+#define BITSET_SUMMARY_NWORDS(nbits_) \
+        BITSET_NWORDS(BITSET_NWORDS(nbits_))
+
+/**
+ * \brief static initializer for summarized bitsets
+ * \param word_ the bitset array
+ * \param summary_ the summary array
+ */
+#define BITSET_SUMMARY_INITIALIZER(word_, summary_)     \
+        {                                               \
+                .nbits = BITSET_NBITS(word_),           \
+                .word = (word_),                        \
+                .summary = (summary_)                   \
+        }
+
+/**
+ * \brief clear all bits of a summarized bitset
+ * \param[out] set the summarized bitset
+ */
+void
+bitset_summary_clear(struct bitset_summary *set);
+
+/**
+ * \brief set a bit in a summarized bitset
+ * \param[in,out] set the summarized bitset
  * \param bit the bit to set
+ */
+void
+bitset_summary_set(struct bitset_summary *set, unsigned long bit);
+
+/**
+ * \brief clear a bit in a summarized bitset
+ * \param[in,out] set the summarized bitset
+ * \param bit the bit to clear
+ */
+void
+bitset_summary_unset(struct bitset_summary *set, unsigned long bit);
+
+/**
+ * \brief check if a bit in a summarized bitset is set
+ * \param[in] set the summarized bitset
+ * \param bit the bit to test
  * \return true if the bit is set, or false otherwise
  */
-int
-bitset_isset(const unsigned char *bitset, unsigned long bit);
+static __inline__ int
+bitset_summary_isset(const struct bitset_summary *set, unsigned long bit)
+{
+        return bitset_isset(set->word, bit);
+}
 
 /**
- * \brief find first unset bit in a bitset
- * \param[in,out] bitset the bitset
- * \param len the bitset's length
+ * \brief find first unset bit in a summarized bitset
+ * \param[in] set the summarized bitset
  * \return the unset bit's position, or a negative error code otherwise
  */
 ssize_t
-bitset_find_unset(const unsigned char *bitset, size_t len);
+bitset_summary_find_unset(const struct bitset_summary *set);
@@ -0,0 +1,154 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clock.h"
+#include <stddef.h>
+#include "div64.h"
+#include "interupt.h"
+
+struct clock {
+    /* odd while the clock is being updated */
+    volatile unsigned long seq;
+
+    struct clocksource* cs;
+    unsigned long long  base_cycles;
+    timestamp_t         base_ns;
+};
+
+static struct clock g_clock;
+
+static inline void
+compiler_barrier(void)
+{
+    __asm__ __volatile__("" : : : "memory");
+}
+
+void
+clocksource_init(struct clocksource* cs, const char* name,
+                 unsigned long long (*read)(struct clocksource*),
+                 unsigned long cycles, unsigned long ns)
+{
+    /* clocksource_cycles_to_ns() supports shifts of up to 32. We
+     * pick the largest shift that keeps mult within 32 bits. */
+
+    unsigned int shift = 32;
+    unsigned long long mult;
+
+    for (;; --shift) {
+        mult = div64_u32((unsigned long long)ns << shift, cycles, NULL);
+        if (!(mult >> 32) || !shift) {
+            break;
+        }
+    }
+
+    cs->name = name;
+    cs->read = read;
+    cs->mult = mult;
+    cs->shift = shift;
+}
+
+/* Call with g_clock.seq odd. */
+static timestamp_t
+fold_cycles(void)
+{
+    if (!g_clock.cs) {
+        return g_clock.base_ns;
+    }
+
+    unsigned long long cycles = g_clock.cs->read(g_clock.cs);
+
+    g_clock.base_ns += clocksource_cycles_to_ns(g_clock.cs,
+                                                cycles - g_clock.base_cycles);
+    g_clock.base_cycles = cycles;
+
+    return g_clock.base_ns;
+}
+
+static void
+begin_update(void)
+{
+    ++g_clock.seq;
+    compiler_barrier();
+}
+
+static void
+end_update(void)
+{
+    compiler_barrier();
+    ++g_clock.seq;
+}
+
+void
+clock_set_source(struct clocksource* cs)
+{
+    bool ints_on = cli_if_on();
+    begin_update();
+
+    fold_cycles();
+
+    g_clock.cs = cs;
+    g_clock.base_cycles = cs->read(cs);
+
+    end_update();
+    sti_if_on(ints_on);
+}
+
+struct clocksource*
+clock_get_source()
+{
+    return g_clock.cs;
+}
+
+timestamp_t
+clock_update()
+{
+    bool ints_on = cli_if_on();
+    begin_update();
+
+    timestamp_t now_ns = fold_cycles();
+
+    end_update();
+    sti_if_on(ints_on);
+
+    return now_ns;
+}
+
+timestamp_t
+clock_now_ns()
+{
+    unsigned long seq;
+    timestamp_t now_ns;
+
+    /* Retry if an interrupt updated the clock meanwhile. */
+
+    do {
+        seq = g_clock.seq;
+        compiler_barrier();
+
+        now_ns = g_clock.base_ns;
+        if (g_clock.cs) {
+            unsigned long long cycles = g_clock.cs->read(g_clock.cs);
+            now_ns += clocksource_cycles_to_ns(g_clock.cs,
+                                               cycles - g_clock.base_cycles);
+        }
+
+        compiler_barrier();
+    } while ((seq & 1) || (seq != g_clock.seq));
+
+    return now_ns;
+}
@@ -0,0 +1,100 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "drivers/timer/timer.h"
+
+/**
+ * A clock source is a free-running counter. Cycles are converted
+ * to nanoseconds by multiplying with mult and shifting right by
+ * shift. The shift is at most 32, so the conversion never overflows
+ * and the clock doesn't require periodic updates.
+ */
+struct clocksource {
+    const char*          name;
+    unsigned long long (*read)(struct clocksource*);
+    unsigned long        mult;
+    unsigned int         shift;
+};
+
+/**
+ * \brief init a clock source
+ * \param[out] cs the clock source
+ * \param name the clock source's name
+ * \param read the function for reading the counter
+ * \param cycles number of cycles in a measured interval
+ * \param ns length of the measured interval in ns
+ */
+void
+clocksource_init(struct clocksource* cs, const char* name,
+                 unsigned long long (*read)(struct clocksource*),
+                 unsigned long cycles, unsigned long ns);
+
+/**
+ * \brief converts clock-source cycles to nanoseconds
+ * \param[in] cs the clock source
+ * \param cycles the number of cycles
+ * \return the number of nanoseconds
+ */
+static inline timestamp_t
+clocksource_cycles_to_ns(const struct clocksource* cs,
+                         unsigned long long cycles)
+{
+    /* The product of 64-bit cycles and 32-bit mult has up to 96
+     * bits. We multiply both halves of cycles individually. The
+     * upper half's low bits are zero, so shifting it is exact. */
+
+    unsigned long long hi = (cycles >> 32) * cs->mult;
+    unsigned long long lo = (cycles & 0xffffffff) * cs->mult;
+
+    return (hi << (32 - cs->shift)) + (lo >> cs->shift);
+}
+
+/**
+ * \brief sets the system clock's source
+ * \param[in] cs the clock source
+ *
+ * The clock continues from its current time.
+ */
+void
+clock_set_source(struct clocksource* cs);
+
+/**
+ * \brief returns the system clock's source
+ * \return the current clock source, or NULL if none has been set
+ */
+struct clocksource*
+clock_get_source(void);
+
+/**
+ * \brief returns the monotonic system time
+ * \return the time since boot in nanoseconds
+ */
+timestamp_t
+clock_now_ns(void);
+
+/**
+ * \brief folds elapsed cycles into the system clock
+ * \return the monotonic system time in nanoseconds
+ *
+ * Folding is optional, as the clock cannot overflow. It's cheap
+ * to call from the timer interrupt, though.
+ */
+timestamp_t
+clock_update(void);
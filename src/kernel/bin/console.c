@@ -21,171 +21,160 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include "drivers/crt/crt.h"
+#include "interupt.h"
+#include "log.h"
 
-static struct crt_drv* g_crt;
+static struct list g_sink = LIST_HEAD_INITIALIZER(g_sink);
 
-int
-init_console(struct crt_drv* crt)
+static struct console_sink*
+console_sink_of_list(struct list* l)
 {
-    assert(crt);
+    return containerof(l, struct console_sink, list);
+}
 
-    g_crt = crt;
+void
+console_sink_init(struct console_sink* sink,
+                  void (*write)(struct console_sink*, const char*, size_t),
+                  void (*flush)(struct console_sink*))
+{
+    assert(sink);
+    assert(write);
 
-    return 0;
+    list_init_item(&sink->list);
+    sink->write = write;
+    sink->flush = flush;
 }
 
 void
-uninit_console()
+console_add_sink(struct console_sink* sink)
 {
-    g_crt = NULL;
+    assert(sink);
+
+    bool ints_on = cli_if_on();
+    list_enqueue_back(&g_sink, &sink->list);
+    sti_if_on(ints_on);
 }
 
-static size_t
-console_hextostr(unsigned long v, char *str)
+void
+console_remove_sink(struct console_sink* sink)
 {
-        static const char symbol[] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
-        };
+    assert(sink);
 
-        char *digit;
-        size_t len;
+    bool ints_on = cli_if_on();
+    list_dequeue(&sink->list);
+    sti_if_on(ints_on);
+}
 
-        digit = str;
+/*
+ * CRT sink
+ */
 
-        if (v)
-        {
-                while (v)
-                {
-                        *(digit++) = symbol[v & 0xf];
-                        v >>= 4;
-                }
-        }
-        else
-        {
-                *(digit++) = '0';
-        }
+static struct crt_drv* g_crt;
+static struct console_sink g_crt_sink;
 
-        *(digit++) = 'x';
-        *(digit++) = '0';
+static void
+crt_sink_write(struct console_sink *sink, const char *buf, size_t len)
+{
+        const char *beg;
 
-        len = digit - str;
+        for (beg = buf; len; ++buf, --len)
+        {
+                if (*buf == '\n')
+                {
+                        crt_drv_write(g_crt, beg, buf - beg);
+                        crt_drv_put_LF(g_crt);
+                        crt_drv_put_CR(g_crt);
 
-        *(digit--) = '\0';
+                        beg = buf + 1;
+                }
+                else if (*buf == '\t')
+                {
+                        crt_drv_write(g_crt, beg, buf - beg);
+                        crt_drv_set_cursor_offset(g_crt,
+                                crt_drv_get_cursor_offset(g_crt) + 8);
 
-        while (str < digit)
-        {
-                const char tmp = *str;
-                *str = *digit;
-                *digit = tmp;
-                ++str;
-                --digit;
+                        beg = buf + 1;
+                }
         }
 
-        return len;
+        crt_drv_write(g_crt, beg, buf - beg);
 }
 
-int
-console_printf(const char *str, ...)
+static void
+crt_sink_flush(struct console_sink *sink)
 {
-        const char *strbeg;
-        size_t len;
+        crt_drv_flush(g_crt);
+}
 
-        va_list args;
+int
+init_console(struct crt_drv* crt)
+{
+    assert(crt);
 
-        va_start(args, str);
+    g_crt = crt;
 
-        for (strbeg = str; *str; ++str)
-        {
+    console_sink_init(&g_crt_sink, crt_sink_write, crt_sink_flush);
+    console_add_sink(&g_crt_sink);
 
-                if (*str == '%')
-                {
+    return 0;
+}
 
-                        len = str - strbeg;
-                        ssize_t off = crt_drv_get_cursor_offset(g_crt);
-                        crt_drv_put_str(g_crt, off, strbeg, len);
-                        crt_drv_set_cursor_offset(g_crt, off + len);
-                        strbeg = ++str;
-
-                        switch (*str)
-                        {
-                                case 's':
-                                        {
-                                                const char *a;
-
-                                                a = va_arg(args, char *);
-
-                                                len = strlen(a);
-
-                                                off = crt_drv_get_cursor_offset(g_crt);
-                                                crt_drv_put_str(g_crt, off, a, len);
-                                                crt_drv_set_cursor_offset(g_crt, off + len);
-                                                strbeg = str + 1;
-                                        }
-                                        break;
-                                case 'x':
-                                        {
-                                                char astr[12];
-                                                size_t len;
-                                                unsigned long a;
-
-                                                a = va_arg(args,
-                                                           unsigned long);
-
-                                                len = console_hextostr(a,
-                                                                       astr);
-
-                                                off = crt_drv_get_cursor_offset(g_crt);
-                                                crt_drv_put_str(g_crt, off, astr, len);
-                                                crt_drv_set_cursor_offset(g_crt, off + len);
-                                                strbeg = str + 1;
-                                        }
-                                        break;
-                                case '%':
-                                        break;
-                                default:
-                                        break;
-                        }
+void
+uninit_console()
+{
+    console_remove_sink(&g_crt_sink);
 
-                }
-                else if (*str == '\n')
-                {
+    g_crt = NULL;
+}
 
-                        len = str - strbeg;
+/*
+ * Output
+ */
 
-                        ssize_t off = crt_drv_get_cursor_offset(g_crt);
-                        crt_drv_put_str(g_crt, off, strbeg, len);
-                        crt_drv_set_cursor_offset(g_crt, off + len);
-                        crt_drv_put_LF(g_crt);
-                        crt_drv_put_CR(g_crt);
+void
+console_write(const char *buf, size_t len)
+{
+        struct list *item;
 
-                        strbeg = str + 1;
+        list_foreach(item, &g_sink)
+        {
+                struct console_sink *sink = console_sink_of_list(item);
 
-                }
-                else if (*str == '\t')
-                {
+                sink->write(sink, buf, len);
+        }
+}
 
-                        len = str - strbeg;
+void
+console_flush()
+{
+        struct list *item;
 
-                        ssize_t off = crt_drv_get_cursor_offset(g_crt);
-                        crt_drv_put_str(g_crt, off, strbeg, len);
-                        crt_drv_set_cursor_offset(g_crt, off + len + 8);
+        list_foreach(item, &g_sink)
+        {
+                struct console_sink *sink = console_sink_of_list(item);
 
-                        strbeg = str + 1;
+                if (sink->flush)
+                {
+                        sink->flush(sink);
                 }
         }
+}
 
-        va_end(args);
-
-        len = str - strbeg;
+int
+console_printf(const char *str, ...)
+{
+        int res;
+        va_list args;
 
-        ssize_t off = crt_drv_get_cursor_offset(g_crt);
-        crt_drv_put_str(g_crt, off, strbeg, len);
-        crt_drv_set_cursor_offset(g_crt, off + len);
+        va_start(args, str);
+        res = log_vprintf(LOG_INFO, str, args);
+        va_end(args);
 
-        return 0;
+        return res;
 }
 
 int
@@ -196,5 +185,5 @@ console_perror(const char *s, int err)
                 return console_perror("console_perror", EINVAL);
         }
 
-        return console_printf("%s: %s\n", s, sys_errlist[err]);
+        return log_printf(LOG_ERR, "%s: %s\n", s, sys_errlist[err]);
 }
@@ -19,16 +19,71 @@
 
 #pragma once
 
+#include <sys/types.h>
+#include "list.h"
+
 struct crt_drv;
 
+/**
+ * A console sink is an output device for the console, such as
+ * the screen or a serial port. Text is written to all sinks.
+ */
+struct console_sink {
+    struct list list;
+    void      (*write)(struct console_sink*, const char*, size_t);
+    void      (*flush)(struct console_sink*); /**< optional */
+};
+
+void
+console_sink_init(struct console_sink* sink,
+                  void (*write)(struct console_sink*, const char*, size_t),
+                  void (*flush)(struct console_sink*));
+
+void
+console_add_sink(struct console_sink* sink);
+
+void
+console_remove_sink(struct console_sink* sink);
+
+/**
+ * \brief init the console with the screen as its first sink
+ * \param[in] crt the screen's CRT driver
+ * \return 0 on success, or a negative error code otherwise
+ */
 int
 init_console(struct crt_drv* crt);
 
 void
 uninit_console(void);
 
+/**
+ * \brief writes text to all console sinks
+ * \param[in] buf the text
+ * \param len the length of the text
+ *
+ * Called by the kernel log to output its records. Sinks may buffer
+ * output until console_flush().
+ */
+void
+console_write(const char *buf, size_t len);
+
+/**
+ * \brief flushes all console sinks after writing
+ */
+void
+console_flush(void);
+
+/**
+ * \brief writes a message to the kernel log
+ * \param[in] str the format string
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * The message goes into the log's ring buffer with severity
+ * LOG_INFO. It appears on the console when the log is drained.
+ */
 int
-console_printf(const char *str, ...);
+console_printf(const char *str, ...)
+        __attribute__((format(printf, 1, 2)));
 
 int
 console_perror(const char *s, int err);
@@ -30,6 +30,8 @@ struct crt_drv_funcs {
     int (*put_CR)(struct crt_drv*);
     int (*put_LF)(struct crt_drv*);
     int (*put_char)(struct crt_drv*, unsigned long, int c);
+    ssize_t (*write)(struct crt_drv*, const char*, size_t);
+    int (*flush)(struct crt_drv*);
 };
 
 struct crt_drv {
@@ -86,6 +88,34 @@ crt_drv_put_char(struct crt_drv* drv, unsigned long off, int c)
     return drv->funcs->put_char(drv, off, c);
 }
 
+/**
+ * \brief writes characters at the cursor and advances the cursor
+ * \param[in] drv the CRT driver
+ * \param[in] buf the characters
+ * \param buflen the number of characters
+ * \return the number of written characters, or a negative error code
+ *
+ * The screen scrolls when the cursor moves beyond the last line. The
+ * cursor is kept in memory; call crt_drv_flush() to update the
+ * display's cursor.
+ */
+static inline ssize_t
+crt_drv_write(struct crt_drv* drv, const char* buf, size_t buflen)
+{
+    return drv->funcs->write(drv, buf, buflen);
+}
+
+/**
+ * \brief updates the displayed cursor
+ * \param[in] drv the CRT driver
+ * \return 0 on success, or a negative error code otherwise
+ */
+static inline int
+crt_drv_flush(struct crt_drv* drv)
+{
+    return drv->funcs->flush(drv);
+}
+
 static inline ssize_t
 crt_drv_put_str(struct crt_drv* drv, unsigned long off,
                 const char* buf, size_t buflen)
@@ -19,9 +19,22 @@
 
 #include "kbd.h"
 #include <errno.h>
+#include <ipc_consts.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "cpu.h"
 #include "idt.h"
+#include "interupt.h"
 #include "ioports.h"
+#include "ipc.h"
+#include "ipcmsg.h"
 #include "irq.h"
+#include "membar.h"
+#include "sched.h"
+#include "softirq.h"
+#include "tcb.h"
+#include "timer.h"
 
 enum {
     IOPORT_CTRL = 0x64,
@@ -170,15 +183,187 @@ kbd_interfacetest(void)
     return kbd_ctrl_incmd(KBD_CTRL_CMD_KBDITFTEST) ? -EIO : 0;
 }
 
-#include "console.h"
+/* scancode buffering
+ *
+ * The ring buffer has a single producer, the interrupt handler,
+ * and a single consumer, the delivery tasklet. Each side only writes
+ * its own index, so neither has to wait for the other.
+ */
+
+enum {
+    KBD_RING_SIZE = 128, /**< must be a power of two */
+    KBD_IRQ_MAX_BYTES = 16, /**< max bytes drained per interrupt */
+    KBD_NMSGS = 4, /**< notifications in flight */
+    KBD_MSG_NBYTES = 2 * sizeof(unsigned long),
+    /** \brief delay before retrying delivery to a busy receiver */
+    KBD_RETRY_NS = uS_TO_NS(MS_TO_uS(2))
+};
+
+struct kbd_ring {
+    volatile unsigned int head; /**< written by the producer */
+    volatile unsigned int tail; /**< written by the consumer */
+    unsigned long         ndropped;
+    unsigned char         buf[KBD_RING_SIZE];
+};
+
+static bool
+ring_put(struct kbd_ring* ring, unsigned char byte)
+{
+    unsigned int head = ring->head;
+
+    if ((head - ring->tail) == KBD_RING_SIZE) {
+        ++ring->ndropped;
+        return false;
+    }
+
+    ring->buf[head & (KBD_RING_SIZE - 1)] = byte;
+    wrmembar(); /* publish byte before index */
+    ring->head = head + 1;
+
+    return true;
+}
+
+static size_t
+ring_peek(const struct kbd_ring* ring, unsigned char* buf, size_t len)
+{
+    unsigned int tail = ring->tail;
+    size_t n = ring->head - tail;
+    rdmembar(); /* read index before bytes */
+
+    if (n > len) {
+        n = len;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        buf[i] = ring->buf[(tail + i) & (KBD_RING_SIZE - 1)];
+    }
+
+    return n;
+}
+
+static void
+ring_consume(struct kbd_ring* ring, size_t n)
+{
+    rwmembar(); /* finish reading bytes before releasing them */
+    ring->tail += n;
+}
+
+static struct {
+    struct kbd_ring ring;
+    struct tasklet  tasklet;
+    struct alarm    retry;
+
+    /* \attention Only access with interupts disabled! */
+    struct tcb*     rcv;
+    struct tcb*     snd;
+    struct ipc_msg  msg[KBD_NMSGS];
+    bool            retry_armed;
+} g_kbd;
+
+static bool
+msg_is_queued(const struct ipc_msg* msg)
+{
+    return !!msg->rcv_q.next;
+}
+
+static unsigned long
+pack_scancodes(const unsigned char* buf, size_t len)
+{
+    unsigned long word = 0;
+
+    for (size_t i = len; i;) {
+        --i;
+        word = (word << 8) | buf[i];
+    }
+
+    return word;
+}
+
+static void
+deliver_scancodes(struct tasklet* tasklet)
+{
+    unsigned char buf[KBD_MSG_NBYTES];
+    bool notified = false;
+
+    bool ints_on = cli_if_on();
+
+    if (!g_kbd.rcv) {
+        /* no subscriber; discard input */
+        size_t n;
+        while ((n = ring_peek(&g_kbd.ring, buf, sizeof(buf)))) {
+            ring_consume(&g_kbd.ring, n);
+        }
+        goto out;
+    }
+
+    /* We send one message per batch of up to 8 scancodes. While all
+     * messages are queued at the receiver, scancodes stay in the ring
+     * buffer. The retry alarm delivers them, so the last key of a
+     * burst does not wait for the next interrupt. */
+
+    for (size_t i = 0; i < ARRAY_NELEMS(g_kbd.msg); ++i) {
+
+        size_t n = ring_peek(&g_kbd.ring, buf, sizeof(buf));
+        if (!n) {
+            break;
+        }
+
+        size_t n0 = n < sizeof(unsigned long) ? n : sizeof(unsigned long);
+
+        /* The message is only filled in if the receiver has
+         * copied its previous content. */
+        int res = ipc_notify(g_kbd.msg + i, g_kbd.rcv, g_kbd.snd,
+                             IPC_OPSYS_KBD_SCANCODES | (n << 8),
+                             pack_scancodes(buf, n0),
+                             pack_scancodes(buf + n0, n - n0));
+        if (res == -EALREADY) {
+            continue; /* still queued */
+        } else if (res < 0) {
+            break; /* receiver busy */
+        }
+
+        ring_consume(&g_kbd.ring, n);
+        notified = true;
+    }
+
+    if (notified) {
+        sched_set_need_resched(cpuid());
+    }
+
+    if (ring_peek(&g_kbd.ring, buf, 1) && !g_kbd.retry_armed) {
+        timer_add_alarm(&g_kbd.retry, KBD_RETRY_NS);
+        g_kbd.retry_armed = true;
+    }
+
+out:
+    sti_if_on(ints_on);
+}
+
+static timeout_t
+retry_delivery(struct alarm* alarm)
+{
+    bool ints_on = cli_if_on();
+    g_kbd.retry_armed = false;
+    sti_if_on(ints_on);
+
+    tasklet_schedule(&g_kbd.tasklet);
+
+    return 0;
+}
 
 static enum irq_status
 irq_handler_func(unsigned char irqno, struct irq_handler* irqh)
 {
-    int scancode = kbd_get_scancode();
+    /* We read all bytes that the controller has buffered, but never
+     * wait for more to arrive. */
 
-    console_printf("%s:%x: keyboard handler scancode=%x.\n",
-                   __FILE__, __LINE__, scancode);
+    for (int i = 0; i < KBD_IRQ_MAX_BYTES; ++i) {
+        if (!(kbd_ctrl_inb() & KBD_CTRL_FLAGS_OUTBUF_FULL)) {
+            break;
+        }
+        ring_put(&g_kbd.ring, io_inb(IOPORT_ENCD));
+    }
+
+    tasklet_schedule(&g_kbd.tasklet);
 
     return IRQ_HANDLED;
 }
@@ -213,6 +398,17 @@ kbd_init()
         }
     }
 
+    g_kbd.ring.head = 0;
+    g_kbd.ring.tail = 0;
+    g_kbd.ring.ndropped = 0;
+    tasklet_init(&g_kbd.tasklet, deliver_scancodes);
+    alarm_init(&g_kbd.retry, retry_delivery);
+    g_kbd.retry_armed = false;
+
+    for (size_t i = 0; i < ARRAY_NELEMS(g_kbd.msg); ++i) {
+        ipc_msg_init(g_kbd.msg + i, NULL, 0, 0, 0);
+    }
+
     irq_handler_init(&g_irq_handler, irq_handler_func);
     install_irq_handler(1, &g_irq_handler);
 
@@ -236,3 +432,46 @@ kbd_get_scancode()
 {
     return io_inb(IOPORT_ENCD);
 }
+
+int
+kbd_subscribe(struct tcb* rcv, struct tcb* snd)
+{
+    int res = 0;
+
+    bool ints_on = cli_if_on();
+
+    if (g_kbd.rcv && (g_kbd.rcv != rcv)) {
+        res = -EBUSY;
+        goto out;
+    }
+
+    g_kbd.rcv = rcv;
+    g_kbd.snd = snd;
+
+out:
+    sti_if_on(ints_on);
+
+    return res;
+}
+
+void
+kbd_unsubscribe(struct tcb* rcv)
+{
+    bool ints_on = cli_if_on();
+
+    if (g_kbd.rcv != rcv) {
+        goto out;
+    }
+
+    for (size_t i = 0; i < ARRAY_NELEMS(g_kbd.msg); ++i) {
+        if (msg_is_queued(g_kbd.msg + i)) {
+            list_dequeue(&g_kbd.msg[i].rcv_q);
+        }
+    }
+
+    g_kbd.rcv = NULL;
+    g_kbd.snd = NULL;
+
+out:
+    sti_if_on(ints_on);
+}
@@ -19,8 +19,34 @@
 
 #pragma once
 
+struct tcb;
+
+/*
+ * The keyboard interrupt handler drains the controller into a ring
+ * buffer. A tasklet batches the buffered scancodes into IPC messages
+ * for the subscribed thread.
+ */
+
 int
 kbd_init(void);
 
+/**
+ * \brief delivers scancodes to a thread
+ * \param[in] rcv the receiving thread
+ * \param[in] snd the sender of the notifications
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+kbd_subscribe(struct tcb* rcv, struct tcb* snd);
+
+/**
+ * \brief stops delivering scancodes to a thread
+ * \param[in] rcv the receiving thread
+ *
+ * Pending notifications are removed from the thread's message queue.
+ */
+void
+kbd_unsubscribe(struct tcb* rcv);
+
 int
 kbd_get_scancode(void);
@@ -40,6 +40,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include "div64.h"
 #include "interupt.h"
 #include "ioports.h"
 #include "timer.h"
@@ -63,6 +64,10 @@ enum {
     i8254_IRQNO = 0
 };
 
+enum {
+    i8254_MAX_COUNT = 0xffff
+};
+
 enum {
     i8254_DATA0 = 0x40,
     i8254_DATA1 = 0x41,
@@ -70,8 +75,21 @@ enum {
     i8254_CMD   = 0x43
 };
 
+/* read-back command and status byte */
 enum {
-    i8254_TICKS_PER_S = 1193182
+    i8254_READBACK           = 0xc0,
+    i8254_READBACK_NO_COUNT  = 0x20,
+    i8254_READBACK_NO_STATUS = 0x10,
+    i8254_STATUS_OUT         = 0x80,
+    i8254_STATUS_NULL_COUNT  = 0x40
+};
+
+/* system control port B; controls the speaker counter */
+enum {
+    i8254_CTRL       = 0x61,
+    i8254_CTRL_GATE2 = 0x01, /* enable counter 2 */
+    i8254_CTRL_SPKR  = 0x02, /* connect counter 2 to speaker */
+    i8254_CTRL_OUT2  = 0x20  /* output of counter 2 */
 };
 
 #define i8254_DATA(_counter) \
@@ -83,13 +101,25 @@ i8254_of_irq_handler(struct irq_handler* irqh)
     return containerof(irqh, struct i8254_drv, irq_handler);
 }
 
+static struct i8254_drv*
+i8254_of_timer_drv(struct timer_drv* drv)
+{
+    return containerof(drv, struct i8254_drv, drv);
+}
+
+static uint8_t
+control_word(enum i8254_counter counter, enum i8254_mode mode)
+{
+    return ((counter & 0x3) << 6) |
+             0x30 |                  /* write LSB, then MSB */
+           ((mode & 0x7) << 1);
+}
+
 void
 wreg_ticks(enum i8254_counter counter, enum i8254_mode mode, uint16_t ticks)
 {
     /* setup PIT control word */
-    uint8_t cmd = ((counter & 0x3) << 6) |
-                    0x30 |                  /* write LSB, then MSB */
-                  ((mode & 0x7) << 1);
+    uint8_t cmd = control_word(counter, mode);
 
     /* setup PIT counter */
     uint8_t lsb = (ticks & 0x00ff);
@@ -104,28 +134,129 @@ wreg_ticks(enum i8254_counter counter, enum i8254_mode mode, uint16_t ticks)
     sti_if_on(ints_on);
 }
 
+/*
+ * The timer counter runs in mode 0. It counts down once from the
+ * programmed value and raises the IRQ at terminal count. Afterwards
+ * the counter wraps around and continues counting, so we can still
+ * compute the elapsed ticks until the next shot is programmed.
+ */
+
+/* Call with interrupts disabled. */
+static unsigned long
+elapsed_ticks(const struct i8254_drv* i8254)
+{
+    if (!i8254->count) {
+        return 0; /* counter is stopped */
+    }
+
+    io_outb(i8254_CMD, i8254_READBACK | (1 << (i8254_COUNTER_TIMER + 1)));
+
+    uint8_t status = io_inb(i8254_DATA(i8254_COUNTER_TIMER));
+    uint8_t lsb = io_inb(i8254_DATA(i8254_COUNTER_TIMER));
+    uint8_t msb = io_inb(i8254_DATA(i8254_COUNTER_TIMER));
+
+    if (status & i8254_STATUS_NULL_COUNT) {
+        return 0; /* count has not been loaded yet */
+    }
+
+    uint16_t current = (msb << 8) | lsb;
+
+    if (status & i8254_STATUS_OUT) {
+        /* terminal count reached; counter wrapped around */
+        return i8254->count + (uint16_t)(0 - current);
+    }
+
+    return i8254->count - current;
+}
+
+/* Call with interrupts disabled. A count of 0 stops the counter. */
+static void
+program_count(struct i8254_drv* i8254, uint16_t count)
+{
+    /* Fold the ticks of the current shot into the clock. The ticks
+     * between reading and reprogramming the counter get lost. */
+    i8254->ticks += elapsed_ticks(i8254);
+    i8254->count = count;
+
+    if (count) {
+        wreg_ticks(i8254_COUNTER_TIMER, i8254_MODE_TERMINAL, count);
+    } else {
+        /* writing only the control word stops the counter */
+        io_outb(i8254_CMD, control_word(i8254_COUNTER_TIMER,
+                                        i8254_MODE_TERMINAL));
+    }
+}
+
 static enum irq_status
 irq_handler_func(unsigned char irqno, struct irq_handler* irqh)
 {
     struct i8254_drv* i8254 = i8254_of_irq_handler(irqh);
 
-    unsigned long freq = i8254->counter_freq[i8254_COUNTER_TIMER];
+    /* The timer softirq programs the next timeout. If we're the
+     * system clock, we keep counting until then. */
+    if (clock_get_source() == &i8254->clocksource) {
+        program_count(i8254, i8254_MAX_COUNT);
+    }
 
-    i8254->timestamp += S_TO_NS(1) / freq;
-    handle_timeout(i8254->timestamp);
+    timer_handle_irq();
 
     return IRQ_HANDLED;
 }
 
+static unsigned long long
+read_ticks(struct clocksource* cs)
+{
+    struct i8254_drv* i8254 = containerof(cs, struct i8254_drv, clocksource);
+
+    bool ints_on = cli_if_on();
+
+    unsigned long long ticks = i8254->ticks + elapsed_ticks(i8254);
+
+    sti_if_on(ints_on);
+
+    return ticks;
+}
+
 static int
 set_timeout(struct timer_drv* drv, timeout_t timeout_ns)
 {
+    /* Round up, so the alarm has expired when the IRQ arrives. */
+    unsigned long long count =
+        div64_u32((unsigned long long)timeout_ns * i8254_TICKS_PER_S +
+                  S_TO_NS(1) - 1, S_TO_NS(1), NULL);
+
+    /* Longer timeouts fire early. The timer code then programs
+     * the remaining time. */
+    if (count > i8254_MAX_COUNT) {
+        count = i8254_MAX_COUNT;
+    } else if (!count) {
+        count = 1;
+    }
+
+    bool ints_on = cli_if_on();
+    program_count(i8254_of_timer_drv(drv), count);
+    sti_if_on(ints_on);
+
     return 0;
 }
 
 static void
 clear_timeout(struct timer_drv* drv)
-{ }
+{
+    struct i8254_drv* i8254 = i8254_of_timer_drv(drv);
+
+    bool ints_on = cli_if_on();
+
+    if (clock_get_source() == &i8254->clocksource) {
+        /* The system clock counts our ticks, so we keep counting
+         * with the longest possible interval. */
+        program_count(i8254, i8254_MAX_COUNT);
+    } else {
+        program_count(i8254, 0);
+    }
+
+    sti_if_on(ints_on);
+}
 
 int
 i8254_init(struct i8254_drv* i8254)
@@ -142,9 +273,10 @@ i8254_init(struct i8254_drv* i8254)
         goto err_init_timer;
     }
 
-    for (size_t i = 0; i < ARRAY_NELEMS(i8254->counter_freq); ++i) {
-        i8254->counter_freq[i] = 0;
-    }
+    i8254->count = 0;
+    i8254->ticks = 0;
+    clocksource_init(&i8254->clocksource, "i8254", read_ticks,
+                     i8254_TICKS_PER_S, S_TO_NS(1));
 
     irq_handler_init(&i8254->irq_handler, irq_handler_func);
 
@@ -173,17 +305,38 @@ i8254_uninit(struct i8254_drv* i8254)
 }
 
 /**
- * \brief program i8254 timer channel
- * \param freq the trigger frequency
+ * \brief start i8254 timer channel
+ *
+ * The counter starts with the longest possible interval. Later
+ * timeouts are programmed as one-shot counts.
  */
 void
-i8254_install_timer(struct i8254_drv* i8254, unsigned long freq)
+i8254_install_timer(struct i8254_drv* i8254)
 {
     assert(i8254);
 
-    i8254->counter_freq[i8254_COUNTER_TIMER] = freq;
+    bool ints_on = cli_if_on();
+    program_count(i8254, i8254_MAX_COUNT);
+    sti_if_on(ints_on);
+}
 
-    /* Program number of PIT ticks between IRQs */
-    wreg_ticks(i8254_COUNTER_TIMER, i8254_MODE_RATEGEN,
-               i8254_TICKS_PER_S / freq);
+void
+i8254_busy_wait(uint16_t ticks)
+{
+    bool ints_on = cli_if_on();
+
+    /* disable speaker and stop counter */
+    uint8_t ctrl = io_inb(i8254_CTRL) & ~(i8254_CTRL_SPKR | i8254_CTRL_GATE2);
+    io_outb(i8254_CTRL, ctrl);
+
+    wreg_ticks(i8254_COUNTER_SPKR, i8254_MODE_TERMINAL, ticks);
+
+    /* start counter and wait for terminal count */
+    io_outb(i8254_CTRL, ctrl | i8254_CTRL_GATE2);
+
+    while (!(io_inb(i8254_CTRL) & i8254_CTRL_OUT2)) { }
+
+    io_outb(i8254_CTRL, ctrl);
+
+    sti_if_on(ints_on);
 }
@@ -19,16 +19,26 @@
 
 #pragma once
 
+#include <stdint.h>
+#include "clock.h"
 #include "irq.h"
 #include "drivers/timer/timer.h"
 
+enum {
+    i8254_TICKS_PER_S = 1193182 /**< input frequency of the counters */
+};
+
 struct i8254_drv {
     struct timer_drv drv;
 
-    unsigned long counter_freq[3];
-
     struct irq_handler irq_handler;
-    timestamp_t timestamp;
+
+    /* count of the current one-shot interval, or 0 if stopped */
+    uint16_t count;
+
+    /* counts input ticks of the timer counter; fallback clock source */
+    struct clocksource clocksource;
+    unsigned long long ticks; /* ticks before the current interval */
 };
 
 int
@@ -38,4 +48,14 @@ void
 i8254_uninit(struct i8254_drv* i8254);
 
 void
-i8254_install_timer(struct i8254_drv* i8254, unsigned long freq);
+i8254_install_timer(struct i8254_drv* i8254);
+
+/**
+ * \brief waits for a number of i8254 input ticks
+ * \param ticks the number of ticks
+ *
+ * This function busy-waits on the speaker counter. It's useful for
+ * calibrating other clocks before interrupts are available.
+ */
+void
+i8254_busy_wait(uint16_t ticks);
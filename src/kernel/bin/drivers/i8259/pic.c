@@ -62,6 +62,10 @@ unmask_irq(unsigned char irqno)
 static int
 enable_irq(unsigned char irqno)
 {
+    if (irqno > 15) {
+        return 0; /* local interrupt; not routed through the PIC */
+    }
+
     unmask_irq(irqno);
 
     return 0;
@@ -70,6 +74,10 @@ enable_irq(unsigned char irqno)
 static void
 disable_irq(unsigned char irqno)
 {
+    if (irqno > 15) {
+        return;
+    }
+
     mask_irq(irqno);
 }
 
@@ -96,6 +104,14 @@ pic_install()
     io_outb(PIC1_DATA, 0x01);
 }
 
+void
+pic_disable()
+{
+    /* mask all IRQs */
+    io_outb(PIC1_DATA, 0xff);
+    io_outb(PIC2_DATA, 0xff);
+}
+
 void
 pic_handle_irq(unsigned char irqno)
 {
@@ -22,6 +22,15 @@
 void
 pic_install(void);
 
+/**
+ * \brief masks all IRQs at the PIC
+ *
+ * Call this function after pic_install() when another interrupt
+ * controller takes over.
+ */
+void
+pic_disable(void);
+
 void
 pic_handle_irq(unsigned char irqno);
 
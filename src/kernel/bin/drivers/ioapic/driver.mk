@@ -0,0 +1,3 @@
+kernel_SRCS += $(addprefix $(driversdir)ioapic/, \
+        ioapic.c \
+    )
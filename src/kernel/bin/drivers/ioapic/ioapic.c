@@ -0,0 +1,183 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ioapic.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include "interupt.h"
+#include "iomem.h"
+#include "pte.h"
+
+/* The registers are accessed indirectly. Software writes the index
+ * to IOREGSEL and then accesses the register's content at IOWIN. */
+enum {
+    IOAPIC_IOREGSEL = 0x00,
+    IOAPIC_IOWIN    = 0x10,
+    IOAPIC_MMIO_LEN = 0x20
+};
+
+enum {
+    IOAPIC_REG_ID     = 0x00,
+    IOAPIC_REG_VER    = 0x01,
+    IOAPIC_REG_REDTBL = 0x10 /* two registers per pin */
+};
+
+enum {
+    IOAPIC_REDIR_ACTIVE_LOW = 1ul << 13,
+    IOAPIC_REDIR_LEVEL      = 1ul << 15,
+    IOAPIC_REDIR_MASKED     = 1ul << 16,
+    IOAPIC_REDIR_DEST_SHIFT = 56 - 32 /* in upper register */
+};
+
+static uint32_t
+rreg(volatile uint32_t* regs, unsigned long index)
+{
+    regs[IOAPIC_IOREGSEL / sizeof(*regs)] = index;
+    return regs[IOAPIC_IOWIN / sizeof(*regs)];
+}
+
+static void
+wreg(volatile uint32_t* regs, unsigned long index, uint32_t value)
+{
+    regs[IOAPIC_IOREGSEL / sizeof(*regs)] = index;
+    regs[IOAPIC_IOWIN / sizeof(*regs)] = value;
+}
+
+static volatile uint32_t*
+map_regs(uintptr_t addr)
+{
+    return map_io_range((const void*)addr, IOAPIC_MMIO_LEN,
+                        PTE_FLAG_PRESENT |
+                        PTE_FLAG_WRITEABLE |
+                        PTE_FLAG_CACHEDISABLE);
+}
+
+static void
+unmap_regs(volatile uint32_t* regs)
+{
+    unmap_io_range((const void*)regs, IOAPIC_MMIO_LEN);
+}
+
+static unsigned long
+read_npins(volatile uint32_t* regs)
+{
+    /* bits 16 to 23 contain the index of the last pin */
+    return ((rreg(regs, IOAPIC_REG_VER) >> 16) & 0xff) + 1;
+}
+
+long
+ioapic_count_pins(uintptr_t addr)
+{
+    volatile uint32_t* regs = map_regs(addr);
+    if (!regs) {
+        return -ENOMEM;
+    }
+
+    long npins = read_npins(regs);
+
+    unmap_regs(regs);
+
+    return npins;
+}
+
+int
+ioapic_init(struct ioapic_drv* ioapic, unsigned char id, uintptr_t addr,
+            unsigned long gsi_base)
+{
+    assert(ioapic);
+
+    ioapic->regs = map_regs(addr);
+    if (!ioapic->regs) {
+        return -ENOMEM;
+    }
+
+    ioapic->id = id;
+    ioapic->gsi_base = gsi_base;
+    ioapic->npins = read_npins(ioapic->regs);
+
+    for (unsigned long pin = 0; pin < ioapic->npins; ++pin) {
+        ioapic_mask_pin(ioapic, pin);
+    }
+
+    return 0;
+}
+
+void
+ioapic_uninit(struct ioapic_drv* ioapic)
+{
+    assert(ioapic);
+
+    unmap_regs(ioapic->regs);
+}
+
+void
+ioapic_route_pin(struct ioapic_drv* ioapic, unsigned long pin,
+                 unsigned char vector, bool active_low, bool level,
+                 unsigned char dest)
+{
+    assert(ioapic);
+    assert(pin < ioapic->npins);
+
+    uint32_t lo = vector | IOAPIC_REDIR_MASKED;
+
+    if (active_low) {
+        lo |= IOAPIC_REDIR_ACTIVE_LOW;
+    }
+    if (level) {
+        lo |= IOAPIC_REDIR_LEVEL;
+    }
+
+    uint32_t hi = (uint32_t)dest << IOAPIC_REDIR_DEST_SHIFT;
+
+    bool ints_on = cli_if_on();
+
+    /* keep the pin masked while the entry is inconsistent */
+    wreg(ioapic->regs, IOAPIC_REG_REDTBL + 2 * pin, lo);
+    wreg(ioapic->regs, IOAPIC_REG_REDTBL + 2 * pin + 1, hi);
+
+    sti_if_on(ints_on);
+}
+
+void
+ioapic_mask_pin(struct ioapic_drv* ioapic, unsigned long pin)
+{
+    assert(ioapic);
+    assert(pin < ioapic->npins);
+
+    bool ints_on = cli_if_on();
+
+    unsigned long index = IOAPIC_REG_REDTBL + 2 * pin;
+    wreg(ioapic->regs, index, rreg(ioapic->regs, index) | IOAPIC_REDIR_MASKED);
+
+    sti_if_on(ints_on);
+}
+
+void
+ioapic_unmask_pin(struct ioapic_drv* ioapic, unsigned long pin)
+{
+    assert(ioapic);
+    assert(pin < ioapic->npins);
+
+    bool ints_on = cli_if_on();
+
+    unsigned long index = IOAPIC_REG_REDTBL + 2 * pin;
+    wreg(ioapic->regs, index, rreg(ioapic->regs, index) & ~IOAPIC_REDIR_MASKED);
+
+    sti_if_on(ints_on);
+}
@@ -0,0 +1,95 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * An I/O APIC routes external interrupts to the local APICs. Each
+ * input pin has a redirection entry with the interrupt vector, the
+ * destination CPU, polarity, trigger mode and mask bit.
+ */
+struct ioapic_drv {
+    volatile uint32_t* regs; /* mapped registers */
+
+    unsigned char id;
+    unsigned long gsi_base; /* global system interrupt of pin 0 */
+    unsigned long npins;
+};
+
+/**
+ * \brief counts the input pins of an I/O APIC
+ * \param addr the physical address of the I/O APIC's registers
+ * \return the number of pins, or a negative error code otherwise
+ */
+long
+ioapic_count_pins(uintptr_t addr);
+
+/**
+ * \brief init an I/O APIC
+ * \param[out] ioapic the I/O-APIC driver
+ * \param id the I/O APIC's id
+ * \param addr the physical address of the I/O APIC's registers
+ * \param gsi_base the global system interrupt of the first pin
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * All pins are masked initially.
+ */
+int
+ioapic_init(struct ioapic_drv* ioapic, unsigned char id, uintptr_t addr,
+            unsigned long gsi_base);
+
+void
+ioapic_uninit(struct ioapic_drv* ioapic);
+
+/**
+ * \brief tests if a global system interrupt belongs to an I/O APIC
+ * \param[in] ioapic the I/O-APIC driver
+ * \param gsi the global system interrupt
+ * \return true if the I/O APIC handles the interrupt, or false otherwise
+ */
+static inline bool
+ioapic_has_gsi(const struct ioapic_drv* ioapic, unsigned long gsi)
+{
+    return (gsi >= ioapic->gsi_base) &&
+           (gsi - ioapic->gsi_base < ioapic->npins);
+}
+
+/**
+ * \brief programs a pin's redirection entry
+ * \param[in] ioapic the I/O-APIC driver
+ * \param pin the input pin
+ * \param vector the interrupt vector
+ * \param active_low true for low-active interrupt lines
+ * \param level true for level-triggered interrupt lines
+ * \param dest the destination's local-APIC id
+ *
+ * The pin remains masked.
+ */
+void
+ioapic_route_pin(struct ioapic_drv* ioapic, unsigned long pin,
+                 unsigned char vector, bool active_low, bool level,
+                 unsigned char dest);
+
+void
+ioapic_mask_pin(struct ioapic_drv* ioapic, unsigned long pin);
+
+void
+ioapic_unmask_pin(struct ioapic_drv* ioapic, unsigned long pin);
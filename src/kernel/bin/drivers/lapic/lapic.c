@@ -0,0 +1,288 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lapic.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "div64.h"
+#include "drivers/i8254/i8254.h"
+#include "idt.h"
+#include "interupt.h"
+#include "iomem.h"
+#include "page.h"
+#include "pte.h"
+#include "timer.h"
+
+/* model-specific registers */
+enum {
+    MSR_APIC_BASE        = 0x1b,
+    MSR_APIC_BASE_ENABLE = 1 << 11,
+    MSR_APIC_BASE_MASK   = 0xfffff000,
+    MSR_TSC_DEADLINE     = 0x6e0
+};
+
+/* byte offsets of the memory-mapped registers */
+enum {
+    LAPIC_ID            = 0x020,
+    LAPIC_EOI           = 0x0b0,
+    LAPIC_SVR           = 0x0f0,
+    LAPIC_LVT_TIMER     = 0x320,
+    LAPIC_TIMER_INITIAL = 0x380,
+    LAPIC_TIMER_CURRENT = 0x390,
+    LAPIC_TIMER_DIVIDE  = 0x3e0
+};
+
+enum {
+    LAPIC_SVR_ENABLE           = 1 << 8,
+    LAPIC_SPURIOUS_VECTOR      = 0xff,
+    LAPIC_LVT_MASKED           = 1 << 16,
+    LAPIC_LVT_TIMER_ONESHOT    = 0 << 17,
+    LAPIC_LVT_TIMER_DEADLINE   = 2 << 17,
+    LAPIC_TIMER_DIVIDE_BY_16   = 0x03
+};
+
+enum {
+    /* calibrate over 50 ms; must fit into the 16-bit counter */
+    LAPIC_CALIBRATION_TICKS = i8254_TICKS_PER_S / 20
+};
+
+static struct lapic_drv*
+lapic_of_timer_drv(struct timer_drv* drv)
+{
+    return containerof(drv, struct lapic_drv, drv);
+}
+
+static uint32_t
+rreg(const struct lapic_drv* lapic, unsigned long reg)
+{
+    return lapic->regs[reg / sizeof(lapic->regs[0])];
+}
+
+static void
+wreg(struct lapic_drv* lapic, unsigned long reg, uint32_t value)
+{
+    lapic->regs[reg / sizeof(lapic->regs[0])] = value;
+}
+
+/* Rounds up, so the alarm has expired when the IRQ arrives. */
+static unsigned long long
+ns_to_cycles(const struct lapic_drv* lapic, timeout_t timeout_ns)
+{
+    return div64_u32((unsigned long long)timeout_ns * lapic->khz +
+                     uS_TO_NS(MS_TO_uS(1)) - 1,
+                     uS_TO_NS(MS_TO_uS(1)), NULL);
+}
+
+static unsigned long
+cycles_to_khz(unsigned long long cycles)
+{
+    return div64_u32(cycles * i8254_TICKS_PER_S,
+                     LAPIC_CALIBRATION_TICKS * S_TO_MS(1), NULL);
+}
+
+static enum irq_status
+irq_handler_func(unsigned char irqno, struct irq_handler* irqh)
+{
+    timer_handle_irq();
+
+    return IRQ_HANDLED;
+}
+
+static int
+set_timeout(struct timer_drv* drv, timeout_t timeout_ns)
+{
+    struct lapic_drv* lapic = lapic_of_timer_drv(drv);
+
+    unsigned long long cycles = ns_to_cycles(lapic, timeout_ns);
+    if (!cycles) {
+        cycles = 1;
+    }
+
+    if (lapic->tsc_deadline) {
+        wrmsr(MSR_TSC_DEADLINE, rdtsc() + cycles);
+    } else {
+        if (cycles > 0xffffffff) {
+            cycles = 0xffffffff; /* fires early; timer code re-arms */
+        }
+        wreg(lapic, LAPIC_TIMER_INITIAL, cycles);
+    }
+
+    return 0;
+}
+
+static void
+clear_timeout(struct timer_drv* drv)
+{
+    struct lapic_drv* lapic = lapic_of_timer_drv(drv);
+
+    if (lapic->tsc_deadline) {
+        wrmsr(MSR_TSC_DEADLINE, 0);
+    } else {
+        wreg(lapic, LAPIC_TIMER_INITIAL, 0);
+    }
+}
+
+static void
+calibrate_timer(struct lapic_drv* lapic)
+{
+    wreg(lapic, LAPIC_LVT_TIMER, LAPIC_LVT_MASKED |
+                                 LAPIC_LVT_TIMER_ONESHOT);
+    wreg(lapic, LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+
+    bool ints_on = cli_if_on();
+
+    wreg(lapic, LAPIC_TIMER_INITIAL, 0xffffffff);
+    unsigned long long tsc0 = rdtsc();
+
+    i8254_busy_wait(LAPIC_CALIBRATION_TICKS);
+
+    uint32_t current = rreg(lapic, LAPIC_TIMER_CURRENT);
+    unsigned long long tsc1 = rdtsc();
+
+    wreg(lapic, LAPIC_TIMER_INITIAL, 0);
+
+    sti_if_on(ints_on);
+
+    if (lapic->tsc_deadline) {
+        lapic->khz = cycles_to_khz(tsc1 - tsc0);
+    } else {
+        lapic->khz = cycles_to_khz(0xffffffff - current);
+    }
+}
+
+int
+lapic_init(struct lapic_drv* lapic)
+{
+    assert(lapic);
+
+    if (!has_cpuid()) {
+        return -ENODEV;
+    }
+
+    unsigned long regs[4];
+    cpuid_leaf(1, regs);
+
+    if (!(regs[3] & CPUID_1_EDX_APIC) || !(regs[3] & CPUID_1_EDX_MSR)) {
+        return -ENODEV;
+    }
+
+    lapic->tsc_deadline = (regs[3] & CPUID_1_EDX_TSC) &&
+                          (regs[2] & CPUID_1_ECX_TSC_DEADLINE);
+
+    unsigned long long base = rdmsr(MSR_APIC_BASE);
+    if (!(base & MSR_APIC_BASE_ENABLE)) {
+        return -ENODEV; /* disabled by firmware */
+    }
+
+    lapic->regs = map_io_range((const void*)(uintptr_t)(base &
+                                                        MSR_APIC_BASE_MASK),
+                               PAGE_SIZE,
+                               PTE_FLAG_PRESENT |
+                               PTE_FLAG_WRITEABLE |
+                               PTE_FLAG_CACHEDISABLE);
+    if (!lapic->regs) {
+        return -ENOMEM;
+    }
+
+    /* software-enable the APIC */
+    wreg(lapic, LAPIC_SVR, rreg(lapic, LAPIC_SVR) |
+                           LAPIC_SVR_ENABLE |
+                           LAPIC_SPURIOUS_VECTOR);
+
+    return 0;
+}
+
+void
+lapic_uninit(struct lapic_drv* lapic)
+{
+    assert(lapic);
+
+    unmap_io_range((const void*)lapic->regs, PAGE_SIZE);
+}
+
+unsigned char
+lapic_id(const struct lapic_drv* lapic)
+{
+    return rreg(lapic, LAPIC_ID) >> 24;
+}
+
+int
+lapic_install_timer(struct lapic_drv* lapic)
+{
+    assert(lapic);
+
+    int res = timer_drv_init(&lapic->drv, set_timeout, clear_timeout);
+    if (res < 0) {
+        return res;
+    }
+
+    calibrate_timer(lapic);
+    if (!lapic->khz) {
+        res = -ERANGE;
+        goto err_calibrate_timer;
+    }
+
+    irq_handler_init(&lapic->irq_handler, irq_handler_func);
+
+    res = install_irq_handler(LAPIC_TIMER_IRQNO, &lapic->irq_handler);
+    if (res < 0) {
+        goto err_install_irq_handler;
+    }
+
+    /* The TSC-deadline MSR only works after the mode has been set. */
+    wreg(lapic, LAPIC_LVT_TIMER,
+         (IDT_IRQ_OFFSET + LAPIC_TIMER_IRQNO) |
+         (lapic->tsc_deadline ? LAPIC_LVT_TIMER_DEADLINE
+                              : LAPIC_LVT_TIMER_ONESHOT));
+
+    res = init_timer(&lapic->drv);
+    if (res < 0) {
+        goto err_init_timer;
+    }
+
+    return 0;
+
+err_init_timer:
+    wreg(lapic, LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    remove_irq_handler(LAPIC_TIMER_IRQNO, &lapic->irq_handler);
+err_install_irq_handler:
+err_calibrate_timer:
+    timer_drv_uninit(&lapic->drv);
+    return res;
+}
+
+void
+lapic_uninstall_timer(struct lapic_drv* lapic)
+{
+    assert(lapic);
+
+    clear_timeout(&lapic->drv);
+    wreg(lapic, LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    uninit_timer();
+    remove_irq_handler(LAPIC_TIMER_IRQNO, &lapic->irq_handler);
+    timer_drv_uninit(&lapic->drv);
+}
+
+void
+lapic_eoi(struct lapic_drv* lapic)
+{
+    wreg(lapic, LAPIC_EOI, 0);
+}
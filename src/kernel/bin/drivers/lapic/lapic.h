@@ -0,0 +1,88 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "irq.h"
+#include "drivers/timer/timer.h"
+
+enum {
+    /** \brief IRQ number of the local APIC timer */
+    LAPIC_TIMER_IRQNO = 16
+};
+
+/**
+ * The local APIC's timer either runs in TSC-deadline mode, where
+ * we program an absolute TSC value, or in one-shot mode, where we
+ * program a count of the timer's input clock. Both only require a
+ * single MSR or MMIO write.
+ */
+struct lapic_drv {
+    struct timer_drv drv;
+
+    struct irq_handler irq_handler;
+
+    volatile uint32_t* regs; /* mapped registers */
+
+    bool tsc_deadline;
+    unsigned long khz; /* frequency of TSC or timer counter */
+};
+
+/**
+ * \brief init the local APIC
+ * \param[out] lapic the local-APIC driver
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+lapic_init(struct lapic_drv* lapic);
+
+void
+lapic_uninit(struct lapic_drv* lapic);
+
+/**
+ * \brief returns the local APIC's id
+ * \param[in] lapic the local-APIC driver
+ * \return the APIC id of the current CPU
+ */
+unsigned char
+lapic_id(const struct lapic_drv* lapic);
+
+/**
+ * \brief starts the local APIC's timer
+ * \param[in] lapic the local-APIC driver
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * The timer's frequency is calibrated against the i8254. On success,
+ * the driver becomes the system timer.
+ */
+int
+lapic_install_timer(struct lapic_drv* lapic);
+
+void
+lapic_uninstall_timer(struct lapic_drv* lapic);
+
+/**
+ * \brief signals end of interrupt to the local APIC
+ * \param[in] lapic the local-APIC driver
+ *
+ * This is a single store to the EOI register.
+ */
+void
+lapic_eoi(struct lapic_drv* lapic);
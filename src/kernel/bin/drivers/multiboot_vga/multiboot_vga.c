@@ -32,10 +32,114 @@ multiboot_vga_drv_of_crt_drv(struct crt_drv* drv)
     return containerof(drv, struct multiboot_vga_drv, drv);
 }
 
+enum {
+    /** \brief size of the text buffer in cells */
+    VGA_TEXT_NCELLS = (32 * 1024) / 2,
+    /** \brief attribute of written characters; light gray on black */
+    VGA_TEXT_ATTR = 0x07
+};
+
+enum {
+    CRTC_INDEX = 0x03d4,
+    CRTC_DATA = 0x03d5
+};
+
+enum crtc_reg {
+    CRTC_START_ADDR_HI = 0x0c,
+    CRTC_START_ADDR_LO = 0x0d,
+    CRTC_CURSOR_LOC_HI = 0x0e,
+    CRTC_CURSOR_LOC_LO = 0x0f
+};
+
+static void
+write_crtc_addr(enum crtc_reg hi, unsigned long addr)
+{
+    io_outb_index(CRTC_INDEX, hi, CRTC_DATA, (addr >> 8) & 0xff);
+    io_outb_index(CRTC_INDEX, hi + 1, CRTC_DATA, addr & 0xff);
+}
+
+static unsigned long
+read_crtc_addr(enum crtc_reg hi)
+{
+    uint8_t addr_hi = io_inb_index(CRTC_INDEX, hi, CRTC_DATA);
+    uint8_t addr_lo = io_inb_index(CRTC_INDEX, hi + 1, CRTC_DATA);
+
+    return (addr_hi << 8) | addr_lo;
+}
+
+static unsigned long
+screen_ncells(const struct multiboot_vga_drv* mb_vga)
+{
+    return mb_vga->fb_w * mb_vga->fb_h;
+}
+
+static uint16_t*
+get_cell(const struct multiboot_vga_drv* mb_vga, unsigned long cell)
+{
+    return ((uint16_t*)mb_vga->vmem) + cell;
+}
+
 static void*
 get_addr(const struct multiboot_vga_drv* mb_vga, unsigned long off)
 {
-    return mb_vga->vmem + 2 * off;
+    return get_cell(mb_vga, mb_vga->start + off);
+}
+
+static void
+clear_cells(struct multiboot_vga_drv* mb_vga, unsigned long cell,
+            unsigned long ncells)
+{
+    uint16_t* vmem = get_cell(mb_vga, cell);
+
+    for (; ncells; --ncells, ++vmem) {
+        *vmem = (VGA_TEXT_ATTR << 8) | ' ';
+    }
+}
+
+/* Scrolls by moving the screen's start address through the text
+ * buffer. Only when the screen reaches the buffer's end do we copy
+ * the visible lines back to the beginning. */
+static void
+scroll(struct multiboot_vga_drv* mb_vga, unsigned long nlines)
+{
+    unsigned long ncells = screen_ncells(mb_vga);
+
+    unsigned long nkeep = 0;
+    if (nlines < mb_vga->fb_h) {
+        nkeep = (mb_vga->fb_h - nlines) * mb_vga->fb_w;
+    }
+
+    unsigned long start = mb_vga->start + (ncells - nkeep);
+
+    if ((start + ncells) > VGA_TEXT_NCELLS) {
+        const uint16_t* src = get_cell(mb_vga, start);
+        uint16_t* dst = get_cell(mb_vga, 0);
+        for (unsigned long i = 0; i < nkeep; ++i) {
+            dst[i] = src[i];
+        }
+        start = 0;
+    }
+
+    clear_cells(mb_vga, start + nkeep, ncells - nkeep);
+
+    mb_vga->start = start;
+    write_crtc_addr(CRTC_START_ADDR_HI, start);
+}
+
+/* Moves the cursor to an offset, scrolling if the offset is beyond
+ * the screen's last line. */
+static void
+move_cursor(struct multiboot_vga_drv* mb_vga, unsigned long off)
+{
+    unsigned long ncells = screen_ncells(mb_vga);
+
+    if (off >= ncells) {
+        unsigned long nlines = (off - ncells) / mb_vga->fb_w + 1;
+        scroll(mb_vga, nlines);
+        off -= nlines * mb_vga->fb_w;
+    }
+
+    mb_vga->cursor = off;
 }
 
 static int
@@ -62,15 +166,9 @@ get_fb_offset(struct crt_drv* drv,
 static int
 set_cursor_offset(struct crt_drv* drv, unsigned long off)
 {
-    const struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
+    struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
 
-    off %= mb_vga->fb_w * mb_vga->fb_h;
-
-    uint8_t cr0e = (off >> 8) & 0xff;
-    uint8_t cr0f = off & 0xff;
-
-    io_outb_index(0x03d4, 0x0e, 0x03d5, cr0e);
-    io_outb_index(0x03d4, 0x0f, 0x03d5, cr0f);
+    move_cursor(mb_vga, off);
 
     return 0;
 }
@@ -78,36 +176,29 @@ set_cursor_offset(struct crt_drv* drv, unsigned long off)
 static ssize_t
 get_cursor_offset(struct crt_drv* drv)
 {
-    uint8_t cr0e = io_inb_index(0x3d4, 0x0e, 0x03d5);
-    uint8_t cr0f = io_inb_index(0x3d4, 0x0f, 0x03d5);
-
-    uint16_t offset = (cr0e << 8) | cr0f;
+    const struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
 
-    return offset;
+    return mb_vga->cursor;
 }
 
 static int
 put_LF(struct crt_drv* drv)
 {
-    const struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
+    struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
 
-    ssize_t res = get_cursor_offset(drv);
-    if (res < 0) {
-        return res;
-    }
-    return set_cursor_offset(drv, res + mb_vga->fb_w);
+    move_cursor(mb_vga, mb_vga->cursor + mb_vga->fb_w);
+
+    return 0;
 }
 
 static int
 put_CR(struct crt_drv* drv)
 {
-    const struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
+    struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
 
-    ssize_t res = get_cursor_offset(drv);
-    if (res < 0) {
-        return res;
-    }
-    return set_cursor_offset(drv, res - (res % mb_vga->fb_w));
+    mb_vga->cursor -= mb_vga->cursor % mb_vga->fb_w;
+
+    return 0;
 }
 
 static int
@@ -115,7 +206,7 @@ put_char(struct crt_drv* drv, unsigned long off, int c)
 {
     const struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
 
-    off %= mb_vga->fb_w * mb_vga->fb_h;
+    off %= screen_ncells(mb_vga);
 
     unsigned char* vmem = get_addr(mb_vga, off);
 
@@ -124,11 +215,62 @@ put_char(struct crt_drv* drv, unsigned long off, int c)
     }
 
     vmem[0] = c;
-    vmem[1] = 0x07;
+    vmem[1] = VGA_TEXT_ATTR;
 
     return 1;
 }
 
+static ssize_t
+write(struct crt_drv* drv, const char* buf, size_t buflen)
+{
+    struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
+
+    unsigned long ncells = screen_ncells(mb_vga);
+    ssize_t len = 0;
+
+    while (buflen) {
+
+        if (mb_vga->cursor == ncells) {
+            move_cursor(mb_vga, mb_vga->cursor);
+        }
+
+        /* write the run up to the end of the screen */
+
+        size_t n = ncells - mb_vga->cursor;
+        if (n > buflen) {
+            n = buflen;
+        }
+
+        uint16_t* vmem = get_addr(mb_vga, mb_vga->cursor);
+
+        for (size_t i = 0; i < n; ++i) {
+            vmem[i] = (VGA_TEXT_ATTR << 8) | (unsigned char)buf[i];
+        }
+
+        mb_vga->cursor += n;
+        buf += n;
+        buflen -= n;
+        len += n;
+    }
+
+    return len;
+}
+
+static int
+flush(struct crt_drv* drv)
+{
+    struct multiboot_vga_drv* mb_vga = multiboot_vga_drv_of_crt_drv(drv);
+
+    unsigned long cell = mb_vga->start + mb_vga->cursor;
+
+    if (cell != mb_vga->hw_cursor) {
+        write_crtc_addr(CRTC_CURSOR_LOC_HI, cell);
+        mb_vga->hw_cursor = cell;
+    }
+
+    return 0;
+}
+
 int
 multiboot_vga_early_init(struct multiboot_vga_drv* mb_vga,
                          unsigned short fb_w,
@@ -142,6 +284,8 @@ multiboot_vga_early_init(struct multiboot_vga_drv* mb_vga,
         put_CR,
         put_LF,
         put_char,
+        write,
+        flush
     };
 
     assert(mb_vga);
@@ -155,6 +299,20 @@ multiboot_vga_early_init(struct multiboot_vga_drv* mb_vga,
     mb_vga->fb_h = fb_h;
     mb_vga->vmem = (unsigned char*)0xb8000;
 
+    /* continue after the boot loader's output */
+    mb_vga->start = read_crtc_addr(CRTC_START_ADDR_HI);
+    mb_vga->hw_cursor = read_crtc_addr(CRTC_CURSOR_LOC_HI);
+
+    if ((mb_vga->start + screen_ncells(mb_vga)) > VGA_TEXT_NCELLS) {
+        mb_vga->start = 0;
+    }
+    if ((mb_vga->hw_cursor < mb_vga->start) ||
+        (mb_vga->hw_cursor >= (mb_vga->start + screen_ncells(mb_vga)))) {
+        mb_vga->cursor = 0;
+    } else {
+        mb_vga->cursor = mb_vga->hw_cursor - mb_vga->start;
+    }
+
     return 0;
 }
 
@@ -27,6 +27,13 @@ struct multiboot_vga_drv {
     unsigned short fb_w;
     unsigned short fb_h;
     unsigned char* vmem;
+
+    /* The screen is a window into the text buffer. Scrolling moves
+     * the window's start address. Offsets are relative to the start
+     * address. */
+    unsigned long  start;  /**< first cell on screen */
+    unsigned long  cursor; /**< cursor offset, kept in memory */
+    unsigned long  hw_cursor; /**< cursor cell last written to the CRTC */
 };
 
 int
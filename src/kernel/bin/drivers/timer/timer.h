@@ -22,7 +22,7 @@
 typedef unsigned long timeout_t;
 
 /* relative timestamp in nanoseconds */
-typedef unsigned long timestamp_t;
+typedef unsigned long long timestamp_t;
 
 struct timer_drv {
     int (*set_timeout)(struct timer_drv*, timeout_t);
@@ -0,0 +1,4 @@
+
+kernel_SRCS += $(addprefix $(driversdir)uart16550/, \
+        uart16550.c \
+    )
@@ -0,0 +1,395 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uart16550.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include "interupt.h"
+#include "ioports.h"
+#include "membar.h"
+
+enum uart16550_reg {
+    REG_RBR = 0, /**< receive buffer, read */
+    REG_THR = 0, /**< transmit holding, write */
+    REG_DLL = 0, /**< divisor latch low, with DLAB set */
+    REG_IER = 1,
+    REG_DLM = 1, /**< divisor latch high, with DLAB set */
+    REG_IIR = 2, /**< interrupt identification, read */
+    REG_FCR = 2, /**< FIFO control, write */
+    REG_LCR = 3,
+    REG_MCR = 4,
+    REG_LSR = 5,
+    REG_MSR = 6,
+    REG_SCR = 7
+};
+
+enum {
+    IER_ERBFI = 1 << 0, /**< receive data available */
+    IER_ETBEI = 1 << 1  /**< transmit holding register empty */
+};
+
+enum {
+    IIR_NO_INT = 1 << 0,
+    IIR_ID_MASK = 0x0e,
+    IIR_ID_MSR = 0x00,
+    IIR_ID_THRE = 0x02,
+    IIR_ID_RDA = 0x04,
+    IIR_ID_LSR = 0x06,
+    IIR_ID_TIMEOUT = 0x0c,
+    IIR_FIFO_MASK = 0xc0
+};
+
+enum {
+    FCR_ENABLE = 1 << 0,
+    FCR_CLEAR_RX = 1 << 1,
+    FCR_CLEAR_TX = 1 << 2,
+    FCR_TRIGGER_14 = 0xc0
+};
+
+enum {
+    LCR_8N1 = 0x03,
+    LCR_DLAB = 1 << 7
+};
+
+enum {
+    MCR_DTR = 1 << 0,
+    MCR_RTS = 1 << 1,
+    MCR_OUT2 = 1 << 3, /**< gates the interrupt line on PCs */
+    MCR_LOOP = 1 << 4
+};
+
+enum {
+    LSR_DR = 1 << 0,  /**< data ready */
+    LSR_THRE = 1 << 5 /**< transmit holding register empty */
+};
+
+enum {
+    UART16550_CLOCK_HZ = 115200, /**< input clock divided by 16 */
+    UART16550_BAUD = 115200,
+    UART16550_FIFO_SIZE = 16,
+    /** \brief max interrupt causes handled per interrupt */
+    UART16550_IRQ_MAX_LOOPS = 16,
+    /** \brief max status reads while waiting for the loopback byte */
+    UART16550_PROBE_LOOPS = 10000
+};
+
+static unsigned char
+read_reg(const struct uart16550_drv* uart, enum uart16550_reg reg)
+{
+    return io_inb(uart->port + reg);
+}
+
+static void
+write_reg(const struct uart16550_drv* uart, enum uart16550_reg reg,
+          unsigned char value)
+{
+    io_outb(uart->port + reg, value);
+}
+
+static struct uart16550_drv*
+uart16550_drv_of_sink(struct console_sink* sink)
+{
+    return containerof(sink, struct uart16550_drv, sink);
+}
+
+static struct uart16550_drv*
+uart16550_drv_of_irq_handler(struct irq_handler* irqh)
+{
+    return containerof(irqh, struct uart16550_drv, irq_handler);
+}
+
+/*
+ * Transmit buffer
+ */
+
+static bool
+txbuf_is_empty(const struct uart16550_drv* uart)
+{
+    return uart->txhead == uart->txtail;
+}
+
+static bool
+txbuf_put(struct uart16550_drv* uart, unsigned char byte)
+{
+    unsigned long head = uart->txhead;
+
+    if ((head - uart->txtail) == UART16550_TXBUF_SIZE) {
+        return false;
+    }
+
+    uart->txbuf[head & (UART16550_TXBUF_SIZE - 1)] = byte;
+    wrmembar(); /* publish byte before index */
+    uart->txhead = head + 1;
+
+    return true;
+}
+
+/* Sends up to one FIFO of buffered bytes if the transmitter is
+ * empty. Call with interrupts disabled. */
+static void
+transmit_burst(struct uart16550_drv* uart)
+{
+    if (!(read_reg(uart, REG_LSR) & LSR_THRE)) {
+        return;
+    }
+
+    unsigned long tail = uart->txtail;
+    unsigned long n = uart->txhead - tail;
+    rdmembar(); /* read index before bytes */
+
+    if (n > uart->fifo_size) {
+        n = uart->fifo_size;
+    }
+
+    for (unsigned long i = 0; i < n; ++i) {
+        write_reg(uart, REG_THR,
+                  uart->txbuf[(tail + i) & (UART16550_TXBUF_SIZE - 1)]);
+    }
+
+    uart->txtail = tail + n;
+}
+
+/* Sends buffered bytes by busy-waiting on the transmitter. Call with
+ * interrupts disabled. */
+static void
+transmit_polled(struct uart16550_drv* uart, unsigned long nbytes)
+{
+    unsigned long tail = uart->txtail;
+
+    while (!txbuf_is_empty(uart) && ((uart->txtail - tail) < nbytes)) {
+        while (!(read_reg(uart, REG_LSR) & LSR_THRE)) { }
+        transmit_burst(uart);
+    }
+}
+
+/* Starts interrupt-driven transmission. Call with interrupts
+ * disabled. */
+static void
+start_transmit(struct uart16550_drv* uart)
+{
+    transmit_burst(uart);
+
+    /* The THRE interrupt fires once the transmitter has sent
+     * the burst. */
+    if (!txbuf_is_empty(uart)) {
+        write_reg(uart, REG_IER, IER_ETBEI);
+    }
+}
+
+/*
+ * Console sink
+ */
+
+static void
+put_byte(struct uart16550_drv* uart, unsigned char byte)
+{
+    while (!txbuf_put(uart, byte)) {
+        /* The buffer is full. Make room by sending one burst
+         * without waiting for the interrupt. */
+        bool ints_on = cli_if_on();
+        transmit_polled(uart, uart->fifo_size);
+        sti_if_on(ints_on);
+    }
+}
+
+static void
+sink_write(struct console_sink* sink, const char* buf, size_t len)
+{
+    struct uart16550_drv* uart = uart16550_drv_of_sink(sink);
+
+    for (; len; ++buf, --len) {
+        if (*buf == '\n') {
+            put_byte(uart, '\r');
+        }
+        put_byte(uart, *buf);
+    }
+
+    bool ints_on = cli_if_on();
+
+    if (uart->use_irq) {
+        start_transmit(uart);
+    } else {
+        transmit_polled(uart, UART16550_TXBUF_SIZE);
+    }
+
+    sti_if_on(ints_on);
+}
+
+/*
+ * Interrupt handling
+ */
+
+static enum irq_status
+irq_handler_func(unsigned char irqno, struct irq_handler* irqh)
+{
+    struct uart16550_drv* uart = uart16550_drv_of_irq_handler(irqh);
+
+    enum irq_status status = IRQ_NOT_HANDLED;
+
+    for (int i = 0; i < UART16550_IRQ_MAX_LOOPS; ++i) {
+
+        unsigned char iir = read_reg(uart, REG_IIR);
+
+        if (iir & IIR_NO_INT) {
+            break;
+        }
+
+        status = IRQ_HANDLED;
+
+        switch (iir & IIR_ID_MASK) {
+            case IIR_ID_THRE:
+                transmit_burst(uart);
+                if (txbuf_is_empty(uart)) {
+                    write_reg(uart, REG_IER, 0);
+                }
+                break;
+            case IIR_ID_RDA:
+            case IIR_ID_TIMEOUT:
+                /* we don't support input; discard it */
+                while (read_reg(uart, REG_LSR) & LSR_DR) {
+                    read_reg(uart, REG_RBR);
+                }
+                break;
+            case IIR_ID_LSR:
+                read_reg(uart, REG_LSR);
+                break;
+            case IIR_ID_MSR:
+                read_reg(uart, REG_MSR);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return status;
+}
+
+int
+uart16550_install_irq(struct uart16550_drv* uart, unsigned char irqno)
+{
+    assert(uart);
+
+    irq_handler_init(&uart->irq_handler, irq_handler_func);
+
+    int res = install_irq_handler(irqno, &uart->irq_handler);
+    if (res < 0) {
+        return res;
+    }
+
+    bool ints_on = cli_if_on();
+
+    write_reg(uart, REG_MCR, MCR_DTR | MCR_RTS | MCR_OUT2);
+    uart->use_irq = true;
+    start_transmit(uart);
+
+    sti_if_on(ints_on);
+
+    uart->irqno = irqno;
+
+    return 0;
+}
+
+/*
+ * Initialization
+ */
+
+static int
+probe(struct uart16550_drv* uart)
+{
+    /* test the scratch register */
+
+    write_reg(uart, REG_SCR, 0x5a);
+    if (read_reg(uart, REG_SCR) != 0x5a) {
+        return -ENODEV;
+    }
+
+    /* test sending a byte in loopback mode */
+
+    write_reg(uart, REG_MCR, MCR_LOOP | MCR_RTS | MCR_DTR);
+    write_reg(uart, REG_THR, 0xae);
+
+    for (int i = 0; i < UART16550_PROBE_LOOPS; ++i) {
+        if (read_reg(uart, REG_LSR) & LSR_DR) {
+            break;
+        }
+    }
+
+    unsigned char byte = read_reg(uart, REG_RBR);
+
+    write_reg(uart, REG_MCR, MCR_RTS | MCR_DTR);
+
+    return byte == 0xae ? 0 : -ENODEV;
+}
+
+int
+uart16550_init(struct uart16550_drv* uart, unsigned short port)
+{
+    assert(uart);
+
+    uart->port = port;
+    uart->use_irq = false;
+    uart->txhead = 0;
+    uart->txtail = 0;
+
+    write_reg(uart, REG_IER, 0);
+
+    /* 8N1 at highest baud rate */
+
+    unsigned short divisor = UART16550_CLOCK_HZ / UART16550_BAUD;
+
+    write_reg(uart, REG_LCR, LCR_DLAB);
+    write_reg(uart, REG_DLL, divisor & 0xff);
+    write_reg(uart, REG_DLM, divisor >> 8);
+    write_reg(uart, REG_LCR, LCR_8N1);
+
+    /* The 16550A's FIFOs show up in the IIR; older UARTs send
+     * one byte at a time. */
+
+    write_reg(uart, REG_FCR, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX |
+                             FCR_TRIGGER_14);
+
+    if ((read_reg(uart, REG_IIR) & IIR_FIFO_MASK) == IIR_FIFO_MASK) {
+        uart->fifo_size = UART16550_FIFO_SIZE;
+    } else {
+        uart->fifo_size = 1;
+    }
+
+    int res = probe(uart);
+    if (res < 0) {
+        return res;
+    }
+
+    console_sink_init(&uart->sink, sink_write, NULL);
+
+    return 0;
+}
+
+void
+uart16550_uninit(struct uart16550_drv* uart)
+{
+    assert(uart);
+
+    write_reg(uart, REG_IER, 0);
+    write_reg(uart, REG_MCR, 0);
+
+    if (uart->use_irq) {
+        remove_irq_handler(uart->irqno, &uart->irq_handler);
+        uart->use_irq = false;
+    }
+}
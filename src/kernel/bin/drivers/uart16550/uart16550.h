@@ -0,0 +1,74 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "console.h"
+#include "irq.h"
+
+enum {
+    UART16550_COM1_PORT = 0x3f8,
+    UART16550_COM1_IRQNO = 4,
+    /** \brief size of the transmit buffer; must be a power of two */
+    UART16550_TXBUF_SIZE = 4096
+};
+
+/**
+ * The 16550 driver is a console sink for the serial port. It runs at
+ * 115200 baud, 8N1, with FIFOs enabled. Output is polled until the
+ * interrupt handler is installed. Afterwards, writes go into a
+ * transmit buffer, which the interrupt handler sends in bursts of
+ * up to one FIFO.
+ */
+struct uart16550_drv {
+    struct console_sink sink;
+    struct irq_handler  irq_handler;
+
+    unsigned short      port;
+    unsigned char       fifo_size; /**< bytes per burst */
+    bool                use_irq;
+    unsigned char       irqno;
+
+    /* The sink produces, the interrupt handler consumes. The
+     * consumer side always runs with interrupts disabled. */
+    volatile unsigned long txhead;
+    volatile unsigned long txtail;
+    unsigned char          txbuf[UART16550_TXBUF_SIZE];
+};
+
+/**
+ * \brief init the UART for polled output
+ * \param[out] uart the UART driver
+ * \param port the UART's first I/O port
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+uart16550_init(struct uart16550_drv* uart, unsigned short port);
+
+void
+uart16550_uninit(struct uart16550_drv* uart);
+
+/**
+ * \brief switches the UART to interrupt-driven output
+ * \param[in] uart the UART driver
+ * \param irqno the UART's interrupt line
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+uart16550_install_irq(struct uart16550_drv* uart, unsigned char irqno);
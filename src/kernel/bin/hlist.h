@@ -0,0 +1,115 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Intrusive hash lists. The head is a single pointer, which keeps
+ * hash tables small. Each node points back to the pointer that
+ * references it, so nodes can be removed without knowing the head.
+ */
+
+struct hlist_node {
+    struct hlist_node*  next;
+    struct hlist_node** pprev;
+};
+
+struct hlist_head {
+    struct hlist_node* first;
+};
+
+/** \brief static initializer for an empty hash-list head */
+#define HLIST_HEAD_INITIALIZER  { .first = NULL }
+
+static inline void
+hlist_init_head(struct hlist_head* head)
+{
+    head->first = NULL;
+}
+
+static inline void
+hlist_init_node(struct hlist_node* node)
+{
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+static inline bool
+hlist_is_empty(const struct hlist_head* head)
+{
+    return !head->first;
+}
+
+/**
+ * \brief tests if a node is in a hash list
+ * \param[in] node the node
+ * \return true if the node is not in a list, or false otherwise
+ */
+static inline bool
+hlist_is_unhashed(const struct hlist_node* node)
+{
+    return !node->pprev;
+}
+
+static inline struct hlist_node*
+hlist_first(const struct hlist_head* head)
+{
+    return head->first;
+}
+
+static inline struct hlist_node*
+hlist_next(const struct hlist_node* node)
+{
+    return node->next;
+}
+
+static inline void
+hlist_add_head(struct hlist_head* head, struct hlist_node* node)
+{
+    node->next = head->first;
+    if (node->next) {
+        node->next->pprev = &node->next;
+    }
+    head->first = node;
+    node->pprev = &head->first;
+}
+
+static inline void
+hlist_remove(struct hlist_node* node)
+{
+    *node->pprev = node->next;
+    if (node->next) {
+        node->next->pprev = node->pprev;
+    }
+    hlist_init_node(node);
+}
+
+/**
+ * \brief iterates over all nodes of a hash list
+ * \param node_ the loop variable of type struct hlist_node*
+ * \param head_ the hash-list head
+ *
+ * The current node must not be removed within the loop.
+ */
+#define hlist_foreach(node_, head_)                 \
+    for ((node_) = hlist_first(head_);              \
+         (node_);                                   \
+         (node_) = hlist_next(node_))
@@ -17,15 +17,121 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_IPC
+
 #include "ipc.h"
 #include <errno.h>
+#include <fpage.h>
 #include <stddef.h>
 #include <string.h>
 #include "cpu.h"
+#include "log.h"
+#include "pte.h"
 #include "sched.h"
 #include "task.h"
 #include "tcb.h"
+#include "trace.h"
 #include "vmem.h"
+#include "vmemarea.h"
+
+static int
+fpage_is_user(fpage_type fpage)
+{
+        const struct vmem_area *user;
+
+        user = vmem_area_get_by_name(VMEM_AREA_USER);
+
+        return fpage_is_valid(fpage) &&
+               (fpage_get_pgindex(fpage) >= user->pgindex) &&
+               (fpage_get_npages(fpage) <= user->npages) &&
+               (fpage_get_pgindex(fpage) - user->pgindex <=
+                        user->npages - fpage_get_npages(fpage));
+}
+
+static unsigned long
+fpage_pteflags(fpage_type fpage)
+{
+        unsigned long pteflags;
+
+        /* i386 page tables have no execute bit; readable pages are
+         * always executable */
+
+        pteflags = PTE_FLAG_PRESENT|PTE_FLAG_USERMODE;
+
+        if (fpage_get_rights(fpage)&IPC_MMAP_WR)
+        {
+                pteflags |= PTE_FLAG_WRITEABLE;
+        }
+
+        return pteflags;
+}
+
+static int
+ipc_transfer_fpage(struct ipc_msg *msg, const struct ipc_msg *msgin,
+                   struct tcb *rcv)
+{
+        int err;
+        fpage_type snd_fpage, rcv_fpage;
+        os_index_t pgindex;
+
+        snd_fpage = msgin->msg0;
+        rcv_fpage = msg->msg0;
+
+        if (!fpage_is_user(snd_fpage) || !fpage_is_user(rcv_fpage))
+        {
+                return -EINVAL;
+        }
+        else if (!fpage_get_rights(snd_fpage))
+        {
+                return -EINVAL;
+        }
+        else if (fpage_get_log2npages(snd_fpage) >
+                 fpage_get_log2npages(rcv_fpage))
+        {
+                /* flexpage larger than receive window */
+                return -EINVAL;
+        }
+
+        /*
+         * a smaller flexpage keeps its offset within the receive
+         * window
+         */
+
+        pgindex = fpage_get_pgindex(rcv_fpage) +
+                  (fpage_get_pgindex(snd_fpage) &
+                   (fpage_get_npages(rcv_fpage) - 1));
+
+        if (msgin->flags&IPC_MSG_FLAGS_GRANT)
+        {
+                err = vmem_grant_pages_at(rcv->task->as, pgindex,
+                                          msgin->snd->task->as,
+                                          fpage_get_pgindex(snd_fpage),
+                                          fpage_get_npages(snd_fpage),
+                                          fpage_pteflags(snd_fpage));
+        }
+        else
+        {
+                err = vmem_share_pages_at(rcv->task->as, pgindex,
+                                          msgin->snd->task->as,
+                                          fpage_get_pgindex(snd_fpage),
+                                          fpage_get_npages(snd_fpage),
+                                          fpage_pteflags(snd_fpage));
+        }
+
+        if (err < 0)
+        {
+                return err;
+        }
+
+        msg->snd = msgin->snd;
+        msg->flags = msgin->flags&~IPC_MSG_FLAGS_RESERVED;
+        msg->msg0 = fpage_create(pgindex,
+                                 fpage_get_log2npages(snd_fpage),
+                                 fpage_get_rights(snd_fpage));
+        msg->msg1 = msgin->msg1;
+
+        return 0;
+}
 
 int
 ipc_send(struct ipc_msg *msg, struct tcb *rcv)
@@ -53,6 +159,8 @@ ipc_send_and_wait(struct ipc_msg *msg, struct tcb *rcv)
          * enqueue message
          */
 
+        trace_event(TRACE_IPC_SEND, msg->snd, rcv, msg->flags);
+
         spinlock_lock(&rcv->lock, (unsigned long)sched_get_current_thread(cpuid()));
         list_enqueue_back(&rcv->ipcin, &msg->rcv_q);
         spinlock_unlock(&rcv->lock);
@@ -118,7 +226,6 @@ err_tcb_get_state:
         return err;
 }
 #include "pde.h"
-#include "console.h"
 int
 ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
 {
@@ -129,7 +236,7 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
 
         if (list_is_empty(&rcv->ipcin))
         {
-                console_printf("%s:%x\n", __FILE__, __LINE__);
+                pr_debug("ipc: tcb=%p waits for messages\n", rcv);
                 /*
                  * no pending messages; schedule possible senders
                  */
@@ -138,12 +245,12 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
                 sched_switch(cpuid());
                 spinlock_lock(&rcv->lock,
                               (unsigned long)sched_get_current_thread(cpuid()));
-                console_printf("%s:%x\n", __FILE__, __LINE__);
+                pr_debug("ipc: tcb=%p woke up\n", rcv);
         }
 
         if (list_is_empty(&rcv->ipcin))
         {
-                console_printf("%s:%x\n", __FILE__, __LINE__);
+                pr_debug("ipc: tcb=%p has no messages\n", rcv);
                 err = -EAGAIN;
                 goto err_rcv_ipcin;
         }
@@ -159,15 +266,32 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
 
         if (!msgin)
         {
-                console_printf("%s:%x\n", __FILE__, __LINE__);
+                pr_debug("ipc: tcb=%p has an invalid message\n", rcv);
                 err = -EAGAIN;
                 goto err_msg;
         }
 
-        console_printf("%s:%x msg->flags=%x msgin->flags=%x<\n", __FILE__,
-                       __LINE__, msg->flags, msgin->flags);
+        pr_debug("ipc: msg->flags=%#lx msgin->flags=%#lx\n",
+                 msg->flags, msgin->flags);
+
+        trace_event(TRACE_IPC_RECV, rcv, msgin->snd, msgin->flags);
 
-        if (msg->flags&msgin->flags&IPC_MSG_FLAGS_MMAP)
+        if (msgin->flags&(IPC_MSG_FLAGS_MAP|IPC_MSG_FLAGS_GRANT))
+        {
+                /* sender transfers flexpage */
+
+                if (!(msg->flags&IPC_MSG_FLAGS_MAP))
+                {
+                        err = -EINVAL;
+                        goto err_mode;
+                }
+
+                if ((err = ipc_transfer_fpage(msg, msgin, rcv)) < 0)
+                {
+                        goto err_ipc_transfer_fpage;
+                }
+        }
+        else if (msg->flags&msgin->flags&IPC_MSG_FLAGS_MMAP)
         {
                 /* both threads in mmap mode */
 
@@ -177,10 +301,10 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
                         goto err_mmap_count;
                 }
 
-/*                console_printf("%s:%x: %x\n", __FILE__, __LINE__, msg);
-                console_printf("%s:%x: %x\n", __FILE__, __LINE__, msg->snd);
-                console_printf("%s:%x: %x\n", __FILE__, __LINE__, msg->snd->task);
-                console_printf("%s:%x: %x\n", __FILE__, __LINE__, msg->snd->task->as);*/
+/*                console_printf("%s:%d: %p\n", __FILE__, __LINE__, msg);
+                console_printf("%s:%d: %p\n", __FILE__, __LINE__, msg->snd);
+                console_printf("%s:%d: %p\n", __FILE__, __LINE__, msg->snd->task);
+                console_printf("%s:%d: %p\n", __FILE__, __LINE__, msg->snd->task->as);*/
 
                 vmem_map_pages_at(rcv->task->as, msg->msg0,
                            msgin->snd->task->as, msgin->msg0,
@@ -191,9 +315,10 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
                 msg->flags = msgin->flags&~IPC_MSG_FLAGS_RESERVED;
                 msg->msg1 = msgin->msg1;
         }
-        else if (!((msg->flags|msgin->flags)&IPC_MSG_FLAGS_MMAP))
+        else if (!(msgin->flags&IPC_MSG_FLAGS_MMAP))
         {
-                /* both thread in register mode */
+                /* sender in register mode; an offered receive
+                 * window remains unused */
                 memcpy(msg, msgin, sizeof(*msg));
         }
         else
@@ -208,6 +333,7 @@ ipc_recv(struct ipc_msg *msg, struct tcb *rcv)
 
         return 0;
 
+err_ipc_transfer_fpage:
 err_mmap_count:
 err_mode:
 err_msg:
@@ -221,3 +347,64 @@ ipc_reply_and_recv(struct ipc_msg *msg, struct tcb *rcv)
 {
         return -ENOSYS;
 }
+
+int
+ipc_unmap(struct ipc_msg *msg, struct tcb *rcv)
+{
+        fpage_type fpage;
+
+        /*
+         * revoke the sender's flexpage; the receiver is NULL
+         */
+
+        fpage = msg->msg0;
+
+        if (!fpage_is_user(fpage))
+        {
+                return -EINVAL;
+        }
+
+        return vmem_revoke_pages_at(msg->snd->task->as,
+                                    fpage_get_pgindex(fpage),
+                                    fpage_get_npages(fpage));
+}
+
+/*
+ * Enqueues a kernel-owned message without waiting for the receiver.
+ * Interrupt handlers and softirqs use this function, so we never spin
+ * on the receiver's lock. The message remains queued until the receiver
+ * dequeues it in ipc_recv(), which copies it under the receiver's lock.
+ * We fill in the message under the same lock, so a message is never
+ * overwritten before the receiver copied it.
+ */
+int
+ipc_notify(struct ipc_msg *msg, struct tcb *rcv, struct tcb *snd,
+           unsigned long flags, unsigned long msg0, unsigned long msg1)
+{
+        if (spinlock_try_lock(&rcv->lock, (unsigned long)msg) < 0)
+        {
+                return -EBUSY;
+        }
+
+        if (msg->rcv_q.next)
+        {
+                /* still queued from the previous notification */
+                spinlock_unlock(&rcv->lock);
+                return -EALREADY;
+        }
+
+        ipc_msg_init(msg, snd, flags, msg0, msg1);
+
+        list_enqueue_back(&rcv->ipcin, &msg->rcv_q);
+
+        if (tcb_get_state(rcv) == THREAD_STATE_RECV)
+        {
+                tcb_set_state(rcv, THREAD_STATE_READY);
+        }
+
+        spinlock_unlock(&rcv->lock);
+
+        trace_event(TRACE_IPC_NOTIFY, rcv, msg, msg->flags);
+
+        return 0;
+}
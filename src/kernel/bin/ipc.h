@@ -36,3 +36,10 @@ ipc_reply_and_recv(struct ipc_msg *msg, struct tcb *rcv);
 
 int
 ipc_reply(struct ipc_msg *msg, struct tcb *rcv);
+
+int
+ipc_unmap(struct ipc_msg *msg, struct tcb *rcv);
+
+int
+ipc_notify(struct ipc_msg *msg, struct tcb *rcv, struct tcb *snd,
+           unsigned long flags, unsigned long msg0, unsigned long msg1);
@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <string.h>
 #include "interupt.h"
+#include "trace.h"
 
 static struct irq_handler*
 irq_handler_of_list(struct list* item)
@@ -62,6 +63,8 @@ init_irq_handling(int (*enable_irq)(unsigned char),
 void
 handle_irq(unsigned char irqno)
 {
+    trace_event(TRACE_IRQ_ENTER, irqno, 0, 0);
+
     const struct list* head = g_irq_handling.irqh + irqno;
     struct list* item = list_begin(head);
 
@@ -79,6 +82,8 @@ handle_irq(unsigned char irqno)
         /* don't touch *item after func() returned */
         item = next;
     }
+
+    trace_event(TRACE_IRQ_EXIT, irqno, 0, 0);
 }
 
 int
@@ -20,60 +20,206 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Intrusive doubly-linked lists. All operations are inline, so
+ * traversals compile down to plain pointer chasing. Embed a struct
+ * list in an object and use containerof() to get back to the object.
+ */
 
 struct list {
     struct list* next;
     struct list* prev;
 };
 
-struct list*
-list_init_item(struct list* item);
-
-struct list*
-list_init_head(struct list* head);
-
-bool
-list_is_empty(const struct list* head);
-
-void
-list_enqueue_before(struct list* item, struct list* newitem);
-
-void
-list_enqueue_after(struct list* item, struct list* newitem);
-
-void
-list_enqueue_front(struct list* head, struct list* newitem);
-
-void
-list_enqueue_back(struct list* head, struct list* newitem);
-
-void
+/** \brief static initializer for an empty list head */
+#define LIST_HEAD_INITIALIZER(head_) \
+    { .next = &(head_), .prev = &(head_) }
+
+static inline struct list*
+list_init_item(struct list* item)
+{
+    item->next = NULL;
+    item->prev = NULL;
+
+    return item;
+}
+
+static inline struct list*
+list_init_head(struct list* head)
+{
+    head->next = head;
+    head->prev = head;
+
+    return head;
+}
+
+static inline struct list*
+list_begin(const struct list* head)
+{
+    return head->next;
+}
+
+static inline const struct list*
+list_end(const struct list* head)
+{
+    return head;
+}
+
+static inline struct list*
+list_rbegin(const struct list* head)
+{
+    return head->prev;
+}
+
+static inline const struct list*
+list_rend(const struct list* head)
+{
+    return head;
+}
+
+static inline struct list*
+list_next(const struct list* item)
+{
+    return item->next;
+}
+
+static inline struct list*
+list_prev(const struct list* item)
+{
+    return item->prev;
+}
+
+static inline bool
+list_is_empty(const struct list* head)
+{
+    return list_begin(head) == list_end(head);
+}
+
+static inline void
+list_enqueue_before(struct list* item, struct list* newitem)
+{
+    newitem->prev = item->prev;
+    newitem->next = item;
+
+    if (item->prev) {
+        item->prev->next = newitem;
+    }
+
+    item->prev = newitem;
+}
+
+static inline void
+list_enqueue_after(struct list* item, struct list* newitem)
+{
+    newitem->prev = item;
+    newitem->next = item->next;
+
+    if (item->next) {
+        item->next->prev = newitem;
+    }
+
+    item->next = newitem;
+}
+
+static inline void
+list_enqueue_front(struct list* head, struct list* newitem)
+{
+    list_enqueue_after(head, newitem);
+}
+
+static inline void
+list_enqueue_back(struct list* head, struct list* newitem)
+{
+    list_enqueue_before(head, newitem);
+}
+
+/**
+ * \brief inserts an item before the first item that compares lower
+ * \param[in] head the list head
+ * \param[in] newitem the new item
+ * \param cmp the compare function
+ *
+ * This is a linear operation. Use a heap or a red-black tree for
+ * large ordered sets.
+ */
+static inline void
 list_enqueue_sorted(struct list* head, struct list* newitem,
-                    int (*cmp)(struct list*, struct list*));
-
-void
-list_dequeue(struct list* item);
-
-struct list*
-list_begin(const struct list* head);
-
-const struct list*
-list_end(const struct list* head);
-
-struct list*
-list_rbegin(const struct list* head);
-
-const struct list*
-list_rend(const struct list* head);
-
-struct list*
-list_first(const struct list* head);
-
-struct list*
-list_last(const struct list* head);
-
-struct list*
-list_next(const struct list* item);
-
-struct list*
-list_prev(const struct list* item);
+                    int (*cmp)(struct list*, struct list*))
+{
+    struct list* item = list_begin(head);
+
+    while (item != list_end(head)) {
+        if (cmp(newitem, item) > 0) {
+            break;
+        }
+        item = list_next(item);
+    }
+
+    list_enqueue_before(item, newitem);
+}
+
+static inline void
+list_dequeue(struct list* item)
+{
+    if (item->next) {
+        item->next->prev = item->prev;
+    }
+    if (item->prev) {
+        item->prev->next = item->next;
+    }
+
+    item->prev = NULL;
+    item->next = NULL;
+}
+
+/**
+ * \brief moves all items of a list to the end of another list
+ * \param[in] head the destination list head
+ * \param[in] from the source list head, empty afterwards
+ */
+static inline void
+list_splice_back(struct list* head, struct list* from)
+{
+    if (list_is_empty(from)) {
+        return;
+    }
+
+    from->next->prev = head->prev;
+    from->prev->next = head;
+    head->prev->next = from->next;
+    head->prev = from->prev;
+
+    list_init_head(from);
+}
+
+static inline struct list*
+list_first(const struct list* head)
+{
+    if (list_is_empty(head)) {
+        return NULL;
+    }
+    return list_begin(head);
+}
+
+static inline struct list*
+list_last(const struct list* head)
+{
+    if (list_is_empty(head)) {
+        return NULL;
+    }
+    return list_prev(list_end(head));
+}
+
+/**
+ * \brief iterates over all items of a list
+ * \param item_ the loop variable of type struct list*
+ * \param head_ the list head
+ *
+ * The current item must not be removed within the loop.
+ */
+#define list_foreach(item_, head_)                  \
+    for ((item_) = list_begin(head_);               \
+         (item_) != list_end(head_);                \
+         (item_) = list_next(item_))
@@ -0,0 +1,331 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "log.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "atomic.h"
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "div64.h"
+#include "interupt.h"
+#include "membar.h"
+#include "sched.h"
+#include "tcb.h"
+#include "tcbhlp.h"
+
+enum {
+    /** \brief number of records in the ring; must be a power of two */
+    LOG_NRECORDS = 128,
+    /** \brief writers drain the ring themselves above this fill level */
+    LOG_SYNC_FILL = (LOG_NRECORDS * 3) / 4,
+    /** \brief priority of the drain thread */
+    LOG_THREAD_PRIO = 1
+};
+
+struct log_record {
+    volatile unsigned long seq; /**< sequence number plus 1 once committed */
+    timestamp_t            ts_ns;
+    unsigned char          level;
+    unsigned short         len;
+    char                   text[LOG_LINE_MAX];
+};
+
+static struct {
+    volatile unsigned long head; /**< next sequence number to reserve */
+    unsigned long          tail; /**< next sequence number to drain */
+    unsigned long          ndropped;
+
+    /* \attention Only access with interupts disabled! */
+    bool                   draining;
+    bool                   at_line_start;
+    struct tcb*            worker;
+
+    /* exclusive output; runs in the drain, see log_run_exclusive() */
+    void                 (*exclusive_func)(void*);
+    void*                  exclusive_data;
+
+    struct log_record      record[LOG_NRECORDS];
+} g_log = {
+    .at_line_start = true
+};
+
+static struct log_record*
+record_of_seq(unsigned long seq)
+{
+    return g_log.record + (seq & (LOG_NRECORDS - 1));
+}
+
+/*
+ * Draining
+ */
+
+/* Call with interrupts disabled. */
+static void
+skip_overrun_records(void)
+{
+    unsigned long head = g_log.head;
+
+    if ((head - g_log.tail) > LOG_NRECORDS) {
+        g_log.ndropped += (head - g_log.tail) - LOG_NRECORDS;
+        g_log.tail = head - LOG_NRECORDS;
+    }
+}
+
+/* Call with interrupts disabled. */
+static bool
+has_committed_records(void)
+{
+    skip_overrun_records();
+
+    return (g_log.tail != g_log.head) &&
+           (record_of_seq(g_log.tail)->seq == (g_log.tail + 1));
+}
+
+static void
+write_timestamp(timestamp_t ts_ns)
+{
+    unsigned long us;
+    unsigned long s = div64_u32(div64_u32(ts_ns, 1000, NULL), 1000000, &us);
+
+    char str[24];
+    int len = snprintf(str, sizeof(str), "[%5lu.%06lu] ", s, us);
+
+    console_write(str, len);
+}
+
+static void
+write_record(const struct log_record* rec, bool at_line_start)
+{
+    if (at_line_start) {
+        write_timestamp(rec->ts_ns);
+    }
+    console_write(rec->text, rec->len);
+}
+
+void
+log_flush()
+{
+    struct log_record rec;
+
+    bool ints_on = cli_if_on();
+
+    if (g_log.draining) {
+        goto out;
+    }
+    g_log.draining = true;
+
+    while (has_committed_records()) {
+
+        unsigned long seq = g_log.tail;
+        const struct log_record* slot = record_of_seq(seq);
+
+        /* Copy the record, then make sure that no writer
+         * reused the slot meanwhile. */
+
+        rdmembar();
+        memcpy(&rec, (const void*)slot, sizeof(rec));
+        rdmembar();
+
+        if (slot->seq != (seq + 1)) {
+            continue; /* overrun; skipped on next iteration */
+        }
+
+        g_log.tail = seq + 1;
+
+        bool at_line_start = g_log.at_line_start;
+        if (rec.len) {
+            g_log.at_line_start = rec.text[rec.len - 1] == '\n';
+        }
+
+        /* write to the console with interrupts enabled */
+        sti_if_on(ints_on);
+        write_record(&rec, at_line_start);
+        ints_on = cli_if_on();
+    }
+
+    if (g_log.ndropped) {
+        char str[LOG_LINE_MAX];
+        int len = snprintf(str, sizeof(str), "log: %lu records dropped\n",
+                           g_log.ndropped);
+        g_log.ndropped = 0;
+        g_log.at_line_start = true;
+        sti_if_on(ints_on);
+        console_write(str, len);
+        ints_on = cli_if_on();
+    }
+
+    while (g_log.exclusive_func) {
+        void (*func)(void*) = g_log.exclusive_func;
+        void* data = g_log.exclusive_data;
+        g_log.exclusive_func = NULL;
+        sti_if_on(ints_on);
+        func(data);
+        ints_on = cli_if_on();
+    }
+
+    console_flush();
+
+    g_log.draining = false;
+
+out:
+    sti_if_on(ints_on);
+}
+
+int
+log_run_exclusive(void (*func)(void*), void* data)
+{
+    bool ints_on = cli_if_on();
+
+    if (g_log.exclusive_func) {
+        sti_if_on(ints_on);
+        return -EBUSY;
+    }
+    g_log.exclusive_func = func;
+    g_log.exclusive_data = data;
+
+    sti_if_on(ints_on);
+
+    /* Runs the function here, or in the thread that currently
+     * drains the log before it finishes. */
+    log_flush();
+
+    return 0;
+}
+
+static void
+wake_worker(void)
+{
+    bool ints_on = cli_if_on();
+
+    if (g_log.worker && (tcb_get_state(g_log.worker) == THREAD_STATE_WAITING)) {
+        tcb_set_state(g_log.worker, THREAD_STATE_READY);
+    }
+
+    sti_if_on(ints_on);
+}
+
+/*
+ * Writing
+ */
+
+int
+log_vprintf(enum log_level level, const char* fmt, va_list args)
+{
+    unsigned long seq = atomic_xadd(&g_log.head, 1);
+
+    struct log_record* rec = record_of_seq(seq);
+
+    rec->seq = seq; /* not committed */
+    wrmembar();
+
+    rec->ts_ns = clock_now_ns();
+    rec->level = level;
+
+    int len = vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+    if (len >= (int)sizeof(rec->text)) {
+        /* truncated; terminate the line */
+        len = sizeof(rec->text) - 1;
+        rec->text[len - 1] = '\n';
+    }
+    rec->len = len;
+
+    wrmembar(); /* publish record before committing */
+    rec->seq = seq + 1;
+
+    if (!g_log.worker || ((seq - g_log.tail) >= LOG_SYNC_FILL)) {
+        log_flush();
+    } else {
+        wake_worker();
+    }
+
+    return 0;
+}
+
+int
+log_printf(enum log_level level, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int res = log_vprintf(level, fmt, args);
+    va_end(args);
+
+    return res;
+}
+
+/*
+ * Drain thread
+ */
+
+static void
+worker_func(struct tcb* self)
+{
+    for (;;) {
+        cli();
+
+        if (!has_committed_records()) {
+            tcb_set_state(self, THREAD_STATE_WAITING);
+            sti();
+            sched_switch(cpuid());
+            continue;
+        }
+
+        sti();
+
+        log_flush();
+    }
+}
+
+int
+log_init_thread(struct task* task)
+{
+    struct tcb* tcb;
+
+    int res = tcb_helper_allocate_tcb_and_stack(task, 1, &tcb);
+    if (res < 0) {
+        console_perror("tcb_helper_allocate_tcb_and_stack", -res);
+        return res;
+    }
+
+    res = tcb_helper_run_kernel_thread(tcb, worker_func);
+    if (res < 0) {
+        console_perror("tcb_helper_run_kernel_thread", -res);
+        goto err_tcb_helper_run_kernel_thread;
+    }
+
+    res = sched_add_thread(tcb, LOG_THREAD_PRIO);
+    if (res < 0) {
+        console_perror("sched_add_thread", -res);
+        goto err_sched_add_thread;
+    }
+
+    bool ints_on = cli_if_on();
+    g_log.worker = tcb;
+    sti_if_on(ints_on);
+
+    return 0;
+
+err_sched_add_thread:
+err_tcb_helper_run_kernel_thread:
+    tcb_helper_free_tcb(tcb);
+    return res;
+}
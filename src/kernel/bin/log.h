@@ -0,0 +1,166 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdarg.h>
+
+struct task;
+
+/*
+ * The kernel log is an in-memory ring buffer of formatted records.
+ * Writers reserve a record with a single atomic operation, format
+ * their message into it and commit it. They never wait for each other
+ * or for a device. A low-priority kernel thread drains committed
+ * records to the console. Until that thread runs, or if the ring
+ * fills up, writers drain it themselves.
+ *
+ * If writers overrun the ring, the oldest records are lost.
+ */
+
+enum {
+    /** \brief maximum length of a log message */
+    LOG_LINE_MAX = 112
+};
+
+enum log_level {
+    LOG_EMERG = 0,
+    LOG_ALERT,
+    LOG_CRIT,
+    LOG_ERR,
+    LOG_WARNING,
+    LOG_NOTICE,
+    LOG_INFO,
+    LOG_DEBUG,
+    LOG_NLEVELS
+};
+
+/**
+ * \brief writes a message to the kernel log
+ * \param level the message's severity
+ * \param[in] fmt the format string
+ * \param args the format arguments
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * Messages are formatted with vsnprintf() and truncated to
+ * LOG_LINE_MAX - 1 characters.
+ */
+int
+log_vprintf(enum log_level level, const char* fmt, va_list args)
+    __attribute__((format(printf, 2, 0)));
+
+/**
+ * \brief writes a message to the kernel log
+ * \param level the message's severity
+ * \param[in] fmt the format string
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+log_printf(enum log_level level, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/*
+ * Leveled logging
+ *
+ * The pr_*() macros log a message from a subsystem. A source file
+ * selects its subsystem by defining LOG_SUBSYS before including any
+ * header. Messages less severe than LOG_LEVEL_MIN, or from subsystems
+ * outside of LOG_SUBSYS_MASK, are removed at compile time. Their
+ * arguments are still type-checked, but no code or string data is
+ * emitted for them.
+ */
+
+#define LOG_SUBSYS_CORE     (1ul << 0)
+#define LOG_SUBSYS_IPC      (1ul << 1)
+#define LOG_SUBSYS_SYSCALL  (1ul << 2)
+#define LOG_SUBSYS_SCHED    (1ul << 3)
+#define LOG_SUBSYS_TASK     (1ul << 4)
+#define LOG_SUBSYS_SYSSRV   (1ul << 5)
+#define LOG_SUBSYS_ALL      (~0ul)
+
+#ifndef LOG_SUBSYS
+#define LOG_SUBSYS          LOG_SUBSYS_CORE
+#endif
+
+/* least severe level that is compiled in */
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN       LOG_INFO
+#endif
+
+#ifndef LOG_SUBSYS_MASK
+#ifdef LOG_NO_HOTPATHS
+#define LOG_SUBSYS_MASK     (LOG_SUBSYS_ALL & ~(LOG_SUBSYS_IPC | \
+                                                LOG_SUBSYS_SYSCALL))
+#else
+#define LOG_SUBSYS_MASK     LOG_SUBSYS_ALL
+#endif
+#endif
+
+/**
+ * \brief tests at compile time if messages are logged
+ * \param level_ the messages' severity
+ * \param subsys_ the messages' subsystem
+ */
+#define LOG_ENABLED(level_, subsys_) \
+    (((level_) <= (LOG_LEVEL_MIN)) && ((subsys_) & (LOG_SUBSYS_MASK)))
+
+#define pr_log(level_, ...)                                 \
+    do {                                                    \
+        if (LOG_ENABLED(level_, LOG_SUBSYS)) {              \
+            log_printf((level_), __VA_ARGS__);              \
+        }                                                   \
+    } while (0)
+
+#define pr_emerg(...)   pr_log(LOG_EMERG, __VA_ARGS__)
+#define pr_alert(...)   pr_log(LOG_ALERT, __VA_ARGS__)
+#define pr_crit(...)    pr_log(LOG_CRIT, __VA_ARGS__)
+#define pr_err(...)     pr_log(LOG_ERR, __VA_ARGS__)
+#define pr_warning(...) pr_log(LOG_WARNING, __VA_ARGS__)
+#define pr_notice(...)  pr_log(LOG_NOTICE, __VA_ARGS__)
+#define pr_info(...)    pr_log(LOG_INFO, __VA_ARGS__)
+#define pr_debug(...)   pr_log(LOG_DEBUG, __VA_ARGS__)
+
+/**
+ * \brief writes all committed records to the console
+ *
+ * Returns immediately if another caller is draining the log.
+ */
+void
+log_flush(void);
+
+/**
+ * \brief runs a function with exclusive access to the console
+ * \param[in] func the function
+ * \param[in] data the function's argument
+ * \return 0 on success, or -EBUSY if another function is pending
+ *
+ * The function runs as part of draining the log, after all pending
+ * records have been written. Its output cannot interleave with log
+ * output. If another thread is draining the log, the function runs
+ * in that thread and might not have finished on return.
+ */
+int
+log_run_exclusive(void (*func)(void*), void* data);
+
+/**
+ * \brief starts the thread that drains the log
+ * \param[in] task the kernel task
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+log_init_thread(struct task* task);
@@ -7,20 +7,24 @@ BINS += kernel
 kernel_MODULEDIR := kernel/bin
 
 kernel_SRCS = alloc.c \
+              allocstat.c \
               assert.c \
               bitset.c \
+              clock.c \
               console.c \
               elfldr.c \
               ipc.c \
               ipcmsg.c \
               irq.c \
-              list.c \
               loader.c \
-              memzone.c \
+              log.c \
               pmem.c \
               pmemarea.c \
+              rmap.c \
               sched.c \
               semaphore.c \
+              slab.c \
+              softirq.c \
               spinlock.c \
               syscall.c \
               sysexec.c \
@@ -30,6 +34,8 @@ kernel_SRCS = alloc.c \
               tcb.c \
               tcbhlp.c \
               timer.c \
+              trace.c \
+              twheel.c \
               vmem.c \
               vmemarea.c
 
@@ -40,6 +46,28 @@ kernel_INCLUDES += kernel/bin/$(archdir) \
                    libc0/include
 kernel_LD_SEARCH_PATHS += libc0/lib
 
+# Track kernel allocations per call site; build with 'make ALLOC_STATS=1'
+ifdef ALLOC_STATS
+kernel_CPPFLAGS += -DALLOC_STATS
+endif
+
+# Compile-time log filtering; build with 'make LOG_LEVEL=<n>' to keep
+# messages of level n and more severe, e.g., LOG_LEVEL=7 for debugging
+ifdef LOG_LEVEL
+kernel_CPPFLAGS += -DLOG_LEVEL_MIN=$(LOG_LEVEL)
+endif
+
+# Remove all logging from the IPC and syscall paths; build with
+# 'make LOG_NO_HOTPATHS=1'
+ifdef LOG_NO_HOTPATHS
+kernel_CPPFLAGS += -DLOG_NO_HOTPATHS
+endif
+
+# Record all trace events from boot on; build with 'make TRACE_BOOT=1'
+ifdef TRACE_BOOT
+kernel_CPPFLAGS += -DTRACE_BOOT
+endif
+
 # include architecture-specific files
 include $(srcdir)/kernel/bin/$(archdir)/arch.mk
 
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stddef.h>
 #include <string.h>
+#include "minmax.h"
 #include "pageframe.h"
 #include "semaphore.h"
 
@@ -348,26 +349,121 @@ err_get_ref:
     return res;
 }
 
-void
+unsigned long
 pmem_unref_frames(unsigned long pfindex, unsigned long nframes)
 {
     if (nframes > memmap_len(&g_pmem)) {
-        return;
+        return 0;
     } else if (pfindex > memmap_len(&g_pmem) - nframes) {
-        return;
+        return 0;
     }
 
+    unsigned long nfreed = 0;
+
     pmem_map_t* beg = g_pmem.map + pfindex;
     const pmem_map_t* end = beg + nframes;
 
     semaphore_enter(&g_pmem.map_sem);
 
     while (beg < end) {
-        checked_unref_frame(beg); // ignore errors
+        if (checked_unref_frame(beg) && !get_ref(*beg)) {
+            ++nfreed;
+        }
         ++beg;
     }
 
     semaphore_leave(&g_pmem.map_sem);
+
+    return nfreed;
+}
+
+int
+pmem_ref_frame_batch(const unsigned long* pfindex, size_t count)
+{
+    int res = 0;
+    const unsigned long* beg = pfindex;
+    const unsigned long* end = pfindex + count;
+
+    semaphore_enter(&g_pmem.map_sem);
+
+    for (; pfindex < end; ++pfindex) {
+        if (!(*pfindex < memmap_len(&g_pmem))) {
+            res = -ENOMEM;
+            goto err_memmap_len;
+        }
+        pmem_map_t* memmap = g_pmem.map + *pfindex;
+
+        if (!get_ref(*memmap)) {
+            res = -ENODEV;
+            goto err_get_ref;
+        }
+        if (!checked_ref_frame(memmap)) {
+            res = -EOVERFLOW;
+            goto err_checked_ref_frame;
+        }
+    }
+
+    semaphore_leave(&g_pmem.map_sem);
+
+    return 0;
+
+err_checked_ref_frame:
+err_get_ref:
+err_memmap_len:
+    while (pfindex > beg) {
+        --pfindex;
+        g_pmem.map[*pfindex] = unref_frame(g_pmem.map[*pfindex]);
+    }
+    semaphore_leave(&g_pmem.map_sem);
+    return res;
+}
+
+size_t
+pmem_unref_frame_batch(const unsigned long* pfindex, size_t count)
+{
+    size_t nfreed = 0;
+    const unsigned long* end = pfindex + count;
+
+    semaphore_enter(&g_pmem.map_sem);
+
+    for (; pfindex < end; ++pfindex) {
+        if (!(*pfindex < memmap_len(&g_pmem))) {
+            continue;
+        }
+        pmem_map_t* memmap = g_pmem.map + *pfindex;
+
+        if (checked_unref_frame(memmap) && !get_ref(*memmap)) {
+            ++nfreed;
+        }
+    }
+
+    semaphore_leave(&g_pmem.map_sem);
+
+    return nfreed;
+}
+
+unsigned long
+pmem_count_used_frames(unsigned long pfindex, unsigned long nframes)
+{
+    if (!(pfindex < memmap_len(&g_pmem))) {
+        return 0;
+    }
+    nframes = minul(nframes, memmap_len(&g_pmem) - pfindex);
+
+    const pmem_map_t* beg = g_pmem.map + pfindex;
+    const pmem_map_t* end = beg + nframes;
+
+    unsigned long n = 0;
+
+    semaphore_enter(&g_pmem.map_sem);
+
+    for (; beg < end; ++beg) {
+        n += !!get_ref(*beg);
+    }
+
+    semaphore_leave(&g_pmem.map_sem);
+
+    return n;
 }
 
 const pmem_map_t*
@@ -50,9 +50,52 @@ pmem_claim_frames(unsigned long pfindex, unsigned long nframes);
 int
 pmem_ref_frames(unsigned long pfindex, unsigned long nframes);
 
-void
+/**
+ * \brief unrefs contiguous page frames
+ * \param pfindex the first page frame
+ * \param nframes the number of page frames
+ * \return the number of page frames that have been released
+ */
+unsigned long
 pmem_unref_frames(unsigned long pfindex, unsigned long nframes);
 
+/**
+ * \brief refs a list of page frames
+ * \param[in] pfindex an array of page-frame indices
+ * \param count the number of array elements
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * In contrast to pmem_ref_frames(), the page frames do not have
+ * to be contiguous. The memory map is locked only once for the whole
+ * list. On errors, none of the page frames is referenced.
+ */
+int
+pmem_ref_frame_batch(const unsigned long* pfindex, size_t count);
+
+/**
+ * \brief unrefs a list of page frames
+ * \param[in] pfindex an array of page-frame indices
+ * \param count the number of array elements
+ * \return the number of page frames that have been released
+ *
+ * In contrast to pmem_unref_frames(), the page frames do not have
+ * to be contiguous. The memory map is locked only once for the whole
+ * list.
+ */
+size_t
+pmem_unref_frame_batch(const unsigned long* pfindex, size_t count);
+
+/**
+ * \brief counts the used page frames in a range
+ * \param pfindex the first page frame
+ * \param nframes the number of page frames
+ * \return the number of page frames with a non-zero reference count
+ *
+ * This function scans the memory map and is meant for statistics.
+ */
+unsigned long
+pmem_count_used_frames(unsigned long pfindex, unsigned long nframes);
+
 const pmem_map_t*
 pmem_get_memmap(void);
 
@@ -0,0 +1,517 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rmap.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "bitset.h"
+#include "semaphore.h"
+
+//
+// rmap_t helpers
+//
+// A single mapping is stored as the address-space id in bits 20 to
+// 30 and the page index in bits 0 to 19. If bit 31 is set, the
+// remaining bits contain the index of the first overflow node.
+//
+
+enum {
+    RMAP_PGINDEX_BITS = 20,
+    RMAP_PGINDEX_MASK = (1 << RMAP_PGINDEX_BITS) - 1,
+    RMAP_CHAINED_BIT  = 31
+};
+
+static rmap_t
+make_entry(rmap_asid_t asid, os_index_t pgindex)
+{
+    return (asid << RMAP_PGINDEX_BITS) | (pgindex & RMAP_PGINDEX_MASK);
+}
+
+static rmap_t
+make_chained_entry(size_t i)
+{
+    return (1ul << RMAP_CHAINED_BIT) | i;
+}
+
+static bool
+is_chained(rmap_t entry)
+{
+    return !!(entry >> RMAP_CHAINED_BIT);
+}
+
+static size_t
+get_chain(rmap_t entry)
+{
+    return entry & ~(1ul << RMAP_CHAINED_BIT);
+}
+
+static rmap_asid_t
+get_asid(rmap_t entry)
+{
+    return entry >> RMAP_PGINDEX_BITS;
+}
+
+static os_index_t
+get_pgindex(rmap_t entry)
+{
+    return entry & RMAP_PGINDEX_MASK;
+}
+
+//
+// RMAP
+//
+
+struct rmap {
+    struct semaphore      sem;
+    rmap_t*               map;
+    const rmap_t*         map_end;
+    struct rmap_chain*    chain;
+    size_t                nchains;
+    uint32_t              free_chain; /**< index+1 of first free node, or 0 */
+    struct bitset_summary asid;
+    bitset_word           asid_word[BITSET_NWORDS(RMAP_NASIDS)];
+    bitset_word           asid_summary[BITSET_SUMMARY_NWORDS(RMAP_NASIDS)];
+    struct vmem*          vmem[RMAP_NASIDS];
+    unsigned short        npins[RMAP_NASIDS]; /**< pins on each vmem */
+
+    /* Detaching waits for the last pin. There's only one detacher
+     * at a time, which waits for 'unpinned' to be signalled. */
+    struct semaphore      detach_sem;
+    struct semaphore      unpinned;
+    rmap_asid_t           detaching;
+};
+
+static size_t
+map_len(const struct rmap* rmap)
+{
+    return rmap->map_end - rmap->map;
+}
+
+static struct rmap g_rmap;
+
+static struct rmap_chain*
+chain_at(uint32_t next)
+{
+    return next ? g_rmap.chain + next - 1 : NULL;
+}
+
+static uint32_t
+chain_next(const struct rmap_chain* node)
+{
+    return node ? node - g_rmap.chain + 1 : 0;
+}
+
+static struct rmap_chain*
+alloc_chain(void)
+{
+    struct rmap_chain* node = chain_at(g_rmap.free_chain);
+    if (!node) {
+        return NULL;
+    }
+    g_rmap.free_chain = node->next;
+
+    memset(node, 0, sizeof(*node));
+
+    return node;
+}
+
+static void
+free_chain(struct rmap_chain* node)
+{
+    node->next = g_rmap.free_chain;
+    g_rmap.free_chain = chain_next(node);
+}
+
+static size_t
+count_chain_entries(const struct rmap_chain* node)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < ARRAY_NELEMS(node->entry); ++i) {
+        n += !!node->entry[i];
+    }
+    return n;
+}
+
+static rmap_t*
+find_chain_entry(struct rmap_chain* node, rmap_t entry)
+{
+    for (size_t i = 0; i < ARRAY_NELEMS(node->entry); ++i) {
+        if (node->entry[i] == entry) {
+            return node->entry + i;
+        }
+    }
+    return NULL;
+}
+
+size_t
+rmap_chain_count(unsigned long nframes)
+{
+    /* Most page frames are mapped at most once; shared frames
+     * are rare enough for one node per four frames. */
+    return (nframes >> 2) + 1;
+}
+
+int
+rmap_init(rmap_t* map, unsigned long nframes,
+          struct rmap_chain* chain, size_t nchains)
+{
+    int res = semaphore_init(&g_rmap.sem, 1);
+    if (res < 0) {
+        return res;
+    }
+
+    res = semaphore_init(&g_rmap.detach_sem, 1);
+    if (res < 0) {
+        goto err_semaphore_init_detach_sem;
+    }
+
+    res = semaphore_init(&g_rmap.unpinned, 0);
+    if (res < 0) {
+        goto err_semaphore_init_unpinned;
+    }
+
+    g_rmap.detaching = RMAP_ASID_NONE;
+
+    g_rmap.map = map;
+    g_rmap.map_end = g_rmap.map + nframes;
+
+    memset(g_rmap.map, 0, map_len(&g_rmap) * sizeof(g_rmap.map[0]));
+
+    g_rmap.chain = chain;
+    g_rmap.nchains = nchains;
+    g_rmap.free_chain = 0;
+
+    for (size_t i = nchains; i; --i) {
+        free_chain(g_rmap.chain + i - 1);
+    }
+
+    /* the first id is reserved for untracked mappings */
+    g_rmap.asid.nbits = RMAP_NASIDS;
+    g_rmap.asid.word = g_rmap.asid_word;
+    g_rmap.asid.summary = g_rmap.asid_summary;
+    bitset_summary_clear(&g_rmap.asid);
+    bitset_summary_set(&g_rmap.asid, RMAP_ASID_NONE);
+
+    return 0;
+
+err_semaphore_init_unpinned:
+    semaphore_uninit(&g_rmap.detach_sem);
+err_semaphore_init_detach_sem:
+    semaphore_uninit(&g_rmap.sem);
+    return res;
+}
+
+int
+rmap_alloc_asid(struct vmem* vmem)
+{
+    semaphore_enter(&g_rmap.sem);
+
+    ssize_t asid = bitset_summary_find_unset(&g_rmap.asid);
+    if (asid < 0) {
+        goto err_bitset_summary_find_unset;
+    }
+
+    bitset_summary_set(&g_rmap.asid, asid);
+    g_rmap.vmem[asid] = vmem;
+
+    semaphore_leave(&g_rmap.sem);
+
+    return asid;
+
+err_bitset_summary_find_unset:
+    semaphore_leave(&g_rmap.sem);
+    return asid;
+}
+
+void
+rmap_free_asid(rmap_asid_t asid)
+{
+    if (asid == RMAP_ASID_NONE || !(asid < RMAP_NASIDS)) {
+        return;
+    }
+
+    semaphore_enter(&g_rmap.sem);
+
+    g_rmap.vmem[asid] = NULL;
+    bitset_summary_unset(&g_rmap.asid, asid);
+
+    semaphore_leave(&g_rmap.sem);
+}
+
+void
+rmap_detach_vmem(rmap_asid_t asid)
+{
+    if (asid == RMAP_ASID_NONE || !(asid < RMAP_NASIDS)) {
+        return;
+    }
+
+    semaphore_enter(&g_rmap.detach_sem);
+    semaphore_enter(&g_rmap.sem);
+
+    g_rmap.vmem[asid] = NULL;
+
+    if (g_rmap.npins[asid]) {
+        /* the last pin signals us */
+        g_rmap.detaching = asid;
+        semaphore_leave(&g_rmap.sem);
+        semaphore_enter(&g_rmap.unpinned);
+        semaphore_enter(&g_rmap.sem);
+        g_rmap.detaching = RMAP_ASID_NONE;
+    }
+
+    semaphore_leave(&g_rmap.sem);
+    semaphore_leave(&g_rmap.detach_sem);
+}
+
+struct vmem*
+rmap_pin_vmem(rmap_asid_t asid)
+{
+    if (!(asid < RMAP_NASIDS)) {
+        return NULL;
+    }
+
+    semaphore_enter(&g_rmap.sem);
+
+    struct vmem* vmem = g_rmap.vmem[asid];
+    if (vmem) {
+        ++g_rmap.npins[asid];
+    }
+
+    semaphore_leave(&g_rmap.sem);
+
+    return vmem;
+}
+
+void
+rmap_unpin_vmem(rmap_asid_t asid)
+{
+    semaphore_enter(&g_rmap.sem);
+
+    if (!--g_rmap.npins[asid] && (asid == g_rmap.detaching)) {
+        semaphore_leave(&g_rmap.unpinned);
+    }
+
+    semaphore_leave(&g_rmap.sem);
+}
+
+int
+rmap_add(unsigned long pfindex, rmap_asid_t asid, os_index_t pgindex)
+{
+    if (asid == RMAP_ASID_NONE) {
+        return 0;
+    } else if (!(pfindex < map_len(&g_rmap))) {
+        return -ENODEV;
+    }
+
+    rmap_t entry = make_entry(asid, pgindex);
+
+    semaphore_enter(&g_rmap.sem);
+
+    int res;
+    rmap_t* head = g_rmap.map + pfindex;
+
+    if (!*head) {
+        /* first mapping is stored in the entry itself */
+        *head = entry;
+        goto out;
+    }
+
+    if (!is_chained(*head)) {
+        /* second mapping; move both into an overflow node */
+        struct rmap_chain* node = alloc_chain();
+        if (!node) {
+            res = -ENOMEM;
+            goto err_alloc_chain;
+        }
+        node->entry[0] = *head;
+        node->entry[1] = entry;
+
+        *head = make_chained_entry(node - g_rmap.chain);
+        goto out;
+    }
+
+    /* find an empty slot in the chain */
+
+    struct rmap_chain* first = g_rmap.chain + get_chain(*head);
+
+    for (struct rmap_chain* node = first; node; node = chain_at(node->next)) {
+        rmap_t* slot = find_chain_entry(node, 0);
+        if (slot) {
+            *slot = entry;
+            goto out;
+        }
+    }
+
+    /* all nodes are full; prepend a new one */
+
+    struct rmap_chain* node = alloc_chain();
+    if (!node) {
+        res = -ENOMEM;
+        goto err_alloc_chain;
+    }
+    node->entry[0] = entry;
+    node->next = chain_next(first);
+
+    *head = make_chained_entry(node - g_rmap.chain);
+
+out:
+    semaphore_leave(&g_rmap.sem);
+
+    return 0;
+
+err_alloc_chain:
+    semaphore_leave(&g_rmap.sem);
+    return res;
+}
+
+void
+rmap_remove(unsigned long pfindex, rmap_asid_t asid, os_index_t pgindex)
+{
+    if (asid == RMAP_ASID_NONE) {
+        return;
+    } else if (!(pfindex < map_len(&g_rmap))) {
+        return;
+    }
+
+    rmap_t entry = make_entry(asid, pgindex);
+
+    semaphore_enter(&g_rmap.sem);
+
+    rmap_t* head = g_rmap.map + pfindex;
+
+    if (!is_chained(*head)) {
+        if (*head == entry) {
+            *head = 0;
+        }
+        goto out;
+    }
+
+    struct rmap_chain* prev = NULL;
+    struct rmap_chain* node = g_rmap.chain + get_chain(*head);
+
+    for (; node; prev = node, node = chain_at(node->next)) {
+        rmap_t* slot = find_chain_entry(node, entry);
+        if (slot) {
+            *slot = 0;
+            break;
+        }
+    }
+
+    if (!node) {
+        goto out; /* mapping not found */
+    }
+
+    if (!count_chain_entries(node)) {
+        /* unlink empty node */
+        if (prev) {
+            prev->next = node->next;
+        } else if (node->next) {
+            *head = make_chained_entry(chain_at(node->next) - g_rmap.chain);
+        } else {
+            *head = 0;
+        }
+        free_chain(node);
+    }
+
+    /* store single remaining mapping in the entry itself */
+
+    if (is_chained(*head)) {
+        struct rmap_chain* first = g_rmap.chain + get_chain(*head);
+
+        if (!first->next && (count_chain_entries(first) == 1)) {
+            for (size_t i = 0; i < ARRAY_NELEMS(first->entry); ++i) {
+                if (first->entry[i]) {
+                    *head = first->entry[i];
+                    break;
+                }
+            }
+            free_chain(first);
+        }
+    }
+
+out:
+    semaphore_leave(&g_rmap.sem);
+}
+
+size_t
+rmap_count(unsigned long pfindex)
+{
+    if (!(pfindex < map_len(&g_rmap))) {
+        return 0;
+    }
+
+    semaphore_enter(&g_rmap.sem);
+
+    size_t n;
+    rmap_t head = g_rmap.map[pfindex];
+
+    if (!is_chained(head)) {
+        n = !!head;
+    } else {
+        n = 0;
+        for (const struct rmap_chain* node = g_rmap.chain + get_chain(head);
+                node;
+                node = chain_at(node->next)) {
+            n += count_chain_entries(node);
+        }
+    }
+
+    semaphore_leave(&g_rmap.sem);
+
+    return n;
+}
+
+int
+rmap_walk(unsigned long pfindex,
+          int (*func)(rmap_asid_t, os_index_t, void*), void* data)
+{
+    if (!(pfindex < map_len(&g_rmap))) {
+        return 0;
+    }
+
+    semaphore_enter(&g_rmap.sem);
+
+    int res = 0;
+    rmap_t head = g_rmap.map[pfindex];
+
+    if (!is_chained(head)) {
+        if (head) {
+            res = func(get_asid(head), get_pgindex(head), data);
+        }
+        goto out;
+    }
+
+    for (const struct rmap_chain* node = g_rmap.chain + get_chain(head);
+            node && !res;
+            node = chain_at(node->next)) {
+        for (size_t i = 0; (i < ARRAY_NELEMS(node->entry)) && !res; ++i) {
+            if (node->entry[i]) {
+                res = func(get_asid(node->entry[i]),
+                           get_pgindex(node->entry[i]), data);
+            }
+        }
+    }
+
+out:
+    semaphore_leave(&g_rmap.sem);
+
+    return res;
+}
@@ -0,0 +1,154 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "page.h"
+
+struct vmem;
+
+/** identifies an address space in the reverse map */
+typedef unsigned int rmap_asid_t;
+
+enum {
+    RMAP_ASID_NONE = 0,     /**< mappings that are not tracked */
+    RMAP_ASID_BITS = 11,
+    RMAP_NASIDS    = 1 << RMAP_ASID_BITS
+};
+
+/**
+ * Represents individual entries in the reverse map. An entry
+ * either holds a single mapping of the page frame, or refers to
+ * a chain of overflow nodes if the page frame is shared.
+ */
+typedef uint32_t rmap_t;
+
+/** overflow node for page frames with multiple mappings */
+struct rmap_chain {
+    rmap_t   entry[3];
+    uint32_t next;
+};
+
+/**
+ * \brief returns the number of overflow nodes for a number of page frames
+ * \param nframes the number of page frames
+ * \return the number of overflow nodes
+ */
+size_t
+rmap_chain_count(unsigned long nframes);
+
+/**
+ * \brief init the reverse map
+ * \param[in] map the per-frame entries
+ * \param nframes the number of page frames
+ * \param[in] chain the overflow nodes
+ * \param nchains the number of overflow nodes
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+rmap_init(rmap_t* map, unsigned long nframes,
+          struct rmap_chain* chain, size_t nchains);
+
+/**
+ * \brief allocates an address-space id
+ * \param[in] vmem the address space
+ * \return the address-space id, or a negative error code otherwise
+ */
+int
+rmap_alloc_asid(struct vmem* vmem);
+
+/**
+ * \brief releases an address-space id
+ * \param asid the address-space id
+ */
+void
+rmap_free_asid(rmap_asid_t asid);
+
+/**
+ * \brief detaches an address space from its address-space id
+ * \param asid the address-space id
+ *
+ * Afterwards, rmap_pin_vmem() returns NULL for the id. The function
+ * waits until all pins have been released, so the caller can tear
+ * down the address space. Call rmap_free_asid() after the address
+ * space's mappings have been removed.
+ */
+void
+rmap_detach_vmem(rmap_asid_t asid);
+
+/**
+ * \brief returns the address space of an address-space id
+ * \param asid the address-space id
+ * \return the address space, or NULL if none
+ *
+ * The address space stays valid until the pin is released with
+ * rmap_unpin_vmem(). Don't hold a pin while waiting for an address
+ * space's lock that is held by its owner across rmap_detach_vmem().
+ */
+struct vmem*
+rmap_pin_vmem(rmap_asid_t asid);
+
+/**
+ * \brief releases a pin on an address space
+ * \param asid the address-space id
+ */
+void
+rmap_unpin_vmem(rmap_asid_t asid);
+
+/**
+ * \brief records a mapping of a page frame
+ * \param pfindex the page frame
+ * \param asid the address space of the mapping
+ * \param pgindex the page of the mapping
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+rmap_add(unsigned long pfindex, rmap_asid_t asid, os_index_t pgindex);
+
+/**
+ * \brief removes a recorded mapping of a page frame
+ * \param pfindex the page frame
+ * \param asid the address space of the mapping
+ * \param pgindex the page of the mapping
+ */
+void
+rmap_remove(unsigned long pfindex, rmap_asid_t asid, os_index_t pgindex);
+
+/**
+ * \brief returns the number of recorded mappings of a page frame
+ * \param pfindex the page frame
+ * \return the number of mappings
+ */
+size_t
+rmap_count(unsigned long pfindex);
+
+/**
+ * \brief calls a function for each mapping of a page frame
+ * \param pfindex the page frame
+ * \param func the callback function
+ * \param[in] data the user data for the callback function
+ * \return 0 on success, or the first non-zero return value of func
+ *
+ * The reverse map is locked while walking the mappings, so the
+ * callback function must not modify the reverse map.
+ */
+int
+rmap_walk(unsigned long pfindex,
+          int (*func)(rmap_asid_t, os_index_t, void*), void* data);
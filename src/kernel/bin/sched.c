@@ -30,6 +30,10 @@
  *  - first determines the highest priority class with runnable threads, and
  *  - schedules the threads in round-robin order with fixed time slices.
  *
+ * The scheduler's alarm only runs while threads other than the idle
+ * thread are runnable. An idle system takes no timer interrupts for
+ * scheduling.
+ *
  * \todo Current many scheduler function receive the current CPU's index as
  *       parameter. This can lead to problems when the thread is migrated
  *       between two depended calls. A possible solution is to never migrate
@@ -37,15 +41,19 @@
  *       pin the thread to a specific CPU during the critical phase.
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_SCHED
+
 #include "sched.h"
 #include <stddef.h>
 #include <string.h>
 #include "assert.h"
-#include "console.h"
 #include "cpu.h"
+#include "interupt.h"
+#include "log.h"
 #include "task.h"
 #include "tcb.h"
 #include "timer.h"
+#include "trace.h"
 
 /**
  * \brief current list head in thread list, one per priority class
@@ -53,15 +61,82 @@
  */
 static struct list g_thread[SCHED_NPRIOS];
 
+enum {
+    SCHED_THREAD_HASH_BITS = 6
+};
+
+/**
+ * \brief all scheduled threads, hashed by task and thread id
+ * \internal
+ */
+static struct hlist_head g_thread_hash[1 << SCHED_THREAD_HASH_BITS];
+
+static struct hlist_head*
+thread_hash_head(unsigned int taskid, unsigned char tcbid)
+{
+    unsigned long key = (taskid << 8) | tcbid;
+
+    /* multiplicative hashing with the golden ratio */
+    return g_thread_hash +
+           ((key * 0x9e3779b1ul) >> (32 - SCHED_THREAD_HASH_BITS));
+}
+
 /**
  * \brief TCB of the currently scheduled thread on each CPU
  */
 static struct tcb* g_current_thread[SCHED_NCPUS];
 
+/**
+ * \brief set if a CPU should switch threads on interrupt exit
+ */
+static bool g_need_resched[SCHED_NCPUS];
+
 static timeout_t
 sched_timeout(void)
 {
-    return 1000 / SCHED_FREQ;
+    return S_TO_NS(1) / SCHED_FREQ;
+}
+
+/**
+ * \brief test for runnable threads besides the idle thread
+ * \internal
+ */
+static bool
+has_runnable_threads(void)
+{
+    for (size_t i = ARRAY_NELEMS(g_thread); i > 1;) {
+        --i;
+
+        struct list* listhead;
+
+        list_foreach(listhead, g_thread + i) {
+            if (tcb_is_runnable(tcb_of_sched_list(listhead))) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static struct alarm g_alarm;
+
+/* true while g_alarm is enqueued or about to be re-enqueued */
+static bool g_alarm_armed;
+
+static void
+arm_alarm(void)
+{
+    if (g_alarm_armed) {
+        return;
+    }
+
+    int res = timer_add_alarm(&g_alarm, sched_timeout());
+    if (res < 0) {
+        return;
+    }
+
+    g_alarm_armed = true;
 }
 
 /**
@@ -71,12 +146,16 @@ sched_timeout(void)
 static timeout_t
 alarm_handler(struct alarm* alarm)
 {
-    sched_switch(cpuid());
+    /* Once only the idle thread is left, we stop the alarm. The
+     * next switch to another thread re-arms it. */
+    bool rearm = has_runnable_threads();
+    g_alarm_armed = rearm;
 
-    return sched_timeout();
-}
+    /* We run in softirq context; switch on interrupt exit. */
+    sched_set_need_resched(cpuid());
 
-static struct alarm g_alarm;
+    return rearm ? sched_timeout() : 0;
+}
 
 /**
  * \brief init scheduler
@@ -93,6 +172,7 @@ sched_init(struct tcb* idle)
 
     for (size_t i = 0; i < ARRAY_NELEMS(g_current_thread); ++i) {
         g_current_thread[i] = idle;
+        g_need_resched[i] = false;
     }
 
     for (size_t i = 0; i < ARRAY_NELEMS(g_thread); ++i) {
@@ -100,13 +180,9 @@ sched_init(struct tcb* idle)
     }
 
     alarm_init(&g_alarm, alarm_handler);
+    g_alarm_armed = false;
 
-    int res = timer_add_alarm(&g_alarm, sched_timeout());
-    if (res < 0) {
-        goto err_timer_add_alarm;
-    }
-
-    res = sched_add_thread(idle, 0);
+    int res = sched_add_thread(idle, 0);
     if (res < 0) {
         goto err_sched_add_thread;
     }
@@ -114,8 +190,6 @@ sched_init(struct tcb* idle)
     return 0;
 
 err_sched_add_thread:
-    timer_remove_alarm(&g_alarm);
-err_timer_add_alarm:
     for (size_t i = ARRAY_NELEMS(g_current_thread); i;) {
         --i;
         g_current_thread[i] = NULL;
@@ -132,14 +206,36 @@ err_timer_add_alarm:
 int
 sched_add_thread(struct tcb* tcb, prio_class_type prio)
 {
-    console_printf("%s:%x adding tcb=%x, prio=%x.\n", __FILE__, __LINE__, tcb, prio);
+    pr_debug("sched: adding tcb=%p, prio=%d.\n", tcb, prio);
 
     list_enqueue_back(g_thread + prio, &tcb->sched);
     tcb->prio = prio;
 
+    hlist_add_head(thread_hash_head(tcb->task->id, tcb->id), &tcb->sched_hash);
+
     return 0;
 }
 
+/**
+ * \brief remove a thread from the scheduler
+ * \param[in] tcb the thread
+ *
+ * \attention The thread must not be running on any CPU.
+ */
+void
+sched_remove_thread(struct tcb* tcb)
+{
+    bool int_enabled = cli_if_on();
+
+    list_dequeue(&tcb->sched);
+
+    if (!hlist_is_unhashed(&tcb->sched_hash)) {
+        hlist_remove(&tcb->sched_hash);
+    }
+
+    sti_if_on(int_enabled);
+}
+
 /**
  * \brief return the thread that is currently scheduled on the CPU
  * \param cpu the CPU on which the thread is running
@@ -162,22 +258,14 @@ sched_get_current_thread(unsigned int cpu)
 struct tcb*
 sched_search_thread(unsigned int taskid, unsigned char tcbid)
 {
-    const struct list* cur_prio = g_thread;
-    const struct list* end_prio = cur_prio + ARRAY_NELEMS(g_thread);
+    struct hlist_node* node;
 
-    while (cur_prio < end_prio) {
-        struct list* listhead = list_begin(cur_prio);
-
-        while (listhead != list_end(cur_prio)) {
-            struct tcb* tcb = tcb_of_sched_list(listhead);
+    hlist_foreach(node, thread_hash_head(taskid, tcbid)) {
+        struct tcb* tcb = containerof(node, struct tcb, sched_hash);
 
-            if ((tcb->id == tcbid) && (tcb->task->id == taskid)) {
-                return tcb;
-            }
-            listhead = list_next(listhead);
+        if ((tcb->id == tcbid) && (tcb->task->id == taskid)) {
+            return tcb;
         }
-
-        ++cur_prio;
     }
 
     return NULL;
@@ -208,12 +296,18 @@ sched_switch_to(unsigned int cpu, struct tcb* next)
      * ready list, so we don't select it over and over again. */
     move_thread_to_back(next);
 
+    if (next->prio) {
+        arm_alarm(); /* time slices for threads besides idle */
+    }
+
     struct tcb* self = g_current_thread[cpu];
 
     if (next == self) {
 		return 0; /* nothing to do if we're switching to the same thread */
 	}
 
+    trace_event(TRACE_SCHED_SWITCH, self, next, next->prio);
+
     /* Calling tcb_switch() means scheduling another thread, We set
      * the new thread as the current one _before_ switching, or it
      * won't know it's own TCB structure otherwise. */
@@ -285,3 +379,59 @@ sched_switch(unsigned int cpu)
 
     return 0;
 }
+
+/**
+ * \brief request a thread switch on interrupt exit
+ * \param cpu the CPU that should switch threads
+ */
+void
+sched_set_need_resched(unsigned int cpu)
+{
+    assert(cpu < ARRAY_NELEMS(g_need_resched));
+
+    g_need_resched[cpu] = true;
+}
+
+/**
+ * \brief switch threads if requested
+ * \param cpu the CPU on which the thread is running
+ *
+ * Call this function on interrupt exit and from other places where
+ * it is safe to switch threads.
+ */
+void
+sched_resched_if_needed(unsigned int cpu)
+{
+    assert(cpu < ARRAY_NELEMS(g_need_resched));
+
+    bool ints_on = cli_if_on();
+
+    bool need_resched = g_need_resched[cpu];
+    g_need_resched[cpu] = false;
+
+    sti_if_on(ints_on);
+
+    if (need_resched) {
+        sched_switch(cpu);
+    }
+}
+
+/**
+ * \brief runs the idle thread's loop body
+ *
+ * The idle thread halts the CPU until an interrupt arrives, unless
+ * other threads are runnable. Then it switches to them.
+ */
+void
+sched_idle()
+{
+    cli();
+
+    if (!has_runnable_threads()) {
+        sti_hlt(); /* wait for an interrupt */
+    } else {
+        sti();
+    }
+
+    sched_switch(cpuid());
+}
@@ -39,6 +39,9 @@ sched_init(struct tcb* idle);
 int
 sched_add_thread(struct tcb* tcb, prio_class_type prio);
 
+void
+sched_remove_thread(struct tcb* tcb);
+
 struct tcb*
 sched_get_current_thread(unsigned int cpu);
 
@@ -50,3 +53,12 @@ sched_switch_to(unsigned int cpu, struct tcb* next);
 
 int
 sched_switch(unsigned int cpu);
+
+void
+sched_set_need_resched(unsigned int cpu);
+
+void
+sched_resched_if_needed(unsigned int cpu);
+
+void
+sched_idle(void);
@@ -29,6 +29,14 @@ struct semaphore
         struct list     waiters; /**< Waiter-list head */
 };
 
+/** \brief static initializer for a semaphore */
+#define SEMAPHORE_INITIALIZER(sem_, slots_)                     \
+        {                                                       \
+                .lock = 0,                                      \
+                .slots = (slots_),                              \
+                .waiters = LIST_HEAD_INITIALIZER((sem_).waiters) \
+        }
+
 int
 semaphore_init(struct semaphore *sem, unsigned long slots);
 
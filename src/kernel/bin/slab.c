@@ -0,0 +1,271 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "slab.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "alloc.h"
+#include "page.h"
+
+struct slab {
+    struct slab_cache* cache; /**< must be the first field */
+    struct list        list;
+    unsigned short     nfree;
+    unsigned short     free[]; /**< stack of free object indices */
+};
+
+static struct slab*
+slab_of_list(struct list* l)
+{
+    return containerof(l, struct slab, list);
+}
+
+static size_t
+align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static void
+compute_layout(struct slab_cache* cache)
+{
+    cache->stride = align_up(cache->size, cache->align);
+
+    size_t n = (PAGE_SIZE - sizeof(struct slab)) /
+               (cache->stride + sizeof(((struct slab*)0)->free[0]));
+
+    size_t offset;
+
+    do {
+        offset = align_up(sizeof(struct slab) +
+                          n * sizeof(((struct slab*)0)->free[0]),
+                          cache->align);
+    } while (n && ((offset + n * cache->stride) > PAGE_SIZE) && --n);
+
+    cache->offset = offset;
+    cache->nobjs = n;
+    cache->initialized = true;
+}
+
+static void*
+slab_object(const struct slab_cache* cache, struct slab* slab, size_t i)
+{
+    return ((uint8_t*)slab) + cache->offset + i * cache->stride;
+}
+
+static struct slab*
+slab_of_object(const void* obj)
+{
+    return page_address(page_index(obj));
+}
+
+static struct slab*
+create_slab(struct slab_cache* cache)
+{
+    struct slab* slab = kmalloc_pages(1);
+    if (!slab) {
+        return NULL;
+    }
+
+    slab->cache = cache;
+    list_init_item(&slab->list);
+    slab->nfree = cache->nobjs;
+
+    /* hand out objects in order of their addresses */
+    for (size_t i = 0; i < cache->nobjs; ++i) {
+        slab->free[i] = cache->nobjs - i - 1;
+    }
+
+    if (cache->ctor) {
+        for (size_t i = 0; i < cache->nobjs; ++i) {
+            cache->ctor(slab_object(cache, slab, i));
+        }
+    }
+
+    return slab;
+}
+
+static void
+destroy_slab(struct slab* slab)
+{
+    kfree_pages(slab, 1);
+}
+
+static size_t
+trim_empty_slabs(struct slab_cache* cache, size_t max_empty)
+{
+    size_t n = 0;
+
+    for (; cache->nempty > max_empty; --cache->nempty, --cache->nslabs, ++n) {
+        struct slab* slab = slab_of_list(list_last(&cache->empty));
+        list_dequeue(&slab->list);
+        destroy_slab(slab);
+    }
+
+    return n;
+}
+
+int
+slab_cache_init(struct slab_cache* cache, size_t size, size_t align,
+                void (*ctor)(void*))
+{
+    if (!align || (align & (align - 1))) {
+        return -EINVAL;
+    }
+
+    int res = semaphore_init(&cache->sem, 1);
+    if (res < 0) {
+        return res;
+    }
+
+    cache->size = size;
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->max_empty = SLAB_CACHE_MAX_EMPTY;
+    cache->initialized = false;
+
+    list_init_head(&cache->partial);
+    list_init_head(&cache->full);
+    list_init_head(&cache->empty);
+
+    cache->nslabs = 0;
+    cache->nempty = 0;
+    cache->nused = 0;
+
+    return 0;
+}
+
+void*
+slab_cache_alloc(struct slab_cache* cache)
+{
+    semaphore_enter(&cache->sem);
+
+    if (!cache->initialized) {
+        compute_layout(cache);
+    }
+
+    struct slab* slab;
+
+    if (!list_is_empty(&cache->partial)) {
+        slab = slab_of_list(list_first(&cache->partial));
+    } else if (!list_is_empty(&cache->empty)) {
+        slab = slab_of_list(list_first(&cache->empty));
+        --cache->nempty;
+    } else if (cache->nobjs) {
+        slab = create_slab(cache);
+        if (!slab) {
+            goto err_create_slab;
+        }
+        ++cache->nslabs;
+    } else {
+        goto err_nobjs; /* object larger than a slab */
+    }
+
+    void* obj = slab_object(cache, slab, slab->free[--slab->nfree]);
+    ++cache->nused;
+
+    list_dequeue(&slab->list);
+
+    if (slab->nfree) {
+        list_enqueue_front(&cache->partial, &slab->list);
+    } else {
+        list_enqueue_front(&cache->full, &slab->list);
+    }
+
+    semaphore_leave(&cache->sem);
+
+    return obj;
+
+err_nobjs:
+err_create_slab:
+    semaphore_leave(&cache->sem);
+    return NULL;
+}
+
+struct slab_cache*
+slab_cache_of_object(const void* obj)
+{
+    return slab_of_object(obj)->cache;
+}
+
+void
+slab_cache_free(struct slab_cache* cache, void* obj)
+{
+    struct slab* slab = slab_of_object(obj);
+
+    size_t i = ((uint8_t*)obj - (uint8_t*)slab_object(cache, slab, 0)) /
+               cache->stride;
+
+    semaphore_enter(&cache->sem);
+
+    slab->free[slab->nfree++] = i;
+    --cache->nused;
+
+    list_dequeue(&slab->list);
+
+    if (slab->nfree < cache->nobjs) {
+        list_enqueue_front(&cache->partial, &slab->list);
+    } else if (cache->nempty < cache->max_empty) {
+        /* keep empty slab for later allocations */
+        list_enqueue_front(&cache->empty, &slab->list);
+        ++cache->nempty;
+    } else {
+        /* return memory above watermark */
+        destroy_slab(slab);
+        --cache->nslabs;
+    }
+
+    semaphore_leave(&cache->sem);
+}
+
+void
+slab_cache_set_watermark(struct slab_cache* cache, size_t max_empty)
+{
+    semaphore_enter(&cache->sem);
+
+    cache->max_empty = max_empty;
+    trim_empty_slabs(cache, max_empty);
+
+    semaphore_leave(&cache->sem);
+}
+
+size_t
+slab_cache_shrink(struct slab_cache* cache)
+{
+    semaphore_enter(&cache->sem);
+
+    size_t n = trim_empty_slabs(cache, 0);
+
+    semaphore_leave(&cache->sem);
+
+    return n;
+}
+
+void
+slab_cache_get_stats(struct slab_cache* cache, struct slab_cache_stats* stats)
+{
+    semaphore_enter(&cache->sem);
+
+    stats->nslabs = cache->nslabs;
+    stats->nempty = cache->nempty;
+    stats->nused = cache->nused;
+    stats->nobjs = cache->nobjs;
+
+    semaphore_leave(&cache->sem);
+}
@@ -0,0 +1,156 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "list.h"
+#include "semaphore.h"
+
+enum {
+    /** \brief default alignment of objects */
+    SLAB_CACHE_LINE_SIZE = 64,
+    /** \brief default number of empty slabs kept by a cache */
+    SLAB_CACHE_MAX_EMPTY = 2
+};
+
+/**
+ * A slab cache hands out objects of a single type. Objects are
+ * packed into page-sized slabs. Each slab starts with a header
+ * that holds a stack of the slab's free objects.
+ */
+struct slab_cache {
+    struct semaphore sem;
+    size_t           size;  /**< object size */
+    size_t           align; /**< object alignment */
+    void           (*ctor)(void*);
+    size_t           max_empty; /**< empty slabs to keep for reuse */
+
+    /* filled in on first use */
+    bool             initialized;
+    size_t           stride;  /**< distance between objects */
+    size_t           offset;  /**< offset of first object in slab */
+    size_t           nobjs;   /**< objects per slab */
+
+    struct list      partial; /**< slabs with used and free objects */
+    struct list      full;    /**< slabs without free objects */
+    struct list      empty;   /**< slabs without used objects */
+
+    /* statistics */
+    size_t           nslabs;  /**< number of slabs */
+    size_t           nempty;  /**< number of empty slabs */
+    size_t           nused;   /**< number of allocated objects */
+};
+
+/** statistics of a slab cache */
+struct slab_cache_stats {
+    size_t nslabs; /**< number of slabs, one page each */
+    size_t nempty; /**< number of empty slabs */
+    size_t nused;  /**< number of allocated objects */
+    size_t nobjs;  /**< number of objects per slab */
+};
+
+/**
+ * \brief static initializer for slab caches
+ * \param cache_ the slab-cache variable
+ * \param type_ the object type
+ * \param ctor_ the constructor for new objects, or NULL
+ */
+#define SLAB_CACHE_INITIALIZER(cache_, type_, ctor_)            \
+    {                                                           \
+        .sem = SEMAPHORE_INITIALIZER((cache_).sem, 1),          \
+        .size = sizeof(type_),                                  \
+        .align = SLAB_CACHE_LINE_SIZE,                          \
+        .ctor = (ctor_),                                        \
+        .max_empty = SLAB_CACHE_MAX_EMPTY,                      \
+        .initialized = false,                                   \
+        .partial = LIST_HEAD_INITIALIZER((cache_).partial),     \
+        .full = LIST_HEAD_INITIALIZER((cache_).full),           \
+        .empty = LIST_HEAD_INITIALIZER((cache_).empty)          \
+    }
+
+/**
+ * \brief init a slab cache at runtime
+ * \param[out] cache the slab cache
+ * \param size the object size
+ * \param align the object alignment, must be a power of two
+ * \param ctor the constructor for new objects, or NULL
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+slab_cache_init(struct slab_cache* cache, size_t size, size_t align,
+                void (*ctor)(void*));
+
+/**
+ * \brief allocates an object
+ * \param[in] cache the slab cache
+ * \return the object, or NULL if out of memory
+ *
+ * New slabs are filled with constructed objects. Objects are
+ * returned in the state in which they were freed.
+ */
+void*
+slab_cache_alloc(struct slab_cache* cache);
+
+/**
+ * \brief sets the number of empty slabs kept by a cache
+ * \param[in] cache the slab cache
+ * \param max_empty the maximum number of empty slabs
+ *
+ * Empty slabs beyond the watermark are released immediately.
+ */
+void
+slab_cache_set_watermark(struct slab_cache* cache, size_t max_empty);
+
+/**
+ * \brief releases all empty slabs
+ * \param[in] cache the slab cache
+ * \return the number of released pages
+ */
+size_t
+slab_cache_shrink(struct slab_cache* cache);
+
+/**
+ * \brief reads the statistics of a slab cache
+ * \param[in] cache the slab cache
+ * \param[out] stats the statistics
+ */
+void
+slab_cache_get_stats(struct slab_cache* cache, struct slab_cache_stats* stats);
+
+/**
+ * \brief returns the slab cache of an object
+ * \param[in] obj the object
+ * \return the slab cache
+ *
+ * The cache is read from the first word of the object's page. Other
+ * page-backed allocations can be told apart from slabs by storing
+ * NULL in this word.
+ */
+struct slab_cache*
+slab_cache_of_object(const void* obj);
+
+/**
+ * \brief releases an object
+ * \param[in] cache the slab cache
+ * \param[in] obj the object
+ */
+void
+slab_cache_free(struct slab_cache* cache, void* obj);
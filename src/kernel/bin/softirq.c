@@ -0,0 +1,269 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "softirq.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include "bitset.h"
+#include "console.h"
+#include "cpu.h"
+#include "interupt.h"
+#include "sched.h"
+#include "tcb.h"
+#include "tcbhlp.h"
+
+enum {
+    /** \brief rounds on interrupt exit before deferring to the worker */
+    SOFTIRQ_MAX_ROUNDS = 4,
+    /** \brief priority of the worker thread */
+    SOFTIRQ_THREAD_PRIO = 128
+};
+
+static void (*g_softirq_handler[SOFTIRQ_NR])(void);
+
+struct softirq_cpu {
+    bitset_word     pending; /* \attention Do not write with interupts enabled! */
+    bool            running;
+    struct tcb*     worker;
+    struct list     tasklets;
+};
+
+static struct softirq_cpu g_softirq_cpu[SCHED_NCPUS];
+
+void
+softirq_set_handler(enum softirq_nr nr, void (*func)(void))
+{
+    assert(nr < SOFTIRQ_NR);
+
+    g_softirq_handler[nr] = func;
+}
+
+void
+softirq_raise(enum softirq_nr nr)
+{
+    assert(nr < SOFTIRQ_NR);
+
+    bool ints_on = cli_if_on();
+    g_softirq_cpu[cpuid()].pending |= 1ul << nr;
+    sti_if_on(ints_on);
+}
+
+/* Call with interrupts disabled; returns with interrupts disabled. */
+static void
+run_pending(struct softirq_cpu* sc)
+{
+    bitset_word pending = sc->pending;
+    sc->pending = 0;
+
+    sti();
+
+    while (pending) {
+        int nr = bitset_word_first(pending);
+        pending &= ~(1ul << nr);
+
+        if (g_softirq_handler[nr]) {
+            g_softirq_handler[nr]();
+        }
+    }
+
+    cli();
+}
+
+static void
+wake_worker(struct softirq_cpu* sc)
+{
+    if (sc->worker && (tcb_get_state(sc->worker) == THREAD_STATE_WAITING)) {
+        tcb_set_state(sc->worker, THREAD_STATE_READY);
+    }
+}
+
+bool
+softirq_run()
+{
+    bool ints_on = cli_if_on();
+
+    struct softirq_cpu* sc = g_softirq_cpu + cpuid();
+
+    bool outermost = !sc->running;
+
+    if (outermost) {
+
+        sc->running = true;
+
+        for (int i = 0; sc->pending && (i < SOFTIRQ_MAX_ROUNDS); ++i) {
+            run_pending(sc);
+        }
+
+        sc->running = false;
+
+        if (sc->pending) {
+            /* under load; leave the rest to the worker */
+            wake_worker(sc);
+        }
+    }
+
+    sti_if_on(ints_on);
+
+    return outermost;
+}
+
+static void
+worker_func(struct tcb* self)
+{
+    struct softirq_cpu* sc = g_softirq_cpu + cpuid();
+
+    for (;;) {
+        cli();
+
+        if (!sc->pending || sc->running) {
+            tcb_set_state(self, THREAD_STATE_WAITING);
+            sti();
+            sched_switch(cpuid());
+            continue;
+        }
+
+        sc->running = true;
+        run_pending(sc);
+        sc->running = false;
+
+        sti();
+
+        sched_resched_if_needed(cpuid());
+    }
+}
+
+int
+softirq_init_thread(struct task* task)
+{
+    struct tcb* tcb;
+
+    int res = tcb_helper_allocate_tcb_and_stack(task, 1, &tcb);
+    if (res < 0) {
+        console_perror("tcb_helper_allocate_tcb_and_stack", -res);
+        return res;
+    }
+
+    res = tcb_helper_run_kernel_thread(tcb, worker_func);
+    if (res < 0) {
+        console_perror("tcb_helper_run_kernel_thread", -res);
+        goto err_tcb_helper_run_kernel_thread;
+    }
+
+    tcb_set_state(tcb, THREAD_STATE_WAITING);
+
+    res = sched_add_thread(tcb, SOFTIRQ_THREAD_PRIO);
+    if (res < 0) {
+        console_perror("sched_add_thread", -res);
+        goto err_sched_add_thread;
+    }
+
+    g_softirq_cpu[cpuid()].worker = tcb;
+
+    return 0;
+
+err_sched_add_thread:
+err_tcb_helper_run_kernel_thread:
+    tcb_helper_free_tcb(tcb);
+    return res;
+}
+
+/*
+ * Tasklets
+ */
+
+static struct tasklet*
+tasklet_of_list(struct list* item)
+{
+    return containerof(item, struct tasklet, list);
+}
+
+static void
+run_tasklets(void)
+{
+    struct softirq_cpu* sc = g_softirq_cpu + cpuid();
+
+    /* take the current tasklets; new ones go into the next round */
+
+    struct list tasklets;
+    list_init_head(&tasklets);
+
+    bool ints_on = cli_if_on();
+    list_splice_back(&tasklets, &sc->tasklets);
+    sti_if_on(ints_on);
+
+    while (!list_is_empty(&tasklets)) {
+        struct tasklet* tasklet = tasklet_of_list(list_first(&tasklets));
+        list_dequeue(&tasklet->list);
+
+        ints_on = cli_if_on();
+        tasklet->scheduled = false;
+        sti_if_on(ints_on);
+
+        tasklet->func(tasklet);
+    }
+}
+
+void
+tasklet_init(struct tasklet* tasklet, void (*func)(struct tasklet*))
+{
+    assert(tasklet);
+    assert(func);
+
+    list_init_item(&tasklet->list);
+    tasklet->func = func;
+    tasklet->scheduled = false;
+}
+
+void
+tasklet_schedule(struct tasklet* tasklet)
+{
+    assert(tasklet);
+
+    bool ints_on = cli_if_on();
+
+    if (!tasklet->scheduled) {
+
+        struct softirq_cpu* sc = g_softirq_cpu + cpuid();
+
+        list_enqueue_back(&sc->tasklets, &tasklet->list);
+        tasklet->scheduled = true;
+
+        softirq_raise(SOFTIRQ_TASKLET);
+    }
+
+    sti_if_on(ints_on);
+}
+
+/*
+ * Initialization
+ */
+
+void
+softirq_init()
+{
+    for (size_t i = 0; i < ARRAY_NELEMS(g_softirq_cpu); ++i) {
+        g_softirq_cpu[i].pending = 0;
+        g_softirq_cpu[i].running = false;
+        g_softirq_cpu[i].worker = NULL;
+        list_init_head(&g_softirq_cpu[i].tasklets);
+    }
+
+    softirq_set_handler(SOFTIRQ_TASKLET, run_tasklets);
+}
@@ -0,0 +1,103 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "list.h"
+
+struct task;
+
+/*
+ * Softirqs run deferred interrupt work. Interrupt handlers only
+ * acknowledge their device and raise a softirq. Pending softirqs
+ * run on interrupt exit with interrupts enabled. If they keep being
+ * raised, the remaining work moves to a kernel worker thread, which
+ * is scheduled like any other thread.
+ *
+ * Softirq handlers and tasklets must not block or switch threads.
+ * Set the scheduler's need-resched flag instead.
+ */
+
+enum softirq_nr {
+    SOFTIRQ_TIMER = 0,
+    SOFTIRQ_TASKLET,
+    SOFTIRQ_NR
+};
+
+/**
+ * \brief init softirq handling
+ */
+void
+softirq_init(void);
+
+/**
+ * \brief sets the handler of a softirq
+ * \param nr the softirq
+ * \param func the handler function
+ */
+void
+softirq_set_handler(enum softirq_nr nr, void (*func)(void));
+
+/**
+ * \brief marks a softirq as pending on the current CPU
+ * \param nr the softirq
+ */
+void
+softirq_raise(enum softirq_nr nr);
+
+/**
+ * \brief runs pending softirqs
+ * \return false if softirqs were already running on this CPU, or
+ *         true otherwise
+ *
+ * Called on interrupt exit. Returns immediately if softirqs are
+ * already running on this CPU. The interrupt then arrived while
+ * they ran with interrupts enabled, so the caller must not switch
+ * threads.
+ */
+bool
+softirq_run(void);
+
+/**
+ * \brief starts the softirq worker thread
+ * \param[in] task the kernel task
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+softirq_init_thread(struct task* task);
+
+/**
+ * A tasklet is a one-time piece of deferred work. Scheduling an
+ * already scheduled tasklet has no effect.
+ */
+struct tasklet {
+    struct list list;
+    void      (*func)(struct tasklet*);
+    bool        scheduled;
+};
+
+void
+tasklet_init(struct tasklet* tasklet, void (*func)(struct tasklet*));
+
+/**
+ * \brief runs a tasklet from the softirq on the current CPU
+ * \param[in] tasklet the tasklet
+ */
+void
+tasklet_schedule(struct tasklet* tasklet);
@@ -17,14 +17,16 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_SYSCALL
+
 #include "syscall.h"
 #include <errno.h>
 #include <string.h>
 #include <syscall_consts.h>
 #include <tid.h>
-#include "console.h"
 #include "cpu.h"
 #include "ipc.h"
+#include "log.h"
 #include "ipcmsg.h"
 #include "sched.h"
 #include "tcb.h"
@@ -49,15 +51,16 @@ syscall_entry_handler(unsigned long *tid,
                 [SYSCALL_OP_SEND]           = ipc_send,
                 [SYSCALL_OP_SEND_AND_WAIT]  = ipc_send_and_wait,
                 [SYSCALL_OP_RECV]           = ipc_recv,
-                [SYSCALL_OP_REPLY_AND_RECV] = ipc_reply_and_recv
+                [SYSCALL_OP_REPLY_AND_RECV] = ipc_reply_and_recv,
+                [SYSCALL_OP_UNMAP]          = ipc_unmap
         };
 
         int err;
         struct tcb *snd, *rcv;
         enum syscall_op op;
 
-        console_printf("%s:%x: tid=%x flags=%x msg0=%x msg1=%x<\n", __FILE__,
-                       __LINE__, *tid, *flags, *msg0, *msg1);
+        pr_debug("syscall: tid=%#lx flags=%#lx msg0=%#lx msg1=%#lx\n",
+                 *tid, *flags, *msg0, *msg1);
 
         op = syscall_get_op(*flags);
 
@@ -78,12 +81,15 @@ syscall_entry_handler(unsigned long *tid,
         }
 
         /*
-         * get receiver thread
+         * get receiver thread; unmapping only affects the sender
          */
 
-        rcv = sched_search_thread(threadid_get_taskid(R0_THREADID(*tid)),
-                                  threadid_get_tcbid(R0_THREADID(*tid)));
-        if (!rcv)
+        if (op == SYSCALL_OP_UNMAP)
+        {
+                rcv = NULL;
+        }
+        else if (!(rcv = sched_search_thread(threadid_get_taskid(R0_THREADID(*tid)),
+                                             threadid_get_tcbid(R0_THREADID(*tid)))))
         {
                 err = -EAGAIN;
                 goto err_sched_search_thread;
@@ -21,7 +21,9 @@
 #include "console.h"
 #include "cpu.h"
 #include "loader.h"
+#include "log.h"
 #include "sched.h"
+#include "softirq.h"
 #include "syssrv.h"
 #include "taskhlp.h"
 #include "tcb.h"
@@ -84,10 +86,26 @@ schedule_kernel_threads(struct vmem* vmem, void* stack, struct task** task_out)
         goto err_sched_add_thread;
     }
 
+    /* create worker thread for deferred interupt work */
+
+    res = softirq_init_thread(task);
+    if (res < 0) {
+        goto err_softirq_init_thread;
+    }
+
+    /* create thread for draining the kernel log */
+
+    res = log_init_thread(task);
+    if (res < 0) {
+        goto err_log_init_thread;
+    }
+
     *task_out = task;
 
     return 0;
 
+err_log_init_thread:
+err_softirq_init_thread:
 err_sched_add_thread:
 err_tcb_helper_run_kernel_thread:
 err_tcb_helper_allocate_tcb_and_stack:
@@ -104,7 +122,7 @@ execute_module(struct task* parent, uintptr_t start, size_t len,
     if (name) {
         console_printf("loading module '\%s'\n", name);
     } else {
-        console_printf("loading module at address 0x%x\n", start);
+        console_printf("loading module at address %#lx\n", (unsigned long)start);
     }
 
     /* allocate task */
@@ -154,16 +172,16 @@ execute_module(struct task* parent, uintptr_t start, size_t len,
         goto err_sched_add_thread;
     }
 
-    console_printf("scheduled as %x.\n", res);
+    console_printf("scheduled as %d.\n", res);
 
     return 0;
 
 err_sched_add_thread:
 err_tcb_helper_run_user_thread:
 err_loader_exec:
-    /* FIXME: free tcb */
+    tcb_helper_free_tcb(tcb);
 err_tcb_helper_allocate_tcb_and_stack:
-    /* FIXME: free task */
+    task_helper_free_task(task);
 err_task_helper_allocate_task_from_parent:
     return res;
 }
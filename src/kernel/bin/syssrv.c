@@ -17,34 +17,69 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_SYSSRV
+
 #include "syssrv.h"
 #include <errno.h>
-#include "console.h"
+#include "alloc.h"
+#include "allocstat.h"
+#include "drivers/i8042/kbd.h"
 #include "ipc.h"
+#include "log.h"
+#include "sched.h"
 #include "task.h"
+#include "taskhlp.h"
 #include "tcb.h"
+#include "tcbhlp.h"
+#include "trace.h"
 #include "vmem.h"
 
+static void
+system_srv_remove_thread(struct tcb *tcb, struct tcb *self)
+{
+        struct task *tsk;
+        size_t nfreed;
+
+        tsk = tcb->task;
+
+        tcb_set_state(tcb, THREAD_STATE_ZOMBIE);
+        kbd_unsubscribe(tcb);
+        sched_remove_thread(tcb);
+        tcb_helper_free_tcb(tcb);
+
+        if (tsk->nthreads || (tsk == self->task))
+        {
+                return;
+        }
+
+        /*
+         * last thread quit; release task
+         */
+
+        nfreed = task_helper_free_task(tsk);
+
+        pr_info("task quit, %zu page frames released.\n", nfreed);
+}
+
 static int
 system_srv_handle_msg(struct ipc_msg *msg, struct tcb *self)
 {
-        console_printf("%s:%x.\n", __FILE__, __LINE__);
+        pr_debug("syssrv: flags=%#lx from tcb=%p\n", msg->flags, msg->snd);
 
         switch (msg->flags&0xffff)
         {
                 case 0:        /* thread quit */
                         /*
-                         * mark sender thread for removal
+                         * remove sender thread
                          */
-                        console_printf("%s:%x.\n", __FILE__, __LINE__);
-                        tcb_set_state(msg->snd, THREAD_STATE_ZOMBIE);
+                        system_srv_remove_thread(msg->snd, self);
                         break;
                 case 1:        /* write to console */
                         /*
                          * mark sender thread for removal
                          */
-                        console_printf("%s:%x\n", __FILE__, __LINE__);
-                        console_printf("received msg: %s\n", (msg->msg0)<<12);
+                        pr_info("received msg: %s\n",
+                                       (const char *)((msg->msg0)<<12));
 
                                 struct tcb *rcv = msg->snd;
                                 ipc_msg_init(msg, self,
@@ -52,6 +87,87 @@ system_srv_handle_msg(struct ipc_msg *msg, struct tcb *self)
                                              ENOSYS, 0);
                                 ipc_reply(msg, rcv);
 
+                        break;
+                case IPC_OPSYS_DUMP_ALLOC_STATS:
+                        /*
+                         * print allocation statistics
+                         */
+                        allocstat_dump();
+                        {
+                                struct tcb *rcv = msg->snd;
+                                ipc_msg_init(msg, self, 0, 0, 0);
+                                ipc_reply(msg, rcv);
+                        }
+
+                        break;
+                case IPC_OPSYS_KBD_SUBSCRIBE:
+                        /*
+                         * deliver keyboard input to sender thread
+                         */
+                        {
+                                struct tcb *rcv = msg->snd;
+                                int err = kbd_subscribe(rcv, self);
+                                if (err < 0)
+                                {
+                                        ipc_msg_init(msg, self,
+                                                     IPC_MSG_FLAG_IS_ERRNO,
+                                                     -err, 0);
+                                }
+                                else
+                                {
+                                        ipc_msg_init(msg, self, 0, 0, 0);
+                                }
+                                ipc_reply(msg, rcv);
+                        }
+
+                        break;
+                case IPC_OPSYS_TRACE_SET_EVENTS:
+                        /*
+                         * enable trace events; reply with previous events
+                         */
+                        {
+                                struct tcb *rcv = msg->snd;
+                                unsigned long old;
+                                int err = trace_set_events(msg->msg0, &old);
+                                if (err < 0)
+                                {
+                                        ipc_msg_init(msg, self,
+                                                     IPC_MSG_FLAG_IS_ERRNO,
+                                                     -err, 0);
+                                }
+                                else
+                                {
+                                        ipc_msg_init(msg, self, 0, old, 0);
+                                }
+                                ipc_reply(msg, rcv);
+                        }
+
+                        break;
+                case IPC_OPSYS_TRACE_DUMP:
+                        /*
+                         * write trace buffers to serial port
+                         */
+                        trace_dump();
+                        {
+                                struct tcb *rcv = msg->snd;
+                                ipc_msg_init(msg, self, 0, 0, 0);
+                                ipc_reply(msg, rcv);
+                        }
+
+                        break;
+                case IPC_OPSYS_KMALLOC_SHRINK:
+                        /*
+                         * set empty-slab watermark and release empty
+                         * slabs; reply with number of released pages
+                         */
+                        kmalloc_set_watermark(msg->msg0);
+                        {
+                                struct tcb *rcv = msg->snd;
+                                size_t npages = kmalloc_shrink();
+                                ipc_msg_init(msg, self, 0, npages, 0);
+                                ipc_reply(msg, rcv);
+                        }
+
                         break;
                 default:
                         /*
@@ -77,6 +193,8 @@ system_srv_start(struct tcb *self)
         {
                 int err;
                 struct ipc_msg msg;
+                os_index_t pgindex;
+                size_t pgcount;
 
                 msg.flags = IPC_MSG_FLAGS_MMAP;
                 msg.msg1 = 1;
@@ -84,20 +202,41 @@ system_srv_start(struct tcb *self)
                                                     VMEM_AREA_KERNEL,
                                                     msg.msg1);
 
-                console_printf("%s:%x syssrv=%x.\n", __FILE__, __LINE__,
-                               self);
+                pr_debug("syssrv: tcb=%p waits for messages\n", self);
 
                 if ((err = ipc_recv(&msg, self)) < 0)
                 {
                         goto err_ipc_recv;
                 }
 
-                if ((err = system_srv_handle_msg(&msg, self)) < 0)
+                /*
+                 * remember mapped pages; handling the message
+                 * overwrites them
+                 */
+
+                if (msg.flags&IPC_MSG_FLAGS_MMAP)
+                {
+                        pgindex = msg.msg0;
+                        pgcount = msg.msg1;
+                }
+                else
+                {
+                        pgcount = 0;
+                }
+
+                err = system_srv_handle_msg(&msg, self);
+
+                if (pgcount)
+                {
+                        vmem_unmap_pages_at(self->task->as, pgindex, pgcount);
+                }
+
+                if (err < 0)
                 {
                         goto err_system_srv_handle_msg;
                 }
 
-/*                console_printf("%s:%x.\n", __FILE__, __LINE__);*/
+/*                console_printf("%s:%d.\n", __FILE__, __LINE__);*/
 
                 continue;
 
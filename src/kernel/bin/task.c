@@ -27,7 +27,11 @@ enum
         MAXTASK = 1024
 };
 
-static unsigned char g_taskid[MAXTASK >> 3];
+static bitset_word g_taskid_word[BITSET_NWORDS(MAXTASK)];
+static bitset_word g_taskid_summary[BITSET_SUMMARY_NWORDS(MAXTASK)];
+
+static struct bitset_summary g_taskid =
+        BITSET_SUMMARY_INITIALIZER(g_taskid_word, g_taskid_summary);
 
 int
 task_init(struct task *task, struct vmem *as)
@@ -35,13 +39,13 @@ task_init(struct task *task, struct vmem *as)
         int err;
         ssize_t taskid;
 
-        if ((taskid = bitset_find_unset(g_taskid, sizeof(g_taskid))) < 0)
+        if ((taskid = bitset_summary_find_unset(&g_taskid)) < 0)
         {
                 err = taskid;
                 goto err_find_taskid;
         }
 
-        bitset_set(g_taskid, taskid);
+        bitset_summary_set(&g_taskid, taskid);
 
         task->as = as;
         task->nthreads = 0;
@@ -57,13 +61,13 @@ err_find_taskid:
 void
 task_uninit(struct task *task)
 {
-        bitset_unset(g_taskid, task->id);
+        bitset_summary_unset(&g_taskid, task->id);
 }
 
 size_t
 task_max_nthreads(const struct task *task)
 {
-        return sizeof(task->threadid) * 8;
+        return BITSET_NBITS(task->threadid);
 }
 
 int
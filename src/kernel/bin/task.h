@@ -20,6 +20,7 @@
 #pragma once
 
 #include <sys/types.h>
+#include "bitset.h"
 
 struct vmem;
 
@@ -28,7 +29,7 @@ struct task
         struct vmem *as;
         unsigned int  id;
         unsigned char nthreads;
-        unsigned char threadid[8];
+        bitset_word threadid[BITSET_NWORDS(64)];
 };
 
 int
@@ -19,16 +19,22 @@
 
 #include "taskhlp.h"
 #include <errno.h>
-#include "alloc.h"
 #include "page.h"
 #include "pte.h"
+#include "slab.h"
 #include "task.h"
 #include "vmem.h"
 
+static struct slab_cache g_task_cache =
+    SLAB_CACHE_INITIALIZER(g_task_cache, struct task, NULL);
+
+static struct slab_cache g_vmem_cache =
+    SLAB_CACHE_INITIALIZER(g_vmem_cache, struct vmem, NULL);
+
 int
 task_helper_allocate_task(struct vmem* kernel_as, struct task** task_out)
 {
-    struct task* task = kmalloc(sizeof(*task));
+    struct task* task = slab_cache_alloc(&g_task_cache);
     if (!task) {
         return -ENOMEM;
     }
@@ -43,7 +49,7 @@ task_helper_allocate_task(struct vmem* kernel_as, struct task** task_out)
     return 0;
 
 err_task_init:
-    kfree(task);
+    slab_cache_free(&g_task_cache, task);
     return res;
 }
 
@@ -57,10 +63,10 @@ task_helper_allocate_task_from_parent(const struct task *parent,
          * allocate task memory
          */
 
-        if (!(*tsk = kmalloc(sizeof(**tsk))))
+        if (!(*tsk = slab_cache_alloc(&g_task_cache)))
         {
                 err = -ENOMEM;
-                goto err_kmalloc_tsk;
+                goto err_slab_cache_alloc;
         }
 
         /*
@@ -75,8 +81,8 @@ task_helper_allocate_task_from_parent(const struct task *parent,
         return 0;
 
 err_task_helper_init_task_from_parent:
-        kfree(*tsk);
-err_kmalloc_tsk:
+        slab_cache_free(&g_task_cache, *tsk);
+err_slab_cache_alloc:
         return err;
 }
 
@@ -85,7 +91,7 @@ err_kmalloc_tsk:
 int
 allocate_vmem_from_parent(struct vmem* parent, struct vmem** vmem_out)
 {
-    struct vmem* vmem = kmalloc(sizeof(*vmem));
+    struct vmem* vmem = slab_cache_alloc(&g_vmem_cache);
     if (!vmem) {
         return -ENOMEM;
     }
@@ -100,10 +106,19 @@ allocate_vmem_from_parent(struct vmem* parent, struct vmem** vmem_out)
     return 0;
 
 err_vmem_init_from_parent:
-    kfree(vmem);
+    slab_cache_free(&g_vmem_cache, vmem);
     return res;
 }
 
+static size_t
+free_vmem(struct vmem* vmem)
+{
+    size_t nfreed = vmem_uninit(vmem);
+    slab_cache_free(&g_vmem_cache, vmem);
+
+    return nfreed;
+}
+
 int
 task_helper_init_task_from_parent(const struct task *parent, struct task *tsk)
 {
@@ -132,9 +147,18 @@ task_helper_init_task_from_parent(const struct task *parent, struct task *tsk)
         return 0;
 
 err_task_init:
-        /*
-         * TODO: free address space
-         */
+        free_vmem(as);
 err_vmem_helper_allocate_vmem_from_parent:
         return err;
 }
+
+size_t
+task_helper_free_task(struct task* task)
+{
+    struct vmem* as = task->as;
+
+    task_uninit(task);
+    slab_cache_free(&g_task_cache, task);
+
+    return free_vmem(as);
+}
@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <sys/types.h>
+
 struct task;
 struct vmem;
 
@@ -32,3 +34,11 @@ task_helper_allocate_task_from_parent(const struct task *parent,
 int
 task_helper_init_task_from_parent(const struct task *parent,
                                         struct task *tsk);
+
+/**
+ * \brief release a task and its address space
+ * \param[in] task a task from task_helper_allocate_task_from_parent()
+ * \return the number of page frames that have been returned to pmem
+ */
+size_t
+task_helper_free_task(struct task* task);
@@ -17,14 +17,16 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_TASK
+
 #include "tcb.h"
 #include <errno.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <string.h>
-#include "console.h"
 #include "cpu.h"
 #include "bitset.h"
+#include "log.h"
 #include "page.h"
 #include "pageframe.h"
 #include "task.h"
@@ -46,7 +48,7 @@ int
 tcb_init_with_id(struct tcb *tcb,
                  struct task *task, unsigned char id, void *stack)
 {
-    console_printf("tcb id=%x.\n", id);
+    pr_debug("tcb id=%d.\n", id);
 
     int res = task_ref(task);
     if (res < 0) {
@@ -71,6 +73,7 @@ tcb_init_with_id(struct tcb *tcb,
 
     list_init_item(&tcb->wait);
     list_init_item(&tcb->sched);
+    hlist_init_node(&tcb->sched_hash);
 
     spinlock_init(&tcb->lock);
 
@@ -100,7 +103,8 @@ err_bitset_isset:
 int
 tcb_init(struct tcb *tcb, struct task *task, void *stack)
 {
-    ssize_t id = bitset_find_unset(task->threadid, sizeof(task->threadid));
+    ssize_t id = bitset_find_unset(task->threadid,
+                                   BITSET_NBITS(task->threadid));
     if (id < 0) {
         return (int)id;
     }
@@ -116,6 +120,8 @@ tcb_init(struct tcb *tcb, struct task *task, void *stack)
 void
 tcb_uninit(struct tcb *tcb)
 {
+    spinlock_uninit(&tcb->lock);
+    bitset_unset(tcb->task->threadid, tcb->id);
     task_unref(tcb->task);
 }
 
@@ -21,6 +21,7 @@
 
 struct task;
 
+#include "hlist.h"
 #include "ipcmsg.h"
 #include "list.h"
 #include "spinlock.h"
@@ -47,6 +48,7 @@ struct tcb {
     struct ipc_msg msg;
     struct list wait;
     struct list sched;
+    struct hlist_node sched_hash; /**< Entry in scheduler's id hash */
 
     spinlock_type lock;
 };
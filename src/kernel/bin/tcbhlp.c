@@ -18,31 +18,28 @@
  */
 
 #include "tcbhlp.h"
+#include <errno.h>
 #include "page.h"
 #include "pte.h"
+#include "slab.h"
 #include "task.h"
 #include "tcb.h"
 #include "vmem.h"
 
+static struct slab_cache g_tcb_cache =
+        SLAB_CACHE_INITIALIZER(g_tcb_cache, struct tcb, NULL);
+
 int
 tcb_helper_allocate_tcb(struct task *tsk, void *stack, struct tcb **tcb)
 {
         int err;
-        long pgindex;
 
-        pgindex = vmem_alloc_pages_in_area(tsk->as,
-                                           VMEM_AREA_KERNEL,
-                                           page_count(0, sizeof(*tcb)),
-                                           PTE_FLAG_PRESENT|
-                                           PTE_FLAG_WRITEABLE);
-        if (pgindex < 0)
+        if (!(*tcb = slab_cache_alloc(&g_tcb_cache)))
         {
-                err = pgindex;
-                goto err_vmem_helper_alloc_pages_in_area;
+                err = -ENOMEM;
+                goto err_slab_cache_alloc;
         }
 
-        *tcb = page_address(pgindex);
-
         if ((err = tcb_init(*tcb, tsk, stack)) < 0)
         {
                 goto err_tcb_init;
@@ -51,10 +48,8 @@ tcb_helper_allocate_tcb(struct task *tsk, void *stack, struct tcb **tcb)
         return 0;
 
 err_tcb_init:
-        /*
-         * TODO: free pages
-         */
-err_vmem_helper_alloc_pages_in_area:
+        slab_cache_free(&g_tcb_cache, *tcb);
+err_slab_cache_alloc:
         return err;
 }
 
@@ -87,13 +82,23 @@ tcb_helper_allocate_tcb_and_stack(struct task *tsk, size_t stackpages,
         return 0;
 
 err_tcb_helper_allocate_tcb:
-        /*
-         * TODO: free stack
-         */
+        vmem_unmap_pages_at(tsk->as, pgindex, stackpages);
 err_vmem_helper_alloc_pages_in_area:
         return err;
 }
 
+void
+tcb_helper_free_tcb(struct tcb *tcb)
+{
+        tcb_uninit(tcb);
+
+        /*
+         * The stack is released with the task's address space.
+         */
+
+        slab_cache_free(&g_tcb_cache, tcb);
+}
+
 int
 tcb_helper_run_kernel_thread(struct tcb *tcb, void (*func) (struct tcb *))
 {
@@ -135,9 +140,11 @@ tcb_helper_run_user_thread(struct tcb *cur_tcb, struct tcb *usr_tcb, void *ip)
         tcb_set_state(usr_tcb, THREAD_STATE_READY);
 
         /*
-         * TODO: unmap stack from current address space
+         * unmap stack from current address space
          */
 
+        vmem_unmap_pages_at(cur_tcb->task->as, stackpage, 1);
+
         return 0;
 
 err_vmem_helper_map_pages_in_area:
@@ -31,6 +31,9 @@ int
 tcb_helper_allocate_tcb_and_stack(struct task *tsk, size_t stackpages,
                                   struct tcb **tcb);
 
+void
+tcb_helper_free_tcb(struct tcb *tcb);
+
 int
 tcb_helper_run_kernel_thread(struct tcb *tcb, void (*func)(struct tcb*));
 
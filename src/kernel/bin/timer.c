@@ -19,13 +19,15 @@
 #include "timer.h"
 #include <assert.h>
 #include <stddef.h>
+#include "clock.h"
 #include "interupt.h"
+#include "softirq.h"
 
 static struct alarm*
 alarm_of_list(struct list* item)
 {
     assert(item);
-    return containerof(item, struct alarm, timer_entry);
+    return containerof(twheel_entry_of_list(item), struct alarm, timer_entry);
 }
 
 int
@@ -34,8 +36,7 @@ alarm_init(struct alarm* alarm, timeout_t (*func)(struct alarm*))
     assert(alarm);
     assert(func);
 
-    list_init_item(&alarm->timer_entry);
-    alarm->timestamp_ns = 0;
+    twheel_init_entry(&alarm->timer_entry);
     alarm->func = func;
 
     return 0;
@@ -45,18 +46,22 @@ bool
 alarm_has_expired(const struct alarm* alarm, timestamp_t timestamp_ns)
 {
     assert(alarm);
-    return alarm->timestamp_ns <= timestamp_ns;
+    return alarm->timer_entry.expiry_ns <= timestamp_ns;
 }
 
 struct timer {
     struct timer_drv* drv;
     /* timestamp of when the timer last fired */
     timestamp_t timestamp_ns;
-    struct list alarm_list;
+    /* enqueued alarms */
+    struct twheel wheel;
 };
 
 static struct timer g_timer;
 
+static void
+run_timer_softirq(void);
+
 int
 init_timer(struct timer_drv* drv)
 {
@@ -64,7 +69,9 @@ init_timer(struct timer_drv* drv)
 
     g_timer.drv = drv;
     g_timer.timestamp_ns = 0;
-    list_init_head(&g_timer.alarm_list);
+    twheel_init(&g_timer.wheel, g_timer.timestamp_ns);
+
+    softirq_set_handler(SOFTIRQ_TIMER, run_timer_softirq);
 
     return 0;
 }
@@ -73,62 +80,83 @@ void
 uninit_timer()
 { }
 
-static int
-cmp_timestamp(struct list* newitem, struct list* item)
+/* Programs the timer driver for the earliest alarm. */
+static void
+update_timeout(void)
 {
-    const struct alarm* lhs = alarm_of_list(newitem);
-    const struct alarm* rhs = alarm_of_list(item);
+    timestamp_t expiry_ns;
 
-    long long diff = lhs->timestamp_ns - rhs->timestamp_ns;
+    if (!twheel_next_expiry(&g_timer.wheel, &expiry_ns)) {
+        timer_drv_clear_timeout(g_timer.drv);
+        return;
+    }
+
+    timestamp_t now_ns = clock_now_ns();
+    timestamp_t timeout_ns = 0;
+
+    if (expiry_ns > now_ns) {
+        timeout_ns = expiry_ns - now_ns;
+    }
+    if (timeout_ns > (timeout_t)-1) {
+        timeout_ns = (timeout_t)-1;
+    }
 
-    return (diff > 0) - (diff < 0);
+    timer_drv_set_timeout(g_timer.drv, timeout_ns);
 }
 
-void
+static void
 handle_timeout(timestamp_t timestamp_ns)
 {
-    /* We fetch items from the list of alarms and loop while
-     * the timestamp is in the past. This way, we handle all
-     * alarms that have expired. */
+    /* We advance the timer wheel to the current time, which
+     * collects all expired alarms in order of their expiry
+     * times. Then we run each alarm's callback with interrupts
+     * enabled. */
 
-    struct list* item = list_begin(&g_timer.alarm_list);
+    struct list expired;
+    list_init_head(&expired);
 
-    while (item != list_end(&g_timer.alarm_list)) {
+    bool ints_on = cli_if_on();
 
-        struct alarm* alarm = alarm_of_list(item);
+    g_timer.timestamp_ns = timestamp_ns;
+    twheel_advance(&g_timer.wheel, timestamp_ns, &expired);
 
-        if (!alarm_has_expired(alarm, timestamp_ns)) {
-            /* We've handled all expired alarms. */
-            break;
-        }
+    sti_if_on(ints_on);
+
+    while (!list_is_empty(&expired)) {
 
-        struct list* next = list_next(item);
-        list_dequeue(item);
+        struct alarm* alarm = alarm_of_list(list_first(&expired));
+        list_dequeue(&alarm->timer_entry.list);
 
         timeout_t reltime_ns = alarm->func(alarm);
 
         /* For periodic alarms, We now update the alarm's timestamp
-         * and re-enqueue it at the correct position. If the alarm is
+         * and re-enqueue it in the timer wheel. If the alarm is
          * non-periodic, we guarantee to not touch the alarm structure
          * after the callback has returned. */
 
         if (reltime_ns) {
-            alarm->timestamp_ns = timestamp_ns + reltime_ns;
-            list_enqueue_sorted(&g_timer.alarm_list,
-                                &alarm->timer_entry,
-                                cmp_timestamp);
+            ints_on = cli_if_on();
+            twheel_add(&g_timer.wheel, &alarm->timer_entry,
+                       timestamp_ns + reltime_ns);
+            sti_if_on(ints_on);
         }
-
-        item = next;
     }
 
-    if (item != list_end(&g_timer.alarm_list)) {
-        const struct alarm* alarm = alarm_of_list(item);
-        timeout_t timeout_ns = alarm->timestamp_ns - timestamp_ns;
-        timer_drv_set_timeout(g_timer.drv, timeout_ns);
-    } else {
-        timer_drv_clear_timeout(g_timer.drv);
-    }
+    ints_on = cli_if_on();
+    update_timeout();
+    sti_if_on(ints_on);
+}
+
+static void
+run_timer_softirq()
+{
+    handle_timeout(clock_update());
+}
+
+void
+timer_handle_irq()
+{
+    softirq_raise(SOFTIRQ_TIMER);
 }
 
 int
@@ -138,14 +166,10 @@ timer_add_alarm(struct alarm* alarm, timeout_t reltime_ns)
 
     bool ints_on = cli_if_on();
 
-    if (list_is_empty(&g_timer.alarm_list)) {
-        timer_drv_set_timeout(g_timer.drv, reltime_ns);
-    }
+    twheel_add(&g_timer.wheel, &alarm->timer_entry,
+               clock_now_ns() + reltime_ns);
 
-    alarm->timestamp_ns = g_timer.timestamp_ns + reltime_ns;
-    list_enqueue_sorted(&g_timer.alarm_list,
-                        &alarm->timer_entry,
-                        cmp_timestamp);
+    update_timeout();
 
     sti_if_on(ints_on);
 
@@ -159,11 +183,9 @@ timer_remove_alarm(struct alarm* alarm)
 
     bool ints_on = cli_if_on();
 
-    list_dequeue(&alarm->timer_entry);
+    twheel_remove(&g_timer.wheel, &alarm->timer_entry);
 
-    if (list_is_empty(&g_timer.alarm_list)) {
-        timer_drv_clear_timeout(g_timer.drv);
-    }
+    update_timeout();
 
     sti_if_on(ints_on);
 }
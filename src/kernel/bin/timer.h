@@ -19,7 +19,7 @@
 #pragma once
 
 #include "drivers/timer/timer.h"
-#include "list.h"
+#include "twheel.h"
 
 #define S_TO_MS(_s)     (1000 * (_s))
 #define MS_TO_uS(_ms)   (1000 * (_ms))
@@ -28,9 +28,8 @@
 #define S_TO_NS(_s)     uS_TO_NS(MS_TO_uS(S_TO_MS(_s)))
 
 struct alarm {
-    struct list timer_entry;
+    struct twheel_entry timer_entry; /* holds the expiry time */
 
-    timestamp_t timestamp_ns;
     timeout_t (*func)(struct alarm*);
 };
 
@@ -46,8 +45,14 @@ init_timer(struct timer_drv* drv);
 void
 uninit_timer(void);
 
+/**
+ * \brief signals a timer interrupt
+ *
+ * Call this function from the timer driver's interrupt handler.
+ * Expired alarms run later from the timer softirq.
+ */
 void
-handle_timeout(timestamp_t timestamp_ns);
+timer_handle_irq(void);
 
 int
 timer_add_alarm(struct alarm* alarm, timeout_t reltime_ns);
@@ -0,0 +1,187 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "interupt.h"
+#include "log.h"
+#include "sched.h"
+
+/*
+ * Dump format
+ *
+ * A dump is a sequence of text lines, so it can share the serial
+ * port with the kernel log. Each CPU's buffer starts with a header
+ *
+ *      trace: begin cpu=<n> records=<n> lost=<n> mult=<n> shift=<n>
+ *
+ * followed by one line per record, oldest first,
+ *
+ *      trace: r <hex bytes of struct trace_record>
+ *
+ * and a final 'trace: end' line. Timestamps convert to nanoseconds
+ * as (tsc * mult) >> shift.
+ */
+
+volatile unsigned long g_trace_events;
+
+struct trace_cpu {
+    unsigned long       head; /* \attention Do not write with interupts enabled! */
+    struct trace_record rec[TRACE_NRECORDS];
+};
+
+static struct trace_cpu     g_trace_cpu[SCHED_NCPUS];
+static struct clocksource*  g_trace_tsc;
+static struct console_sink* g_trace_sink;
+
+void
+trace_init(struct clocksource* tsc, struct console_sink* sink)
+{
+    g_trace_tsc = tsc;
+    g_trace_sink = sink;
+
+#ifdef TRACE_BOOT
+    trace_set_events(TRACE_EVENTS_ALL, NULL);
+#endif
+}
+
+int
+trace_set_events(unsigned long events, unsigned long* old)
+{
+    if (events && !g_trace_tsc) {
+        return -ENODEV;
+    }
+
+    if (old) {
+        *old = g_trace_events;
+    }
+    g_trace_events = events & TRACE_EVENTS_ALL;
+
+    return 0;
+}
+
+void
+trace_record(enum trace_event event, unsigned long arg0, unsigned long arg1,
+             unsigned long arg2)
+{
+    bool ints_on = cli_if_on();
+
+    unsigned int cpu = cpuid();
+    struct trace_cpu* tc = g_trace_cpu + cpu;
+    struct trace_record* rec = tc->rec + (tc->head & (TRACE_NRECORDS - 1));
+
+    rec->tsc = rdtsc();
+    rec->event = event;
+    rec->cpu = cpu;
+    rec->arg[0] = arg0;
+    rec->arg[1] = arg1;
+    rec->arg[2] = arg2;
+
+    ++tc->head;
+
+    sti_if_on(ints_on);
+}
+
+/*
+ * Dumping
+ */
+
+static void
+dump_write(const char* buf, size_t len)
+{
+    if (g_trace_sink) {
+        g_trace_sink->write(g_trace_sink, buf, len);
+    } else {
+        console_write(buf, len);
+    }
+}
+
+static void
+dump_record(const struct trace_record* rec)
+{
+    static const char hexdigit[] = "0123456789abcdef";
+    static const char prefix[] = "trace: r ";
+
+    char line[sizeof(prefix) - 1 + 2 * sizeof(*rec) + 1];
+
+    memcpy(line, prefix, sizeof(prefix) - 1);
+
+    const unsigned char* byte = (const unsigned char*)rec;
+    char* s = line + sizeof(prefix) - 1;
+
+    for (size_t i = 0; i < sizeof(*rec); ++i) {
+        *s++ = hexdigit[byte[i] >> 4];
+        *s++ = hexdigit[byte[i] & 0xf];
+    }
+    *s++ = '\n';
+
+    dump_write(line, s - line);
+}
+
+static void
+dump_cpu(unsigned int cpu)
+{
+    const struct trace_cpu* tc = g_trace_cpu + cpu;
+
+    unsigned long head = tc->head;
+    unsigned long n = head < TRACE_NRECORDS ? head : TRACE_NRECORDS;
+
+    char line[LOG_LINE_MAX];
+    int len = snprintf(line, sizeof(line),
+                       "trace: begin cpu=%u records=%lu lost=%lu "
+                       "mult=%lu shift=%u\n",
+                       cpu, n, head - n,
+                       g_trace_tsc ? g_trace_tsc->mult : 0ul,
+                       g_trace_tsc ? g_trace_tsc->shift : 0u);
+    dump_write(line, len);
+
+    for (unsigned long i = head - n; i != head; ++i) {
+        dump_record(tc->rec + (i & (TRACE_NRECORDS - 1)));
+    }
+}
+
+/* Runs in the log drain, which serializes all writes to the sinks. */
+static void
+dump_func(void* data)
+{
+    for (unsigned int cpu = 0; cpu < SCHED_NCPUS; ++cpu) {
+        dump_cpu(cpu);
+    }
+
+    static const char end[] = "trace: end\n";
+    dump_write(end, sizeof(end) - 1);
+
+    trace_set_events((unsigned long)data, NULL);
+}
+
+void
+trace_dump()
+{
+    unsigned long events;
+    trace_set_events(0, &events);
+
+    /* If a dump is pending already, it restores the events
+     * that were enabled before it paused recording. */
+    log_run_exclusive(dump_func, (void*)events);
+}
@@ -0,0 +1,125 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct clocksource;
+struct console_sink;
+
+/*
+ * Tracepoints record kernel events into per-CPU ring buffers. Each
+ * record is a fixed-size binary struct with a TSC timestamp. A
+ * disabled tracepoint costs a single test of the global event mask,
+ * which is predicted not-taken.
+ *
+ * The buffers are flight recorders: the newest records overwrite
+ * the oldest ones. trace_dump() writes them to the serial port, and
+ * tools/tracedec/tracedec.py turns the output into a timeline.
+ */
+
+enum {
+    /** \brief records per CPU; must be a power of two */
+    TRACE_NRECORDS = 1024
+};
+
+/* Keep in sync with the event table in tools/tracedec/tracedec.py. */
+enum trace_event {
+    TRACE_SCHED_SWITCH = 0, /**< prev tcb, next tcb, next prio */
+    TRACE_IPC_SEND,         /**< sender tcb, receiver tcb, flags */
+    TRACE_IPC_RECV,         /**< receiver tcb, sender tcb, flags */
+    TRACE_IPC_NOTIFY,       /**< receiver tcb, message, flags */
+    TRACE_IRQ_ENTER,        /**< irqno */
+    TRACE_IRQ_EXIT,         /**< irqno */
+    TRACE_PAGE_FAULT,       /**< address, error code, ip */
+    TRACE_KMALLOC,          /**< address, size, call site */
+    TRACE_KFREE,            /**< address */
+    TRACE_NEVENTS
+};
+
+#define TRACE_EVENTS_ALL    ((1ul << TRACE_NEVENTS) - 1)
+
+struct trace_record {
+    unsigned long long tsc;
+    unsigned short     event;
+    unsigned short     cpu;
+    unsigned long      arg[3];
+};
+
+/** \brief bit mask of enabled events; written by trace_set_events() */
+extern volatile unsigned long g_trace_events;
+
+/**
+ * \brief records an event if it is enabled
+ * \param event_ the event
+ * \param arg0_ the event's first argument
+ * \param arg1_ the event's second argument
+ * \param arg2_ the event's third argument
+ */
+#define trace_event(event_, arg0_, arg1_, arg2_)                        \
+    do {                                                                \
+        if (__builtin_expect(g_trace_events & (1ul << (event_)), 0)) {  \
+            trace_record((event_), (unsigned long)(arg0_),              \
+                         (unsigned long)(arg1_),                        \
+                         (unsigned long)(arg2_));                       \
+        }                                                               \
+    } while (0)
+
+/**
+ * \brief init tracing
+ * \param[in] tsc the TSC clock source, or NULL if there is no TSC
+ * \param[in] sink the serial sink for dumps, or NULL for the console
+ *
+ * Events can only be enabled if the CPU has a TSC. The clock
+ * source's conversion factors are included in dumps.
+ */
+void
+trace_init(struct clocksource* tsc, struct console_sink* sink);
+
+/**
+ * \brief sets the enabled events
+ * \param events a bit mask of enabled events
+ * \param[out] old the previous bit mask, or NULL
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+trace_set_events(unsigned long events, unsigned long* old);
+
+/**
+ * \brief appends a record to the current CPU's buffer
+ * \param event the event
+ * \param arg0 the event's first argument
+ * \param arg1 the event's second argument
+ * \param arg2 the event's third argument
+ *
+ * Use trace_event() instead of calling this function directly.
+ */
+void
+trace_record(enum trace_event event, unsigned long arg0, unsigned long arg1,
+             unsigned long arg2);
+
+/**
+ * \brief writes all buffers to the dump sink
+ *
+ * Recording is paused during the dump. The records remain in the
+ * buffers afterwards. The dump runs in the log drain, after pending
+ * log messages, so it might finish after this function returns.
+ */
+void
+trace_dump(void);
@@ -0,0 +1,290 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "twheel.h"
+#include <stddef.h>
+
+static const timestamp_t TWHEEL_SLOT_MASK = TWHEEL_NSLOTS - 1;
+
+static timestamp_t
+tick_of(timestamp_t ns)
+{
+    return ns >> TWHEEL_TICK_SHIFT;
+}
+
+static size_t
+slot_index(timestamp_t tick, unsigned int level)
+{
+    return (tick >> (level * TWHEEL_LEVEL_BITS)) & TWHEEL_SLOT_MASK;
+}
+
+/* first tick beyond the range of the wheel, relative to its current tick */
+static timestamp_t
+wheel_range(void)
+{
+    return 1ull << (TWHEEL_NLEVELS * TWHEEL_LEVEL_BITS);
+}
+
+void
+twheel_init(struct twheel* wheel, timestamp_t now_ns)
+{
+    wheel->tick = tick_of(now_ns);
+
+    for (size_t i = 0; i < TWHEEL_NLEVELS; ++i) {
+        for (size_t j = 0; j < TWHEEL_NSLOTS; ++j) {
+            list_init_head(&wheel->slot[i][j]);
+        }
+        bitset_unset_range(wheel->pending[i], 0, TWHEEL_NSLOTS);
+    }
+
+    list_init_head(&wheel->overflow);
+}
+
+void
+twheel_init_entry(struct twheel_entry* entry)
+{
+    list_init_item(&entry->list);
+    entry->slot = NULL;
+    entry->expiry_ns = 0;
+}
+
+static void
+insert(struct twheel* wheel, struct twheel_entry* entry)
+{
+    timestamp_t tick = tick_of(entry->expiry_ns);
+
+    if (tick < wheel->tick) {
+        tick = wheel->tick; /* overdue */
+    } else if (!(tick - wheel->tick < wheel_range())) {
+        entry->slot = &wheel->overflow;
+        list_enqueue_back(entry->slot, &entry->list);
+        return;
+    }
+
+    timestamp_t delta = tick - wheel->tick;
+
+    unsigned int level = 0;
+    while (delta >> ((level + 1) * TWHEEL_LEVEL_BITS)) {
+        ++level;
+    }
+
+    size_t index = slot_index(tick, level);
+
+    entry->slot = &wheel->slot[level][index];
+    list_enqueue_back(entry->slot, &entry->list);
+    bitset_set(wheel->pending[level], index);
+}
+
+void
+twheel_add(struct twheel* wheel, struct twheel_entry* entry,
+           timestamp_t expiry_ns)
+{
+    entry->expiry_ns = expiry_ns;
+    insert(wheel, entry);
+}
+
+static void
+update_pending(struct twheel* wheel, const struct list* slot)
+{
+    if (!list_is_empty(slot) || (slot == &wheel->overflow)) {
+        return;
+    }
+
+    size_t i = slot - &wheel->slot[0][0];
+
+    bitset_unset(wheel->pending[i / TWHEEL_NSLOTS], i % TWHEEL_NSLOTS);
+}
+
+void
+twheel_remove(struct twheel* wheel, struct twheel_entry* entry)
+{
+    list_dequeue(&entry->list);
+
+    if (entry->slot) {
+        update_pending(wheel, entry->slot);
+        entry->slot = NULL;
+    }
+}
+
+static void
+reinsert(struct twheel* wheel, struct list* slot)
+{
+    struct list entries;
+    list_init_head(&entries);
+
+    while (!list_is_empty(slot)) {
+        struct list* item = list_first(slot);
+        list_dequeue(item);
+        list_enqueue_back(&entries, item);
+    }
+
+    while (!list_is_empty(&entries)) {
+        struct twheel_entry* entry = twheel_entry_of_list(list_first(&entries));
+        list_dequeue(&entry->list);
+        insert(wheel, entry);
+    }
+}
+
+/* Re-inserts the entries of the slots that the wheel reached. */
+static void
+cascade(struct twheel* wheel)
+{
+    for (unsigned int level = 1; level < TWHEEL_NLEVELS; ++level) {
+
+        size_t index = slot_index(wheel->tick, level);
+
+        reinsert(wheel, &wheel->slot[level][index]);
+        bitset_unset(wheel->pending[level], index);
+
+        if (index && (level + 1 < TWHEEL_NLEVELS)) {
+            return; /* higher levels did not reach a new slot */
+        }
+    }
+
+    /* The top level reached a new slot, so entries in the overflow
+     * list might be in range now. */
+    reinsert(wheel, &wheel->overflow);
+}
+
+/* Inserts an entry by expiry time, starting from the list's end. */
+static void
+enqueue_expired(struct list* expired, struct twheel_entry* entry)
+{
+    struct list* item = list_rbegin(expired);
+
+    while ((item != list_rend(expired)) &&
+           (twheel_entry_of_list(item)->expiry_ns > entry->expiry_ns)) {
+        item = list_prev(item);
+    }
+
+    list_enqueue_after(item, &entry->list);
+}
+
+static void
+expire_slot(struct twheel* wheel, timestamp_t now_ns, struct list* expired)
+{
+    size_t index = slot_index(wheel->tick, 0);
+    struct list* slot = &wheel->slot[0][index];
+    struct list* item = list_begin(slot);
+
+    while (item != list_end(slot)) {
+
+        struct list* next = list_next(item);
+        struct twheel_entry* entry = twheel_entry_of_list(item);
+
+        /* entries in the current tick might expire later */
+        if (entry->expiry_ns <= now_ns) {
+            list_dequeue(item);
+            entry->slot = NULL;
+            enqueue_expired(expired, entry);
+        }
+
+        item = next;
+    }
+
+    update_pending(wheel, slot);
+}
+
+void
+twheel_advance(struct twheel* wheel, timestamp_t now_ns,
+               struct list* expired)
+{
+    timestamp_t target = tick_of(now_ns);
+
+    expire_slot(wheel, now_ns, expired);
+
+    while (wheel->tick < target) {
+
+        /* Jump to the next occupied level-0 slot or to the next
+         * wrap-around of level 0, whichever comes first. */
+
+        timestamp_t next = (wheel->tick | TWHEEL_SLOT_MASK) + 1;
+
+        ssize_t i = bitset_find_next_set(wheel->pending[0], TWHEEL_NSLOTS,
+                                         slot_index(wheel->tick, 0) + 1);
+        if (i >= 0) {
+            next = (wheel->tick & ~TWHEEL_SLOT_MASK) + i;
+        }
+        if (next > target) {
+            next = target;
+        }
+
+        wheel->tick = next;
+
+        if (!slot_index(wheel->tick, 0)) {
+            cascade(wheel);
+        }
+
+        expire_slot(wheel, now_ns, expired);
+    }
+}
+
+/* Returns the earliest expiry time in a slot. */
+static timestamp_t
+slot_expiry(const struct list* slot)
+{
+    struct list* item = list_begin(slot);
+    timestamp_t expiry_ns = twheel_entry_of_list(item)->expiry_ns;
+
+    for (item = list_next(item); item != list_end(slot); item = list_next(item)) {
+        const struct twheel_entry* entry = twheel_entry_of_list(item);
+        if (entry->expiry_ns < expiry_ns) {
+            expiry_ns = entry->expiry_ns;
+        }
+    }
+
+    return expiry_ns;
+}
+
+bool
+twheel_next_expiry(const struct twheel* wheel, timestamp_t* expiry_ns)
+{
+    bool found = false;
+
+    for (unsigned int level = 0; level < TWHEEL_NLEVELS; ++level) {
+
+        /* On higher levels, the current slot has already been
+         * cascaded and holds entries for the next rotation only. */
+
+        size_t start = slot_index(wheel->tick, level) + !!level;
+
+        ssize_t i = bitset_find_next_set(wheel->pending[level],
+                                         TWHEEL_NSLOTS, start);
+        if (i < 0) {
+            i = bitset_find_next_set(wheel->pending[level], TWHEEL_NSLOTS, 0);
+        }
+        if (i < 0) {
+            continue;
+        }
+
+        timestamp_t slot_expiry_ns = slot_expiry(&wheel->slot[level][i]);
+
+        if (!found || (slot_expiry_ns < *expiry_ns)) {
+            *expiry_ns = slot_expiry_ns;
+            found = true;
+        }
+    }
+
+    /* overflowing entries expire after all others */
+    if (!found && !list_is_empty(&wheel->overflow)) {
+        *expiry_ns = slot_expiry(&wheel->overflow);
+        found = true;
+    }
+
+    return found;
+}
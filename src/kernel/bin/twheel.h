@@ -0,0 +1,114 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "bitset.h"
+#include "drivers/timer/timer.h"
+#include "list.h"
+
+/*
+ * Hierarchical timer wheel. Entries are hashed into per-level slot
+ * lists by their expiry tick: level 0 holds entries that expire
+ * within the next 64 ticks, each further level covers 64 times the
+ * range of the level below. Entries on higher levels cascade down
+ * when the wheel reaches their slot. Entries beyond the range of
+ * the top level wait in an overflow list. Adding and removing entries
+ * takes constant time.
+ */
+
+enum {
+    TWHEEL_TICK_SHIFT = 20, /**< log2 of the tick length in ns, ~1 ms */
+    TWHEEL_LEVEL_BITS = 6,
+    TWHEEL_NSLOTS     = 1 << TWHEEL_LEVEL_BITS,
+    TWHEEL_NLEVELS    = 4
+};
+
+struct twheel_entry {
+    struct list  list;
+    struct list* slot; /**< slot of the entry, or NULL */
+    timestamp_t  expiry_ns;
+};
+
+struct twheel {
+    timestamp_t tick; /**< current tick */
+    struct list slot[TWHEEL_NLEVELS][TWHEEL_NSLOTS];
+    bitset_word pending[TWHEEL_NLEVELS][BITSET_NWORDS(TWHEEL_NSLOTS)];
+    struct list overflow; /**< entries beyond the top level's range */
+};
+
+/**
+ * \brief init a timer wheel
+ * \param[out] wheel the timer wheel
+ * \param now_ns the current time
+ */
+void
+twheel_init(struct twheel* wheel, timestamp_t now_ns);
+
+void
+twheel_init_entry(struct twheel_entry* entry);
+
+/**
+ * \brief adds an entry to the timer wheel
+ * \param[in] wheel the timer wheel
+ * \param[in] entry the entry
+ * \param expiry_ns the expiry time
+ */
+void
+twheel_add(struct twheel* wheel, struct twheel_entry* entry,
+           timestamp_t expiry_ns);
+
+/**
+ * \brief removes an entry from the timer wheel
+ * \param[in] wheel the timer wheel
+ * \param[in] entry the entry
+ *
+ * Entries that are not in the wheel are dequeued from the list
+ * they are in, if any.
+ */
+void
+twheel_remove(struct twheel* wheel, struct twheel_entry* entry);
+
+/**
+ * \brief advances the timer wheel and collects expired entries
+ * \param[in] wheel the timer wheel
+ * \param now_ns the current time
+ * \param[out] expired list head that receives the expired entries
+ *
+ * The expired entries are appended in the order of their expiry
+ * times, with ns resolution.
+ */
+void
+twheel_advance(struct twheel* wheel, timestamp_t now_ns,
+               struct list* expired);
+
+/**
+ * \brief returns the expiry time of the earliest entry
+ * \param[in] wheel the timer wheel
+ * \param[out] expiry_ns the expiry time
+ * \return true if the wheel contains entries, or false otherwise
+ */
+bool
+twheel_next_expiry(const struct twheel* wheel, timestamp_t* expiry_ns);
+
+static inline struct twheel_entry*
+twheel_entry_of_list(struct list* l)
+{
+    return containerof(l, struct twheel_entry, list);
+}
@@ -27,6 +27,7 @@
 #include "pagetbl.h"
 #include "pmem.h"
 #include "pte.h"
+#include "rmap.h"
 #include "vmem_32.h"
 
 /*
@@ -36,14 +37,20 @@
 int
 vmem_init(struct vmem* vmem,
           void* (alloc_aligned)(size_t, void*),
-          void (*unref_aligned)(void*, size_t, void*), void* alloc_data)
+          size_t (*unref_aligned)(void*, size_t, void*), void* alloc_data)
 {
     int res = semaphore_init(&vmem->sem, 1);
     if (res < 0) {
         return res;
     }
 
-    res = vmem_32_init(&vmem->vmem_32, alloc_aligned, unref_aligned,
+    int asid = rmap_alloc_asid(vmem);
+    if (asid < 0) {
+        res = asid;
+        goto err_rmap_alloc_asid;
+    }
+
+    res = vmem_32_init(&vmem->vmem_32, asid, alloc_aligned, unref_aligned,
                        alloc_data);
     if (res < 0) {
         goto err_vmem_32_init;
@@ -52,6 +59,8 @@ vmem_init(struct vmem* vmem,
     return 0;
 
 err_vmem_32_init:
+    rmap_free_asid(asid);
+err_rmap_alloc_asid:
     semaphore_uninit(&vmem->sem);
     return res;
 }
@@ -73,10 +82,19 @@ alloc_pages(size_t siz, void* data)
     return page_address(pgindex);
 }
 
-static void
+static size_t
 unref_pages(void* ptr, size_t siz, void* data)
 {
-    // TODO: unref pages
+    struct vmem* vmem = data;
+
+    size_t nfreed = 0;
+
+    semaphore_enter(&vmem->sem);
+    vmem_32_unmap_pages(&vmem->vmem_32, page_index(ptr), page_count(ptr, siz),
+                        &nfreed);
+    semaphore_leave(&vmem->sem);
+
+    return nfreed;
 }
 
 int
@@ -120,11 +138,20 @@ err_share_page_range:
     return res;
 }
 
-void
+size_t
 vmem_uninit(struct vmem* vmem)
 {
-    vmem_32_uninit(&vmem->vmem_32);
+    rmap_asid_t asid = vmem->vmem_32.asid;
+
+    /* Revocations in other address spaces find us by our id. Wait
+     * for them to finish before tearing down the page tables. */
+    rmap_detach_vmem(asid);
+
+    size_t nfreed = vmem_32_uninit(&vmem->vmem_32);
+    rmap_free_asid(asid);
     semaphore_uninit(&vmem->sem);
+
+    return nfreed;
 }
 
 int
@@ -259,6 +286,25 @@ vmem_alloc_pages_in_area(struct vmem* vmem, enum vmem_area_name areaname,
                                    pteflags);
 }
 
+int
+vmem_unmap_pages_at(struct vmem* vmem, os_index_t pgindex, size_t pgcount)
+{
+    semaphore_enter(&vmem->sem);
+
+    int res = vmem_32_unmap_pages(&vmem->vmem_32, pgindex, pgcount, NULL);
+    if (res < 0) {
+        goto err_vmem_32_unmap_pages;
+    }
+
+    semaphore_leave(&vmem->sem);
+
+    return 0;
+
+err_vmem_32_unmap_pages:
+    semaphore_leave(&vmem->sem);
+    return res;
+}
+
 static void
 semaphore_enter_ordered(struct semaphore *sem1, struct semaphore *sem2)
 {
@@ -307,6 +353,59 @@ err_vmem_map_pages:
     return res;
 }
 
+int
+vmem_share_pages_at(struct vmem *dst_vmem, os_index_t dst_pgindex,
+                    struct vmem *src_vmem, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags)
+{
+    semaphore_enter_ordered(&dst_vmem->sem, &src_vmem->sem);
+
+    int res = vmem_32_share_pages(&dst_vmem->vmem_32, dst_pgindex,
+                                  &src_vmem->vmem_32, src_pgindex,
+                                  pgcount, pteflags);
+    if (res < 0) {
+        goto err_vmem_32_share_pages;
+    }
+
+    semaphore_leave_ordered(&dst_vmem->sem, &src_vmem->sem);
+
+    return 0;
+
+err_vmem_32_share_pages:
+    semaphore_leave_ordered(&dst_vmem->sem, &src_vmem->sem);
+    return res;
+}
+
+int
+vmem_grant_pages_at(struct vmem *dst_vmem, os_index_t dst_pgindex,
+                    struct vmem *src_vmem, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags)
+{
+    semaphore_enter_ordered(&dst_vmem->sem, &src_vmem->sem);
+
+    int res = vmem_32_grant_pages(&dst_vmem->vmem_32, dst_pgindex,
+                                  &src_vmem->vmem_32, src_pgindex,
+                                  pgcount, pteflags);
+    if (res < 0) {
+        goto err_vmem_32_grant_pages;
+    }
+
+    semaphore_leave_ordered(&dst_vmem->sem, &src_vmem->sem);
+
+    return 0;
+
+err_vmem_32_grant_pages:
+    semaphore_leave_ordered(&dst_vmem->sem, &src_vmem->sem);
+    return res;
+}
+
+int
+vmem_revoke_pages_at(struct vmem *vmem, os_index_t pgindex, size_t pgcount)
+{
+    /* takes the locks of all involved address spaces */
+    return vmem_32_revoke_pages(&vmem->vmem_32, &vmem->sem, pgindex, pgcount);
+}
+
 os_index_t
 vmem_map_pages_within(struct vmem *dst_vmem, os_index_t pg_index_min,
                       os_index_t pg_index_max, struct vmem *src_vmem,
@@ -410,11 +509,11 @@ alloc_frames(size_t siz, void* data)
     return (void*)(uintptr_t)pageframe_offset(pfindex);
 }
 
-static void
+static size_t
 unref_frames(void* ptr, size_t siz, void* data)
 {
-    pmem_unref_frames(pageframe_index(ptr),
-                      pageframe_span(ptr, siz));
+    return pmem_unref_frames(pageframe_index(ptr),
+                             pageframe_span(ptr, siz));
 }
 
 int
@@ -607,15 +706,14 @@ vmem_enable_paging_nopg(struct vmem* vmem)
 void
 vmem_segfault_handler(void *ip)
 {
-    console_printf("segmentation fault: ip=%x.\n", (unsigned long)ip);
+    console_printf("segmentation fault: ip=%p.\n", ip);
 }
 
 void
 vmem_pagefault_handler(void *ip, void *addr, unsigned long errcode)
 {
-    console_printf("page fault: ip=%x, addr=%x, errcode=%x.\n",
-                    (unsigned long)ip,
-                    (unsigned long)addr, (unsigned long)errcode);
+    console_printf("page fault: ip=%p, addr=%p, errcode=%#lx.\n",
+                    ip, addr, errcode);
 
     while (1) {
         hlt();
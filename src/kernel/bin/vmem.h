@@ -37,18 +37,24 @@ struct vmem {
  * \brief init vmem structure
  * \param[in] as address of vmem structure
  * \param[in] alloc_aligned function for allocating contiguous page-aligned memory
- * \param[in] unref_aligned function for releasing allocated memory
+ * \param[in] unref_aligned function for releasing allocated memory; returns
+ *                          the number of released page frames
  * \return 0 if successful, or a negative error code otherwise
  */
 int
 vmem_init(struct vmem* vmem,
           void* (alloc_aligned)(size_t, void*),
-          void (*unref_aligned)(void*, size_t, void*), void* alloc_data);
+          size_t (*unref_aligned)(void*, size_t, void*), void* alloc_data);
 
 int
 vmem_init_from_parent(struct vmem* vmem, struct vmem* parent);
 
-void
+/**
+ * \brief release the address space's pages, page tables and page directory
+ * \param[in] vmem the address space
+ * \return the number of page frames that have been returned to pmem
+ */
+size_t
 vmem_uninit(struct vmem* vmem);
 
 int
@@ -74,11 +80,65 @@ vmem_alloc_pages_in_area(struct vmem* vmem,
                          size_t pgcount,
                          unsigned int flags);
 
+/**
+ * \brief unmap pages and unref their page frames
+ * \param[in] vmem the address space
+ * \param pgindex the first page
+ * \param pgcount the number of pages
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+vmem_unmap_pages_at(struct vmem* vmem, os_index_t pgindex, size_t pgcount);
+
 int
 vmem_map_pages_at(struct vmem* dst_as, os_index_t dst_pgindex,
                   struct vmem* src_as, os_index_t src_pgindex,
                   size_t pgcount, unsigned long pteflags);
 
+/**
+ * \brief share pages with another address space
+ * \param[in] dst_as the destination address space
+ * \param dst_pgindex the first destination page
+ * \param[in] src_as the source address space
+ * \param src_pgindex the first source page
+ * \param pgcount the number of pages
+ * \param pteflags the flags of the new mappings
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+vmem_share_pages_at(struct vmem* dst_as, os_index_t dst_pgindex,
+                    struct vmem* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags);
+
+/**
+ * \brief move pages to another address space
+ * \param[in] dst_as the destination address space
+ * \param dst_pgindex the first destination page
+ * \param[in] src_as the source address space
+ * \param src_pgindex the first source page
+ * \param pgcount the number of pages
+ * \param pteflags the flags of the new mappings
+ * \return 0 on success, or a negative error code otherwise
+ */
+int
+vmem_grant_pages_at(struct vmem* dst_as, os_index_t dst_pgindex,
+                    struct vmem* src_as, os_index_t src_pgindex,
+                    size_t pgcount, unsigned long pteflags);
+
+/**
+ * \brief remove an address space's pages from all other address spaces
+ * \param[in] vmem the address space
+ * \param pgindex the first page
+ * \param pgcount the number of pages
+ * \return 0 on success, or a negative error code otherwise
+ *
+ * Other address spaces are locked while their mappings are removed.
+ * Fails with -EINVAL if the range contains a page table that the
+ * address space borrowed from another address space.
+ */
+int
+vmem_revoke_pages_at(struct vmem* vmem, os_index_t pgindex, size_t pgcount);
+
 os_index_t
 vmem_map_pages_within(struct vmem* dst_as, os_index_t pg_index_min,
                       os_index_t pg_index_max, struct vmem* src_as,
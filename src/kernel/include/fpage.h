@@ -0,0 +1,79 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <ipc_consts.h>
+
+/**
+ * A flexpage describes a naturally aligned range of 2^n pages and
+ * the access rights for mapping it. The first page's index is stored
+ * in bits 12 to 31, the size's logarithm in bits 4 to 9, and the
+ * rights IPC_MMAP_RD, IPC_MMAP_WR and IPC_MMAP_EX in bits 1 to 3.
+ */
+typedef unsigned long fpage_type;
+
+enum {
+    FPAGE_RIGHTS_MASK = IPC_MMAP_RD | IPC_MMAP_WR | IPC_MMAP_EX,
+    FPAGE_LOG2_MAX    = 20 /**< \brief the complete address space */
+};
+
+static inline fpage_type
+fpage_create(unsigned long pgindex, unsigned int log2npages,
+             unsigned int rights)
+{
+    return (pgindex << 12) |
+           ((log2npages & 0x3f) << 4) |
+           (rights & FPAGE_RIGHTS_MASK);
+}
+
+static inline unsigned long
+fpage_get_pgindex(fpage_type fpage)
+{
+    return fpage >> 12;
+}
+
+static inline unsigned int
+fpage_get_log2npages(fpage_type fpage)
+{
+    return (fpage >> 4) & 0x3f;
+}
+
+static inline unsigned long
+fpage_get_npages(fpage_type fpage)
+{
+    return 1ul << fpage_get_log2npages(fpage);
+}
+
+static inline unsigned int
+fpage_get_rights(fpage_type fpage)
+{
+    return fpage & FPAGE_RIGHTS_MASK;
+}
+
+/**
+ * \brief tests if a flexpage is well-formed
+ * \param fpage the flexpage
+ * \return non-zero if the size is valid and the first page is aligned
+ */
+static inline int
+fpage_is_valid(fpage_type fpage)
+{
+    return (fpage_get_log2npages(fpage) <= FPAGE_LOG2_MAX) &&
+           !(fpage_get_pgindex(fpage) & (fpage_get_npages(fpage) - 1));
+}
@@ -20,14 +20,30 @@
 
 enum ipc_msg_flags {
     IPC_MSG_FLAGS_RESERVED = 0xe0000000,
+    IPC_MSG_FLAGS_GRANT    = 1<<19, /**< \brief move flexpage in msg0 to receiver */
+    IPC_MSG_FLAGS_MAP      = 1<<18, /**< \brief share flexpage in msg0 with receiver */
     IPC_MSG_FLAGS_MMAP     = 1<<17,
     IPC_MSG_FLAG_IS_ERRNO  = 1<<16
 };
 
 enum {
     IPC_OPSYS_TASK_QUIT = 0,
+    IPC_OPSYS_DUMP_ALLOC_STATS = 2, /**< \brief print allocation statistics */
+    IPC_OPSYS_KBD_SUBSCRIBE = 3, /**< \brief receive keyboard scancodes */
+    IPC_OPSYS_KBD_SCANCODES = 4, /**< \brief notification with scancodes */
+    IPC_OPSYS_TRACE_SET_EVENTS = 5, /**< \brief enable trace events in msg0 */
+    IPC_OPSYS_TRACE_DUMP = 6, /**< \brief write trace buffers to serial port */
+    IPC_OPSYS_KMALLOC_SHRINK = 7 /**< \brief keep msg0 empty slabs, release the rest */
 };
 
+/*
+ * A scancode notification carries up to 8 scancodes, in order from
+ * the lowest byte of msg0 to the highest byte of msg1. The number of
+ * scancodes is stored in the flags.
+ */
+
+#define IPC_OPSYS_KBD_NSCANCODES(flags_)    (((flags_) >> 8) & 0xf)
+
 enum {
     IPC_MMAP_RD = 1<<1, /**< \brief map pages readable */
     IPC_MMAP_WR = 1<<2, /**< \brief map pages writeable */
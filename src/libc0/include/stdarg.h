@@ -19,13 +19,15 @@
 
 #pragma once
 
-#define va_list                 void*
+/* The calling convention is up to the compiler, so we use its
+ * built-in implementation. */
 
-#define va_start(__ap, __arg)   ((__ap) = ((char*)&(__arg))+sizeof(__arg))
+typedef __builtin_va_list va_list;
 
-#define va_arg(__ap, __type)    (*((__type*)(__ap)));   \
-                                {char *cp = (char*)(__ap);     \
-                                 cp += sizeof(__type);  \
-                                 (__ap) = cp;}
+#define va_start(__ap, __arg)   __builtin_va_start(__ap, __arg)
 
-#define va_end(__ap)
+#define va_arg(__ap, __type)    __builtin_va_arg(__ap, __type)
+
+#define va_copy(__dst, __src)   __builtin_va_copy(__dst, __src)
+
+#define va_end(__ap)            __builtin_va_end(__ap)
@@ -0,0 +1,56 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdarg.h>
+#include <sys/types.h>
+
+/*
+ * The formatting functions write into caller-provided buffers and
+ * never allocate memory. Supported are the flags '-', '0', '+', ' '
+ * and '#', field width and precision, either as number or as '*',
+ * the length modifiers hh, h, l, ll, j, z and t, and the conversions
+ * d, i, u, o, x, X, c, s, p and %.
+ */
+
+/**
+ * \brief formats a string into a buffer
+ * \param[out] buf the output buffer
+ * \param size the size of the output buffer in bytes
+ * \param[in] fmt the format string
+ * \param args the format arguments
+ * \return the length of the formatted string without truncation
+ *
+ * At most size - 1 characters are written, followed by a
+ * terminating NUL character if size is not 0.
+ */
+int
+vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+        __attribute__((format(printf, 3, 0)));
+
+/**
+ * \brief formats a string into a buffer
+ * \param[out] buf the output buffer
+ * \param size the size of the output buffer in bytes
+ * \param[in] fmt the format string
+ * \return the length of the formatted string without truncation
+ */
+int
+snprintf(char *buf, size_t size, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
@@ -0,0 +1,599 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Numbers are converted backwards from the end of a small buffer.
+ * Decimal conversion produces two digits per division with a table
+ * of digit pairs. Values beyond 32 bit are split into 4-digit chunks
+ * first, so the conversion never needs 64-bit division.
+ */
+
+static const char digit_pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+enum {
+        FLAG_LEFT  = 1 << 0, /* '-' */
+        FLAG_ZERO  = 1 << 1, /* '0' */
+        FLAG_PLUS  = 1 << 2, /* '+' */
+        FLAG_SPACE = 1 << 3, /* ' ' */
+        FLAG_ALT   = 1 << 4  /* '#' */
+};
+
+enum length {
+        LENGTH_INT = 0,
+        LENGTH_CHAR,
+        LENGTH_SHORT,
+        LENGTH_LONG,
+        LENGTH_LLONG,
+        LENGTH_SIZE
+};
+
+enum {
+        /* enough for 64-bit octal numbers */
+        NUMBUF_SIZE = 24
+};
+
+struct outbuf {
+        char   *buf;
+        size_t size;
+        size_t len; /* length without truncation */
+};
+
+static void
+put_chars(struct outbuf *out, const char *str, size_t len)
+{
+        if (out->len < out->size)
+        {
+                size_t n = out->size - out->len;
+
+                memcpy(out->buf + out->len, str, len < n ? len : n);
+        }
+
+        out->len += len;
+}
+
+static void
+put_repeated(struct outbuf *out, char c, size_t n)
+{
+        for (; n; --n)
+        {
+                if (out->len < out->size)
+                {
+                        out->buf[out->len] = c;
+                }
+                ++out->len;
+        }
+}
+
+static char *
+put_digit_pair(char *end, unsigned long i)
+{
+        *(--end) = digit_pairs[2*i+1];
+        *(--end) = digit_pairs[2*i];
+
+        return end;
+}
+
+static char *
+u32_to_dec(uint32_t v, char *end)
+{
+        while (v >= 100)
+        {
+                end = put_digit_pair(end, v % 100);
+                v /= 100;
+        }
+
+        if (v >= 10)
+        {
+                end = put_digit_pair(end, v);
+        }
+        else
+        {
+                *(--end) = '0' + v;
+        }
+
+        return end;
+}
+
+/* divides by 10000 in 16-bit steps; returns the remainder */
+static uint32_t
+u64_div10000(uint64_t *v)
+{
+        uint64_t q = 0;
+        uint32_t rem = 0;
+        int shift;
+
+        for (shift = 48; shift >= 0; shift -= 16)
+        {
+                uint32_t cur = (rem << 16) | ((uint32_t)(*v >> shift) & 0xffff);
+
+                q = (q << 16) | (cur / 10000);
+                rem = cur % 10000;
+        }
+
+        *v = q;
+
+        return rem;
+}
+
+static char *
+u64_to_dec(uint64_t v, char *end)
+{
+        while (v >> 32)
+        {
+                uint32_t rem = u64_div10000(&v);
+
+                end = put_digit_pair(end, rem % 100);
+                end = put_digit_pair(end, rem / 100);
+        }
+
+        return u32_to_dec(v, end);
+}
+
+static char *
+u64_to_base2n(uint64_t v, char *end, unsigned int shift, bool upper)
+{
+        static const char lower_digits[] = "0123456789abcdef";
+        static const char upper_digits[] = "0123456789ABCDEF";
+
+        const char *digits = upper ? upper_digits : lower_digits;
+        unsigned long mask = (1ul << shift) - 1;
+
+        do
+        {
+                *(--end) = digits[v & mask];
+                v >>= shift;
+        } while (v);
+
+        return end;
+}
+
+struct spec {
+        unsigned long flags;
+        size_t        width;
+        long          prec; /* -1 if unspecified */
+        enum length   length;
+};
+
+static void
+put_padded(struct outbuf *out, const struct spec *spec,
+           const char *prefix, size_t prefixlen,
+           const char *str, size_t len, size_t nzeros)
+{
+        size_t total = prefixlen + nzeros + len;
+        size_t npad = spec->width > total ? spec->width - total : 0;
+
+        if ((spec->flags & FLAG_ZERO) && !(spec->flags & FLAG_LEFT))
+        {
+                /* zeros go between prefix and digits */
+                nzeros += npad;
+                npad = 0;
+        }
+
+        if (!(spec->flags & FLAG_LEFT))
+        {
+                put_repeated(out, ' ', npad);
+        }
+
+        put_chars(out, prefix, prefixlen);
+        put_repeated(out, '0', nzeros);
+        put_chars(out, str, len);
+
+        if (spec->flags & FLAG_LEFT)
+        {
+                put_repeated(out, ' ', npad);
+        }
+}
+
+static void
+put_number(struct outbuf *out, struct spec *spec, char conv,
+           uint64_t v, bool negative)
+{
+        char numbuf[NUMBUF_SIZE];
+        char *end = numbuf + sizeof(numbuf);
+        char *beg;
+        char prefix[2];
+        size_t prefixlen = 0;
+
+        if (!v && !spec->prec)
+        {
+                beg = end; /* explicit zero precision prints no digits */
+        }
+        else if ((conv == 'x') || (conv == 'X') || (conv == 'p'))
+        {
+                beg = u64_to_base2n(v, end, 4, conv == 'X');
+        }
+        else if (conv == 'o')
+        {
+                beg = u64_to_base2n(v, end, 3, false);
+        }
+        else
+        {
+                beg = u64_to_dec(v, end);
+        }
+
+        size_t len = end - beg;
+
+        /* sign and prefix */
+
+        if (negative)
+        {
+                prefix[prefixlen++] = '-';
+        }
+        else if (spec->flags & FLAG_PLUS)
+        {
+                prefix[prefixlen++] = '+';
+        }
+        else if (spec->flags & FLAG_SPACE)
+        {
+                prefix[prefixlen++] = ' ';
+        }
+
+        if ((spec->flags & FLAG_ALT) && v &&
+            ((conv == 'x') || (conv == 'X') || (conv == 'p')))
+        {
+                prefix[prefixlen++] = '0';
+                prefix[prefixlen++] = conv == 'X' ? 'X' : 'x';
+        }
+
+        size_t nzeros = 0;
+
+        if (spec->prec >= 0)
+        {
+                /* precision is the minimum number of digits */
+                if ((size_t)spec->prec > len)
+                {
+                        nzeros = spec->prec - len;
+                }
+                spec->flags &= ~FLAG_ZERO;
+        }
+
+        if ((conv == 'o') && (spec->flags & FLAG_ALT) &&
+            !nzeros && ((beg == end) || (*beg != '0')))
+        {
+                nzeros = 1;
+        }
+
+        put_padded(out, spec, prefix, prefixlen, beg, len, nzeros);
+}
+
+static const char *
+parse_uint(const char *fmt, size_t *value)
+{
+        for (*value = 0; (*fmt >= '0') && (*fmt <= '9'); ++fmt)
+        {
+                *value = *value * 10 + (*fmt - '0');
+        }
+
+        return fmt;
+}
+
+int
+vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+        struct outbuf out = {
+                .buf = buf,
+                .size = size ? size - 1 : 0,
+                .len = 0
+        };
+
+        while (*fmt)
+        {
+                const char *beg = fmt;
+
+                /* copy plain text at once */
+
+                while (*fmt && (*fmt != '%'))
+                {
+                        ++fmt;
+                }
+                put_chars(&out, beg, fmt - beg);
+
+                if (!*fmt)
+                {
+                        break;
+                }
+                ++fmt;
+
+                struct spec spec = {
+                        .flags = 0,
+                        .width = 0,
+                        .prec = -1,
+                        .length = LENGTH_INT
+                };
+
+                /* flags */
+
+                for (;; ++fmt)
+                {
+                        if (*fmt == '-')
+                        {
+                                spec.flags |= FLAG_LEFT;
+                        }
+                        else if (*fmt == '0')
+                        {
+                                spec.flags |= FLAG_ZERO;
+                        }
+                        else if (*fmt == '+')
+                        {
+                                spec.flags |= FLAG_PLUS;
+                        }
+                        else if (*fmt == ' ')
+                        {
+                                spec.flags |= FLAG_SPACE;
+                        }
+                        else if (*fmt == '#')
+                        {
+                                spec.flags |= FLAG_ALT;
+                        }
+                        else
+                        {
+                                break;
+                        }
+                }
+
+                /* width */
+
+                if (*fmt == '*')
+                {
+                        int width;
+                        width = va_arg(args, int);
+                        if (width < 0)
+                        {
+                                spec.flags |= FLAG_LEFT;
+                                width = -width;
+                        }
+                        spec.width = width;
+                        ++fmt;
+                }
+                else
+                {
+                        fmt = parse_uint(fmt, &spec.width);
+                }
+
+                /* precision */
+
+                if (*fmt == '.')
+                {
+                        ++fmt;
+
+                        if (*fmt == '*')
+                        {
+                                int prec;
+                                prec = va_arg(args, int);
+                                spec.prec = prec < 0 ? -1 : prec;
+                                ++fmt;
+                        }
+                        else
+                        {
+                                size_t prec;
+                                fmt = parse_uint(fmt, &prec);
+                                spec.prec = prec;
+                        }
+                }
+
+                /* length modifier */
+
+                switch (*fmt)
+                {
+                        case 'h':
+                                ++fmt;
+                                if (*fmt == 'h')
+                                {
+                                        spec.length = LENGTH_CHAR;
+                                        ++fmt;
+                                }
+                                else
+                                {
+                                        spec.length = LENGTH_SHORT;
+                                }
+                                break;
+                        case 'l':
+                                ++fmt;
+                                if (*fmt == 'l')
+                                {
+                                        spec.length = LENGTH_LLONG;
+                                        ++fmt;
+                                }
+                                else
+                                {
+                                        spec.length = LENGTH_LONG;
+                                }
+                                break;
+                        case 'j':
+                                spec.length = LENGTH_LLONG;
+                                ++fmt;
+                                break;
+                        case 'z':
+                        case 't':
+                                spec.length = LENGTH_SIZE;
+                                ++fmt;
+                                break;
+                        default:
+                                break;
+                }
+
+                /* conversion */
+
+                char conv = *fmt;
+
+                switch (conv)
+                {
+                        case 'd':
+                        case 'i':
+                                {
+                                        long long v;
+
+                                        if (spec.length == LENGTH_LLONG)
+                                        {
+                                                v = va_arg(args, long long);
+                                        }
+                                        else if (spec.length == LENGTH_LONG)
+                                        {
+                                                v = va_arg(args, long);
+                                        }
+                                        else if (spec.length == LENGTH_SIZE)
+                                        {
+                                                v = va_arg(args, ssize_t);
+                                        }
+                                        else
+                                        {
+                                                v = va_arg(args, int);
+                                        }
+
+                                        if (spec.length == LENGTH_CHAR)
+                                        {
+                                                v = (signed char)v;
+                                        }
+                                        else if (spec.length == LENGTH_SHORT)
+                                        {
+                                                v = (short)v;
+                                        }
+
+                                        put_number(&out, &spec, conv,
+                                                   v < 0 ? -(uint64_t)v : v,
+                                                   v < 0);
+                                }
+                                break;
+                        case 'u':
+                        case 'o':
+                        case 'x':
+                        case 'X':
+                                {
+                                        unsigned long long v;
+
+                                        if (spec.length == LENGTH_LLONG)
+                                        {
+                                                v = va_arg(args,
+                                                           unsigned long long);
+                                        }
+                                        else if (spec.length == LENGTH_LONG)
+                                        {
+                                                v = va_arg(args, unsigned long);
+                                        }
+                                        else if (spec.length == LENGTH_SIZE)
+                                        {
+                                                v = va_arg(args, size_t);
+                                        }
+                                        else
+                                        {
+                                                v = va_arg(args, unsigned int);
+                                        }
+
+                                        if (spec.length == LENGTH_CHAR)
+                                        {
+                                                v = (unsigned char)v;
+                                        }
+                                        else if (spec.length == LENGTH_SHORT)
+                                        {
+                                                v = (unsigned short)v;
+                                        }
+
+                                        put_number(&out, &spec, conv, v, false);
+                                }
+                                break;
+                        case 'p':
+                                {
+                                        uintptr_t v;
+                                        v = va_arg(args, uintptr_t);
+                                        spec.flags |= FLAG_ALT;
+                                        put_number(&out, &spec, conv, v, false);
+                                }
+                                break;
+                        case 'c':
+                                {
+                                        char c;
+                                        c = va_arg(args, int);
+                                        spec.flags &= ~FLAG_ZERO;
+                                        put_padded(&out, &spec, NULL, 0,
+                                                   &c, 1, 0);
+                                }
+                                break;
+                        case 's':
+                                {
+                                        const char *s;
+                                        s = va_arg(args, const char *);
+                                        if (!s)
+                                        {
+                                                s = "(null)";
+                                        }
+
+                                        /* don't read beyond precision */
+                                        size_t len = 0;
+                                        while (((spec.prec < 0) ||
+                                                (len < (size_t)spec.prec)) &&
+                                               s[len])
+                                        {
+                                                ++len;
+                                        }
+
+                                        spec.flags &= ~FLAG_ZERO;
+                                        put_padded(&out, &spec, NULL, 0,
+                                                   s, len, 0);
+                                }
+                                break;
+                        case '%':
+                                put_chars(&out, "%", 1);
+                                break;
+                        case '\0':
+                                --fmt; /* trailing '%' */
+                                break;
+                        default:
+                                /* unknown conversion; print as is */
+                                put_chars(&out, fmt, 1);
+                                break;
+                }
+
+                ++fmt;
+        }
+
+        if (size)
+        {
+                buf[out.len < out.size ? out.len : out.size] = '\0';
+        }
+
+        return out.len;
+}
+
+int
+snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+        int len;
+        va_list args;
+
+        va_start(args, fmt);
+        len = vsnprintf(buf, size, fmt, args);
+        va_end(args);
+
+        return len;
+}
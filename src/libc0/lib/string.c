@@ -19,26 +19,90 @@
 
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+
+/*
+ * The memory functions handle unaligned heads and tails byte-wise
+ * and process the aligned middle in 32-bit words. Bulk copies and
+ * fills use the i386 string instructions.
+ */
+
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+enum {
+        WORD_SIZE = sizeof(word_t),
+        WORD_MASK = WORD_SIZE-1,
+        WORD_BULK_MIN = 4*WORD_SIZE /* shorter ranges are done byte-wise */
+};
+
+static __inline__ size_t
+word_misalignment(const void *mem)
+{
+        return ((uintptr_t)mem) & WORD_MASK;
+}
+
+static __inline__ size_t
+bytes_to_word_boundary(const void *mem)
+{
+        return (-(uintptr_t)mem) & WORD_MASK;
+}
+
+static __inline__ int
+word_has_zero_byte(word_t w)
+{
+        return !!((w - 0x01010101ul) & ~w & 0x80808080ul);
+}
+
+static __inline__ int
+compare_bytes(unsigned char c1, unsigned char c2)
+{
+        return c1 < c2 ? -1 : 1;
+}
 
 int
 memcmp(const void *s1, const void *s2, size_t n)
 {
-        int res;
         const unsigned char *c1, *c2;
 
-        res = 0;
         c1 = s1;
         c2 = s2;
 
-        while (n && !res)
+        /*
+         * compare words if both ranges share their alignment; a
+         * differing word is resolved by the byte loop below
+         */
+
+        if ((n >= WORD_BULK_MIN) &&
+            (word_misalignment(c1) == word_misalignment(c2)))
         {
-                res = *c1 == *c2 ? 0 : *c1 < *c2 ? -1 : 1;
-                --n;
-                ++s1;
-                ++s2;
+                for (; word_misalignment(c1); --n, ++c1, ++c2)
+                {
+                        if (*c1 != *c2)
+                        {
+                                return compare_bytes(*c1, *c2);
+                        }
+                }
+
+                for (; n >= WORD_SIZE; n -= WORD_SIZE,
+                                       c1 += WORD_SIZE,
+                                       c2 += WORD_SIZE)
+                {
+                        if (*(const word_t *)c1 != *(const word_t *)c2)
+                        {
+                                break;
+                        }
+                }
+        }
+
+        for (; n; --n, ++c1, ++c2)
+        {
+                if (*c1 != *c2)
+                {
+                        return compare_bytes(*c1, *c2);
+                }
         }
 
-        return res;
+        return 0;
 }
 
 void *
@@ -50,12 +114,28 @@ memcpy(void *dest, const void *src, size_t n)
         cdest = dest;
         csrc = src;
 
-        while (n)
+        if (n >= WORD_BULK_MIN)
+        {
+                size_t nhead, nwords;
+
+                /* align destination, copy words, leave tail */
+                nhead = bytes_to_word_boundary(cdest);
+                nwords = (n - nhead) / WORD_SIZE;
+                n = (n - nhead) & WORD_MASK;
+
+                __asm__ __volatile__("rep movsb\n\t"
+                                     : "+D"(cdest), "+S"(csrc), "+c"(nhead)
+                                     :
+                                     : "memory");
+                __asm__ __volatile__("rep movsl\n\t"
+                                     : "+D"(cdest), "+S"(csrc), "+c"(nwords)
+                                     :
+                                     : "memory");
+        }
+
+        for (; n; --n, ++cdest, ++csrc)
         {
                 *cdest = *csrc;
-                --n;
-                ++cdest;
-                ++csrc;
         }
 
         return dest;
@@ -66,11 +146,30 @@ memset(void *mem, int c, size_t n)
 {
         unsigned char *s = mem;
 
-        while (n)
+        if (n >= WORD_BULK_MIN)
+        {
+                size_t nhead, nwords;
+                word_t pattern;
+
+                pattern = ((unsigned char)c) * 0x01010101ul;
+
+                nhead = bytes_to_word_boundary(s);
+                nwords = (n - nhead) / WORD_SIZE;
+                n = (n - nhead) & WORD_MASK;
+
+                __asm__ __volatile__("rep stosb\n\t"
+                                     : "+D"(s), "+c"(nhead)
+                                     : "a"(pattern)
+                                     : "memory");
+                __asm__ __volatile__("rep stosl\n\t"
+                                     : "+D"(s), "+c"(nwords)
+                                     : "a"(pattern)
+                                     : "memory");
+        }
+
+        for (; n; --n, ++s)
         {
                 *s = c;
-                ++s;
-                --n;
         }
 
         return mem;
@@ -113,13 +212,25 @@ strerror_l(int errnum, char *strerrbuf, size_t buflen)
 size_t
 strlen(const char *str)
 {
-        size_t len = 0;
+        const char *s;
+        const word_t *w;
+
+        /*
+         * Aligned words never cross a page boundary, so reading
+         * beyond the terminating zero byte cannot fault.
+         */
 
-        while (*str)
+        for (s = str; word_misalignment(s); ++s)
         {
-                ++str;
-                ++len;
+                if (!*s)
+                {
+                        return s - str;
+                }
         }
 
-        return len;
+        for (w = (const word_t *)s; !word_has_zero_byte(*w); ++w) { }
+
+        for (s = (const char *)w; *s; ++s) { }
+
+        return s - str;
 }
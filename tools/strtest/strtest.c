@@ -0,0 +1,537 @@
+/*
+ *  opsys - A small, experimental operating system
+ *  Copyright (C) 2017  Thomas Zimmermann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host-side test for the libc0 string functions and the page helpers
+ * of the i386 kernel. Each function is compared with a byte-wise
+ * reference version for all small sizes and alignments, and for
+ * randomized sizes and alignments. With -b, the program also times
+ * each function against its reference version.
+ *
+ *   strtest [-b] [-n ITERATIONS] [-s SEED]
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "page.h"
+
+#define ARRAY_NELEMS(x)  \
+        ( sizeof(x)/sizeof((x)[0]) )
+
+/* libc0 functions, renamed at build time */
+int
+libc0_memcmp(const void *s1, const void *s2, size_t n);
+
+void *
+libc0_memcpy(void *dest, const void *src, size_t n);
+
+void *
+libc0_memset(void *mem, int c, size_t n);
+
+size_t
+libc0_strlen(const char *str);
+
+enum {
+        MAX_ALIGN = 16,             /* tested alignment offsets */
+        MAX_SMALL = 4*MAX_ALIGN,    /* exhaustively tested sizes */
+        MAX_LEN   = 2*PAGE_SIZE,    /* longest randomized size */
+        BUF_SIZE  = MAX_LEN + 2*MAX_ALIGN
+};
+
+static alignas(PAGE_SIZE) unsigned char g_src[BUF_SIZE];
+static alignas(PAGE_SIZE) unsigned char g_dst[BUF_SIZE];
+static alignas(PAGE_SIZE) unsigned char g_ref[BUF_SIZE];
+
+static unsigned long g_nfailures;
+
+/*
+ * Byte-wise reference versions
+ */
+
+static int
+ref_memcmp(const void *s1, const void *s2, size_t n)
+{
+        const unsigned char *c1 = s1, *c2 = s2;
+
+        for (; n; --n, ++c1, ++c2)
+        {
+                if (*c1 != *c2)
+                {
+                        return *c1 < *c2 ? -1 : 1;
+                }
+        }
+        return 0;
+}
+
+static void *
+ref_memcpy(void *dest, const void *src, size_t n)
+{
+        unsigned char *cdest = dest;
+        const unsigned char *csrc = src;
+
+        for (; n; --n, ++cdest, ++csrc)
+        {
+                *cdest = *csrc;
+        }
+        return dest;
+}
+
+static void *
+ref_memset(void *mem, int c, size_t n)
+{
+        unsigned char *s = mem;
+
+        for (; n; --n, ++s)
+        {
+                *s = c;
+        }
+        return mem;
+}
+
+static size_t
+ref_strlen(const char *str)
+{
+        const char *s;
+
+        for (s = str; *s; ++s) { }
+
+        return s - str;
+}
+
+static void
+ref_page_zero(void *page)
+{
+        ref_memset(page, 0, PAGE_SIZE);
+}
+
+static void
+ref_page_copy(void *dst, const void *src)
+{
+        ref_memcpy(dst, src, PAGE_SIZE);
+}
+
+/*
+ * Helpers
+ */
+
+static void
+fill_random(unsigned char *buf, size_t n)
+{
+        for (; n; --n, ++buf)
+        {
+                *buf = rand();
+        }
+}
+
+/* returns non-zero bytes, biased towards values that look like zero
+ * bytes to a careless word-wise scan */
+static unsigned char
+random_nonzero(void)
+{
+        static const unsigned char tricky[] = {
+                0x01, 0x7f, 0x80, 0x81, 0xfe, 0xff
+        };
+
+        if (rand() & 1)
+        {
+                return tricky[rand() % ARRAY_NELEMS(tricky)];
+        }
+        return 1 + rand() % 255;
+}
+
+/* returns sizes up to MAX_LEN, with small sizes more likely */
+static size_t
+random_len(void)
+{
+        switch (rand() % 4)
+        {
+                case 0:
+                        return rand() % MAX_SMALL;
+                case 1:
+                        return rand() % 256;
+                default:
+                        return rand() % (MAX_LEN + 1);
+        }
+}
+
+static int
+sign(int n)
+{
+        return (n > 0) - (n < 0);
+}
+
+static void
+fail(const char *func, size_t dstoff, size_t srcoff, size_t len)
+{
+        fprintf(stderr, "%s failed: dst+%zu src+%zu len %zu\n",
+                func, dstoff, srcoff, len);
+        ++g_nfailures;
+}
+
+/*
+ * Correctness tests
+ *
+ * Each test runs the libc0 function on g_dst and the reference
+ * function on g_ref, starting from identical content, and compares
+ * the complete buffers to detect over- and underruns.
+ */
+
+static void
+test_memcpy(size_t dstoff, size_t srcoff, size_t len)
+{
+        fill_random(g_src, sizeof(g_src));
+        fill_random(g_dst, sizeof(g_dst));
+        memcpy(g_ref, g_dst, sizeof(g_ref));
+
+        void *res = libc0_memcpy(g_dst + dstoff, g_src + srcoff, len);
+        ref_memcpy(g_ref + dstoff, g_src + srcoff, len);
+
+        if ((res != g_dst + dstoff) || memcmp(g_dst, g_ref, sizeof(g_dst)))
+        {
+                fail("memcpy", dstoff, srcoff, len);
+        }
+}
+
+static void
+test_memset(size_t dstoff, size_t len)
+{
+        int c = rand();
+
+        fill_random(g_dst, sizeof(g_dst));
+        memcpy(g_ref, g_dst, sizeof(g_ref));
+
+        void *res = libc0_memset(g_dst + dstoff, c, len);
+        ref_memset(g_ref + dstoff, c, len);
+
+        if ((res != g_dst + dstoff) || memcmp(g_dst, g_ref, sizeof(g_dst)))
+        {
+                fail("memset", dstoff, 0, len);
+        }
+}
+
+static void
+test_memcmp(size_t dstoff, size_t srcoff, size_t len)
+{
+        fill_random(g_src, sizeof(g_src));
+        memcpy(g_dst + dstoff, g_src + srcoff, len);
+
+        /* differ at a random position inside or just behind the range,
+         * or not at all */
+        if (rand() % 4)
+        {
+                size_t i = rand() % (len + 1);
+                g_dst[dstoff + i] = rand();
+        }
+
+        int res = libc0_memcmp(g_dst + dstoff, g_src + srcoff, len);
+        int ref = ref_memcmp(g_dst + dstoff, g_src + srcoff, len);
+
+        if (sign(res) != sign(ref))
+        {
+                fail("memcmp", dstoff, srcoff, len);
+        }
+}
+
+static void
+test_strlen(size_t srcoff, size_t len)
+{
+        for (size_t i = 0; i < sizeof(g_src); ++i)
+        {
+                g_src[i] = random_nonzero();
+        }
+        g_src[srcoff + len] = '\0';
+
+        const char *str = (const char *)g_src + srcoff;
+
+        if (libc0_strlen(str) != ref_strlen(str))
+        {
+                fail("strlen", 0, srcoff, len);
+        }
+}
+
+static void
+test_page_copy(void)
+{
+        fill_random(g_src, sizeof(g_src));
+        fill_random(g_dst, sizeof(g_dst));
+        memcpy(g_ref, g_dst, sizeof(g_ref));
+
+        page_copy(g_dst + PAGE_SIZE, g_src);
+        ref_page_copy(g_ref + PAGE_SIZE, g_src);
+
+        if (memcmp(g_dst, g_ref, sizeof(g_dst)))
+        {
+                fail("page_copy", PAGE_SIZE, 0, PAGE_SIZE);
+        }
+}
+
+static void
+test_page_zero(void)
+{
+        fill_random(g_dst, sizeof(g_dst));
+        memcpy(g_ref, g_dst, sizeof(g_ref));
+
+        page_zero(g_dst + PAGE_SIZE);
+        ref_page_zero(g_ref + PAGE_SIZE);
+
+        if (memcmp(g_dst, g_ref, sizeof(g_dst)))
+        {
+                fail("page_zero", PAGE_SIZE, 0, PAGE_SIZE);
+        }
+}
+
+static void
+run_tests(unsigned long niterations)
+{
+        /* all small sizes and alignments */
+
+        for (size_t len = 0; len < MAX_SMALL; ++len)
+        {
+                for (size_t dstoff = 0; dstoff < MAX_ALIGN; ++dstoff)
+                {
+                        for (size_t srcoff = 0; srcoff < MAX_ALIGN; ++srcoff)
+                        {
+                                test_memcpy(dstoff, srcoff, len);
+                                test_memcmp(dstoff, srcoff, len);
+                        }
+                        test_memset(dstoff, len);
+                        test_strlen(dstoff, len);
+                }
+        }
+
+        /* randomized sizes and alignments */
+
+        for (unsigned long i = 0; i < niterations; ++i)
+        {
+                size_t dstoff = rand() % MAX_ALIGN;
+                size_t srcoff = rand() % MAX_ALIGN;
+
+                test_memcpy(dstoff, srcoff, random_len());
+                test_memset(dstoff, random_len());
+                test_memcmp(dstoff, srcoff, random_len());
+                test_strlen(srcoff, random_len());
+        }
+
+        test_page_copy();
+        test_page_zero();
+}
+
+/*
+ * Timing harness
+ */
+
+enum {
+        BENCH_NSEC = 100000000 /* run each benchmark for about 0.1 s */
+};
+
+static volatile size_t g_sink; /* keeps results alive */
+
+static unsigned long long
+now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+enum bench_func {
+        BENCH_MEMCPY,
+        BENCH_MEMSET,
+        BENCH_MEMCMP,
+        BENCH_STRLEN,
+        BENCH_PAGE_COPY,
+        BENCH_PAGE_ZERO
+};
+
+static const char * const g_bench_name[] = {
+        [BENCH_MEMCPY]    = "memcpy",
+        [BENCH_MEMSET]    = "memset",
+        [BENCH_MEMCMP]    = "memcmp",
+        [BENCH_STRLEN]    = "strlen",
+        [BENCH_PAGE_COPY] = "page_copy",
+        [BENCH_PAGE_ZERO] = "page_zero"
+};
+
+static void
+call(enum bench_func func, int ref, size_t off, size_t len)
+{
+        unsigned char *dst = g_dst + off;
+        const unsigned char *src = g_src + off;
+
+        switch (func)
+        {
+                case BENCH_MEMCPY:
+                        g_sink = (size_t)(ref ? ref_memcpy(dst, src, len)
+                                              : libc0_memcpy(dst, src, len));
+                        break;
+                case BENCH_MEMSET:
+                        g_sink = (size_t)(ref ? ref_memset(dst, 0, len)
+                                              : libc0_memset(dst, 0, len));
+                        break;
+                case BENCH_MEMCMP:
+                        g_sink = ref ? ref_memcmp(dst, src, len)
+                                     : libc0_memcmp(dst, src, len);
+                        break;
+                case BENCH_STRLEN:
+                        g_sink = ref ? ref_strlen((const char *)src)
+                                     : libc0_strlen((const char *)src);
+                        break;
+                case BENCH_PAGE_COPY:
+                        if (ref)
+                        {
+                                ref_page_copy(g_dst, g_src);
+                        }
+                        else
+                        {
+                                page_copy(g_dst, g_src);
+                        }
+                        break;
+                case BENCH_PAGE_ZERO:
+                        if (ref)
+                        {
+                                ref_page_zero(g_dst);
+                        }
+                        else
+                        {
+                                page_zero(g_dst);
+                        }
+                        break;
+        }
+}
+
+/* returns the average time of a call in nanoseconds */
+static double
+time_calls(enum bench_func func, int ref, size_t off, size_t len)
+{
+        unsigned long long beg, end;
+        unsigned long ncalls = 0;
+
+        beg = now_ns();
+
+        do
+        {
+                for (int i = 0; i < 64; ++i)
+                {
+                        call(func, ref, off, len);
+                }
+                ncalls += 64;
+                end = now_ns();
+        } while (end - beg < BENCH_NSEC);
+
+        return (double)(end - beg) / ncalls;
+}
+
+static void
+bench(enum bench_func func, size_t off, size_t len)
+{
+        /* equal buffers make memcmp run over the whole range; the
+         * source string has a length of len */
+        memset(g_src, 'x', sizeof(g_src));
+        memset(g_dst, 'x', sizeof(g_dst));
+        g_src[off + len] = '\0';
+        g_dst[off + len] = '\0';
+
+        double t = time_calls(func, 0, off, len);
+        double tref = time_calls(func, 1, off, len);
+
+        printf("%-10s %6zu %4zu %12.1f %12.1f %8.2fx\n",
+               g_bench_name[func], len, off, t, tref, tref / t);
+}
+
+static void
+run_benchmarks(void)
+{
+        static const size_t lens[] = {
+                8, 16, 64, 256, 1024, PAGE_SIZE
+        };
+        static const size_t offs[] = {
+                0, 1
+        };
+
+        printf("%-10s %6s %4s %12s %12s %9s\n",
+               "function", "len", "off", "libc0 [ns]", "ref [ns]", "speedup");
+
+        for (enum bench_func func = BENCH_MEMCPY; func <= BENCH_STRLEN; ++func)
+        {
+                for (size_t i = 0; i < ARRAY_NELEMS(lens); ++i)
+                {
+                        for (size_t j = 0; j < ARRAY_NELEMS(offs); ++j)
+                        {
+                                bench(func, offs[j], lens[i]);
+                        }
+                }
+        }
+
+        bench(BENCH_PAGE_COPY, 0, PAGE_SIZE);
+        bench(BENCH_PAGE_ZERO, 0, PAGE_SIZE);
+}
+
+int
+main(int argc, char *argv[])
+{
+        unsigned long niterations = 100000;
+        unsigned int seed = time(NULL);
+        int benchmark = 0;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "bn:s:")) != -1)
+        {
+                switch (opt)
+                {
+                        case 'b':
+                                benchmark = 1;
+                                break;
+                        case 'n':
+                                niterations = strtoul(optarg, NULL, 0);
+                                break;
+                        case 's':
+                                seed = strtoul(optarg, NULL, 0);
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-b] [-n ITERATIONS] [-s SEED]\n",
+                                        argv[0]);
+                                return EXIT_FAILURE;
+                }
+        }
+
+        printf("seed %u, %lu iterations\n", seed, niterations);
+        srand(seed);
+
+        run_tests(niterations);
+
+        if (g_nfailures)
+        {
+                printf("%lu failures\n", g_nfailures);
+                return EXIT_FAILURE;
+        }
+        printf("all tests passed\n");
+
+        if (benchmark)
+        {
+                run_benchmarks();
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+
+#
+#  opsys - A small, experimental operating system
+#  Copyright (C) 2017  Thomas Zimmermann
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Decodes kernel trace dumps from a serial-port capture.
+
+Reads the 'trace:' lines written by trace_dump() and ignores all
+other output. By default, writes a JSON file in the Trace Event
+Format, which chrome://tracing and Perfetto display as a timeline.
+With --text, writes one line per record instead.
+
+    tracedec.py [--text] [-o OUTPUT] [CAPTURE]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+# struct trace_record on i386
+RECORD = struct.Struct('<QHHLLL')
+
+# enum trace_event in src/kernel/bin/trace.h; names of the arguments
+EVENTS = [
+    ('sched_switch', ('prev', 'next', 'prio')),
+    ('ipc_send',     ('snd', 'rcv', 'flags')),
+    ('ipc_recv',     ('rcv', 'snd', 'flags')),
+    ('ipc_notify',   ('rcv', 'msg', 'flags')),
+    ('irq_enter',    ('irqno',)),
+    ('irq_exit',     ('irqno',)),
+    ('page_fault',   ('addr', 'errcode', 'ip')),
+    ('kmalloc',      ('addr', 'size', 'site')),
+    ('kfree',        ('addr',)),
+]
+
+DECIMAL_ARGS = ('prio', 'irqno', 'size')
+
+
+class Record:
+    def __init__(self, ns, cpu, event, args):
+        self.ns = ns
+        self.cpu = cpu
+        self.event = event
+        self.args = args
+
+    @property
+    def name(self):
+        if self.event < len(EVENTS):
+            return EVENTS[self.event][0]
+        return 'event%d' % self.event
+
+    def named_args(self):
+        names = EVENTS[self.event][1] if self.event < len(EVENTS) else ()
+        named = {}
+        for i, name in enumerate(names):
+            value = self.args[i]
+            named[name] = value if name in DECIMAL_ARGS else '%#x' % value
+        return named
+
+
+def parse_header(words):
+    fields = {}
+    for word in words:
+        key, _, value = word.partition('=')
+        fields[key] = int(value)
+    return fields
+
+
+def read_records(lines):
+    """Returns all records of all dumps, and the number of lost and
+    malformed records."""
+
+    records = []
+    nlost = 0
+    nbad = 0
+    header = None
+
+    for line in lines:
+        # the log may precede the dump on the same line
+        pos = line.find('trace: ')
+        if pos < 0:
+            continue
+        words = line[pos + len('trace: '):].split()
+        if not words:
+            continue
+
+        if words[0] == 'begin':
+            header = parse_header(words[1:])
+            nlost += header.get('lost', 0)
+        elif words[0] == 'end':
+            header = None
+        elif words[0] == 'r' and header:
+            try:
+                raw = bytes.fromhex(words[1])
+                tsc, event, cpu, a0, a1, a2 = RECORD.unpack(raw)
+            except (IndexError, ValueError, struct.error):
+                nbad += 1
+                continue
+            ns = (tsc * header['mult']) >> header['shift']
+            records.append(Record(ns, cpu, event, (a0, a1, a2)))
+
+    records.sort(key=lambda rec: rec.ns)
+
+    return records, nlost, nbad
+
+
+def write_text(records, out):
+    t0 = records[0].ns if records else 0
+    for rec in records:
+        args = ' '.join('%s=%s' % kv for kv in rec.named_args().items())
+        out.write('%12.3f us cpu%d %-12s %s\n' %
+                  ((rec.ns - t0) / 1000.0, rec.cpu, rec.name, args))
+
+
+def write_trace_events(records, out):
+    t0 = records[0].ns if records else 0
+    events = []
+    running = {}  # per CPU, the current thread and its start time
+
+    def us(ns):
+        return (ns - t0) / 1000.0
+
+    for rec in records:
+        if rec.name == 'sched_switch':
+            prev = running.get(rec.cpu)
+            if prev:
+                events.append({'name': 'tcb %#x' % prev[0], 'ph': 'X',
+                               'pid': 0, 'tid': rec.cpu,
+                               'ts': us(prev[1]),
+                               'dur': us(rec.ns) - us(prev[1])})
+            running[rec.cpu] = (rec.args[1], rec.ns)
+        elif rec.name in ('irq_enter', 'irq_exit'):
+            events.append({'name': 'irq %d' % rec.args[0],
+                           'ph': 'B' if rec.name == 'irq_enter' else 'E',
+                           'pid': 1, 'tid': rec.cpu, 'ts': us(rec.ns)})
+        else:
+            events.append({'name': rec.name, 'ph': 'i', 's': 't',
+                           'pid': 2, 'tid': rec.cpu, 'ts': us(rec.ns),
+                           'args': rec.named_args()})
+
+    metadata = [
+        {'name': 'process_name', 'ph': 'M', 'pid': 0,
+         'args': {'name': 'threads'}},
+        {'name': 'process_name', 'ph': 'M', 'pid': 1,
+         'args': {'name': 'interrupts'}},
+        {'name': 'process_name', 'ph': 'M', 'pid': 2,
+         'args': {'name': 'events'}},
+    ]
+
+    json.dump({'traceEvents': metadata + events,
+               'displayTimeUnit': 'ns'}, out, indent=1)
+    out.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode opsys trace dumps from a serial capture.')
+    parser.add_argument('capture', nargs='?',
+                        help='serial output; default is stdin')
+    parser.add_argument('-o', '--output', help='default is stdout')
+    parser.add_argument('--text', action='store_true',
+                        help='write plain text instead of trace events')
+    args = parser.parse_args()
+
+    infile = open(args.capture, errors='replace') if args.capture \
+        else sys.stdin
+    with infile:
+        records, nlost, nbad = read_records(infile)
+
+    if nlost:
+        sys.stderr.write('%d records were overwritten\n' % nlost)
+    if nbad:
+        sys.stderr.write('%d malformed records skipped\n' % nbad)
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    with out:
+        if args.text:
+            write_text(records, out)
+        else:
+            write_trace_events(records, out)
+
+
+if __name__ == '__main__':
+    main()